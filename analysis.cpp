@@ -0,0 +1,273 @@
+// Written by Alexis Wilke based on
+// https://en.wikipedia.org/wiki/Little_man_computer
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Source: 
+// https://github.com/AlexisWilke/little-man-computer
+
+
+#include    "analysis.h"
+
+#include    <iomanip>
+#include    <iterator>
+#include    <sstream>
+
+
+
+namespace lmc
+{
+
+
+
+namespace
+{
+
+
+
+char const * const g_cell_kind_names[] =
+{
+    "unused",       // CELL_UNUSED
+    "code",         // CELL_CODE
+    "data",         // CELL_DATA
+    "modified",     // CELL_MODIFIED
+};
+
+static_assert(std::size(g_cell_kind_names) == CELL_MODIFIED + 1);
+
+
+// same interpretation as machine::run_switch(); cells which are ignored
+// return MNEMONIC_NONE
+//
+mnemonic_t instruction_of(short cell)
+{
+    int const instruction(cell / 100);
+    return instruction >= MNEMONIC_HLT && instruction <= MNEMONIC_OUT
+                ? instruction
+                : MNEMONIC_NONE;
+}
+
+
+bool is_branch(mnemonic_t instruction)
+{
+    return instruction == MNEMONIC_BRA
+        || instruction == MNEMONIC_BRZ
+        || instruction == MNEMONIC_BRP;
+}
+
+
+bool falls_through(mnemonic_t instruction)
+{
+    return instruction != MNEMONIC_HLT
+        && instruction != MNEMONIC_BRA;
+}
+
+
+int next_pc(int pc)
+{
+    return pc + 1 == static_cast<int>(MEMORY_SIZE) ? 0 : pc + 1;
+}
+
+
+
+} // no name namespace
+
+
+
+void analyze(short const * cells, analysis & a, int entry)
+{
+    // keep the buffer of f_blocks so an analysis reused by a machine
+    // does not allocate on each run
+    //
+    std::vector<basic_block> blocks(std::move(a.f_blocks));
+    blocks.clear();
+    a = analysis();
+    a.f_blocks = std::move(blocks);
+
+    // find the cells reachable as code from 0 and from the entry point
+    //
+    bool reachable[MEMORY_SIZE] = {};
+    bool leader[MEMORY_SIZE] = {};
+    bool referenced[MEMORY_SIZE] = {};
+    int todo[MEMORY_SIZE];
+    int count(0);
+    auto const add = [&](int pc)
+    {
+        if(!reachable[pc])
+        {
+            reachable[pc] = true;
+            todo[count++] = pc;
+        }
+    };
+    add(0);
+    add(entry);
+    leader[0] = true;
+    leader[entry] = true;
+    while(count > 0)
+    {
+        int const pc(todo[--count]);
+        mnemonic_t const instruction(instruction_of(cells[pc]));
+        int const loc(cells[pc] % 100);
+        switch(instruction)
+        {
+        case MNEMONIC_STA:
+            a.f_stored[loc] = true;
+            referenced[loc] = true;
+            break;
+
+        case MNEMONIC_ADD:
+        case MNEMONIC_SUB:
+        case MNEMONIC_LDA:
+            referenced[loc] = true;
+            break;
+
+        }
+        if(is_branch(instruction))
+        {
+            a.f_target[loc] = true;
+            leader[loc] = true;
+            add(loc);
+        }
+        if(falls_through(instruction))
+        {
+            int const next(next_pc(pc));
+            if(next == 0)
+            {
+                a.f_target[0] = true;
+            }
+            if(is_branch(instruction))
+            {
+                leader[next] = true;
+            }
+            add(next);
+        }
+    }
+
+    for(std::size_t pc(0); pc < MEMORY_SIZE; ++pc)
+    {
+        if(reachable[pc])
+        {
+            a.f_kind[pc] = a.f_stored[pc] ? CELL_MODIFIED : CELL_CODE;
+            if(a.f_stored[pc])
+            {
+                a.f_self_modifying = true;
+            }
+        }
+        else if(referenced[pc])
+        {
+            a.f_kind[pc] = CELL_DATA;
+        }
+    }
+
+    // cut the reachable cells in basic blocks
+    //
+    for(int pc(0); pc < static_cast<int>(MEMORY_SIZE); ++pc)
+    {
+        if(!reachable[pc])
+        {
+            continue;
+        }
+        basic_block b;
+        b.f_first = pc;
+        for(;; ++pc)
+        {
+            mnemonic_t const instruction(instruction_of(cells[pc]));
+            int const next(next_pc(pc));
+            if(is_branch(instruction)
+            || !falls_through(instruction)
+            || next == 0
+            || !reachable[next]
+            || leader[next])
+            {
+                if(falls_through(instruction))
+                {
+                    b.f_next[0] = next;
+                }
+                if(is_branch(instruction))
+                {
+                    b.f_next[1] = cells[pc] % 100;
+                }
+                break;
+            }
+        }
+        b.f_last = pc;
+        a.f_blocks.push_back(b);
+    }
+}
+
+
+char const * cell_kind_name(cell_kind_t kind)
+{
+    if(static_cast<std::size_t>(kind) >= std::size(g_cell_kind_names))
+    {
+        return "?";
+    }
+    return g_cell_kind_names[kind];
+}
+
+
+// one line per cell used by the program followed by the control-flow
+// graph, one line per basic block
+//
+void print_analysis(program const & p, analysis const & a, std::ostream & out)
+{
+    out << "address  cell label        instruction          kind\n";
+    for(std::size_t pc(0); pc < MEMORY_SIZE; ++pc)
+    {
+        if(pc >= static_cast<std::size_t>(p.f_size)
+        && a.f_kind[pc] == CELL_UNUSED)
+        {
+            continue;
+        }
+        std::ostringstream line;
+        line << std::right << std::setw(7) << pc
+            << std::setw(6) << p.f_cells[pc]
+            << ' ' << std::left << std::setw(12) << label_name(p, pc)
+            << ' ' << std::setw(20)
+            << (a.f_kind[pc] == CELL_CODE || a.f_kind[pc] == CELL_MODIFIED
+                    ? disassemble(p, p.f_cells[pc])
+                    : "DAT " + std::to_string(p.f_cells[pc]))
+            << ' ' << cell_kind_name(a.f_kind[pc]);
+        out << line.str() << '\n';
+    }
+
+    out << "blocks:\n";
+    for(auto const & b : a.f_blocks)
+    {
+        out << std::right << std::setw(7) << b.f_first
+            << '-' << std::left << std::setw(3) << b.f_last << "->";
+        if(b.f_next[0] == -1
+        && b.f_next[1] == -1)
+        {
+            out << " end";
+        }
+        for(auto const next : b.f_next)
+        {
+            if(next != -1)
+            {
+                out << ' ' << next;
+            }
+        }
+        out << '\n';
+    }
+    if(a.f_self_modifying)
+    {
+        out << "the program modifies its own code.\n";
+    }
+}
+
+
+
+} // namespace lmc
+// vim: ts=4 sw=4 et
@@ -0,0 +1,77 @@
+// Written by Alexis Wilke based on
+// https://en.wikipedia.org/wiki/Little_man_computer
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Source: 
+// https://github.com/AlexisWilke/little-man-computer
+
+
+#pragma once
+
+#include    "program.h"
+
+#include    <iostream>
+#include    <vector>
+
+
+namespace lmc
+{
+
+
+
+typedef int cell_kind_t;
+
+constexpr cell_kind_t   CELL_UNUSED = 0;        // never reached nor referenced
+constexpr cell_kind_t   CELL_CODE = 1;          // reachable as an instruction
+constexpr cell_kind_t   CELL_DATA = 2;          // operand of an LDA, ADD, SUB or STA
+constexpr cell_kind_t   CELL_MODIFIED = 3;      // code which an STA overwrites
+
+
+// a run of cells executed one after the other; f_next[0] is the cell
+// reached by falling through and f_next[1] the branch target, -1 if none
+//
+struct basic_block
+{
+    int                 f_first = 0;
+    int                 f_last = 0;
+    int                 f_next[2] = { -1, -1 };
+};
+
+
+// The result of following all the paths from the entry point without
+// running the program. Each STA has a fixed target, so as long as none
+// of them writes to a code cell, the code can never change and this
+// analysis describes every possible execution. When f_self_modifying is
+// true, the cells marked CELL_MODIFIED may become anything at run time
+// and the rest of the result is only a hint.
+//
+struct analysis
+{
+    cell_kind_t                 f_kind[MEMORY_SIZE] = {};
+    bool                        f_target[MEMORY_SIZE] = {};     // reached by a branch or the PC wrapping
+    bool                        f_stored[MEMORY_SIZE] = {};     // written by an STA
+    bool                        f_self_modifying = false;
+    std::vector<basic_block>    f_blocks = {};
+};
+
+
+void                analyze(short const * cells, analysis & a, int entry = 0);
+char const *        cell_kind_name(cell_kind_t kind);
+void                print_analysis(program const & p, analysis const & a, std::ostream & out);
+
+
+
+} // namespace lmc
+// vim: ts=4 sw=4 et
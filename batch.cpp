@@ -0,0 +1,367 @@
+// Written by Alexis Wilke based on
+// https://en.wikipedia.org/wiki/Little_man_computer
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Source: 
+// https://github.com/AlexisWilke/little-man-computer
+
+
+#include    "batch.h"
+
+#include    "cache.h"
+#include    "lockstep.h"
+#include    "metrics.h"
+#include    "offload.h"
+
+#include    <atomic>
+#include    <fstream>
+#include    <sstream>
+#include    <thread>
+#include    <unordered_map>
+
+
+
+namespace lmc
+{
+
+
+
+// the input file has one vector of numbers per line; empty lines and
+// lines starting with '#' are ignored
+//
+bool load_batch(std::string const & filename, std::vector<batch_job> & jobs)
+{
+    std::ifstream in;
+    in.open(filename);
+    if(!in.is_open())
+    {
+        std::cerr << "error: could not open \"" << filename
+            << "\" for reading.\n";
+        return false;
+    }
+
+    int errcount(0);
+    int line(0);
+    std::string input;
+    while(std::getline(in, input))
+    {
+        ++line;
+        std::string::size_type const start(input.find_first_not_of(" \t\r"));
+        if(start == std::string::npos
+        || input[start] == '#')
+        {
+            continue;
+        }
+
+        batch_job job;
+        job.f_line = line;
+        std::istringstream values(input);
+        int value(0);
+        while(values >> value)
+        {
+            job.f_inputs.push_back(value);
+        }
+        if(!values.eof())
+        {
+            ++errcount;
+            std::cerr << "error:" << filename << ":" << line
+                << ": input vectors can only include integers.\n";
+            continue;
+        }
+        jobs.push_back(std::move(job));
+    }
+
+    if(errcount != 0)
+    {
+        std::cerr << "found " << errcount << " errors.\n";
+        return false;
+    }
+
+    return true;
+}
+
+
+namespace
+{
+
+
+
+// a worker keeps one machine for all its jobs (so the JIT only gets
+// mapped and compiled once per thread); these give it the input and
+// output of whichever job it currently runs
+//
+class job_input
+    : public input
+{
+public:
+    void set(std::vector<int> const & values)
+    {
+        f_values = &values;
+        f_pos = 0;
+    }
+
+    virtual bool read(int & value) override
+    {
+        if(f_pos >= f_values->size())
+        {
+            return false;
+        }
+        value = (*f_values)[f_pos];
+        ++f_pos;
+        return true;
+    }
+
+private:
+    std::vector<int> const *
+                        f_values = nullptr;
+    std::size_t         f_pos = 0;
+};
+
+
+class job_output
+    : public output
+{
+public:
+    void set(std::vector<int> & values)
+    {
+        f_values = &values;
+    }
+
+    virtual void write(int value) override
+    {
+        f_values->push_back(value);
+    }
+
+private:
+    std::vector<int> *  f_values = nullptr;
+};
+
+
+// each thread restores its machine from the same starting state before
+// each job so the threads do not share anything except that read-only
+// state and the index of the next job to run; the start is either a
+// program which did not run yet or a snapshot taken after some set-up
+// phase
+//
+void run_jobs(snapshot const & start, std::vector<batch_job> & jobs, engine_t engine, limits const & l, int threads, metrics * stats)
+{
+    if(engine == ENGINE_GPU)
+    {
+        if(run_offload(start, jobs, l))
+        {
+            if(stats != nullptr)
+            {
+                thread_metrics & counters(stats->add_thread());
+                for(auto const & job : jobs)
+                {
+                    counters.run(ENGINE_GPU, job.f_status, job.f_steps - start.f_steps);
+                    counters.job_done();
+                }
+            }
+            return;
+        }
+        engine = ENGINE_SIMD;
+    }
+
+    std::atomic<std::size_t> next(0);
+    auto const worker = [&]()
+    {
+        thread_metrics * counters(stats == nullptr ? nullptr : &stats->add_thread());
+        job_input in;
+        job_output out;
+        machine m(start.f_program, in, out);
+        m.set_limits(l);
+        for(;;)
+        {
+            if(engine == ENGINE_SIMD)
+            {
+                std::size_t const idx(next.fetch_add(LOCKSTEP_LANES));
+                if(idx >= jobs.size())
+                {
+                    return;
+                }
+                std::size_t const count(std::min(LOCKSTEP_LANES, jobs.size() - idx));
+                run_lockstep(start, jobs.data() + idx, count, l);
+                if(counters != nullptr)
+                {
+                    for(std::size_t j(idx); j < idx + count; ++j)
+                    {
+                        counters->run(ENGINE_SIMD, jobs[j].f_status, jobs[j].f_steps - start.f_steps);
+                        counters->job_done();
+                    }
+                }
+                continue;
+            }
+
+            std::size_t const idx(next++);
+            if(idx >= jobs.size())
+            {
+                return;
+            }
+            batch_job & job(jobs[idx]);
+            in.set(job.f_inputs);
+            out.set(job.f_outputs);
+            m.restore(start);
+            job.f_status = m.run(engine);
+            job.f_pc = m.pc();
+            job.f_acc = m.acc();
+            job.f_overflow = m.overflow();
+            job.f_steps = m.steps();
+            if(counters != nullptr)
+            {
+                counters->run(engine, job.f_status, job.f_steps - start.f_steps);
+                counters->job_done();
+            }
+        }
+    };
+
+    if(threads <= 0)
+    {
+        threads = std::max(1U, std::thread::hardware_concurrency());
+    }
+    std::size_t const tasks(engine == ENGINE_SIMD
+                    ? (jobs.size() + LOCKSTEP_LANES - 1) / LOCKSTEP_LANES
+                    : jobs.size());
+    if(static_cast<std::size_t>(threads) > tasks)
+    {
+        threads = std::max(static_cast<int>(tasks), 1);
+    }
+
+    std::vector<std::thread> pool;
+    for(int t(1); t < threads; ++t)
+    {
+        pool.emplace_back(worker);
+    }
+    worker();
+    for(auto & t : pool)
+    {
+        t.join();
+    }
+}
+
+
+
+} // no name namespace
+
+
+
+// with a cache, the jobs which repeat an earlier job of the batch or have
+// their result in the cache do not run
+//
+void run_batch(snapshot const & start, std::vector<batch_job> & jobs, engine_t engine, limits const & l, int threads, result_cache * cache, metrics * stats)
+{
+    if(cache == nullptr)
+    {
+        run_jobs(start, jobs, engine, l, threads, stats);
+        return;
+    }
+
+    thread_metrics * counters(stats == nullptr ? nullptr : &stats->add_thread());
+
+    std::size_t const none(static_cast<std::size_t>(-1));
+    std::vector<std::string> keys(jobs.size());
+    std::vector<std::size_t> same_as(jobs.size(), none);
+    std::unordered_map<std::string, std::size_t> first;
+    std::vector<std::size_t> pending;
+    for(std::size_t idx(0); idx < jobs.size(); ++idx)
+    {
+        keys[idx] = result_cache::key(start, l, jobs[idx].f_inputs);
+        auto const it(first.emplace(keys[idx], idx));
+        if(!it.second)
+        {
+            same_as[idx] = it.first->second;
+            cache->duplicate();
+        }
+        else if(!cache->lookup(keys[idx], jobs[idx]))
+        {
+            pending.push_back(idx);
+            continue;
+        }
+        if(counters != nullptr)
+        {
+            counters->f_cache_hits.add();
+            counters->job_done();
+        }
+    }
+    if(counters != nullptr)
+    {
+        counters->f_cache_misses.add(pending.size());
+    }
+
+    std::vector<batch_job> misses;
+    misses.reserve(pending.size());
+    for(auto const idx : pending)
+    {
+        misses.push_back(std::move(jobs[idx]));
+    }
+    run_jobs(start, misses, engine, l, threads, stats);
+    for(std::size_t idx(0); idx < pending.size(); ++idx)
+    {
+        jobs[pending[idx]] = std::move(misses[idx]);
+        cache->store(keys[pending[idx]], jobs[pending[idx]]);
+    }
+
+    for(std::size_t idx(0); idx < jobs.size(); ++idx)
+    {
+        if(same_as[idx] != none)
+        {
+            batch_job const & original(jobs[same_as[idx]]);
+            batch_job & job(jobs[idx]);
+            job.f_outputs = original.f_outputs;
+            job.f_status = original.f_status;
+            job.f_pc = original.f_pc;
+            job.f_acc = original.f_acc;
+            job.f_overflow = original.f_overflow;
+            job.f_steps = original.f_steps;
+        }
+    }
+}
+
+
+// the results are printed in the same order as the input vectors, one
+// line each: "<line>: <output> <output> ..."
+//
+void print_batch(std::vector<batch_job> const & jobs, std::ostream & out)
+{
+    for(auto const & job : jobs)
+    {
+        out << job.f_line << ":";
+        for(auto const & value : job.f_outputs)
+        {
+            out << ' ' << value;
+        }
+        switch(job.f_status)
+        {
+        case STATUS_NO_INPUT:
+            out << " [no more input]";
+            break;
+
+        case STATUS_STEP_LIMIT:
+            out << " [step limit]";
+            break;
+
+        case STATUS_TIMEOUT:
+            out << " [timeout]";
+            break;
+
+        }
+        out << '\n';
+    }
+}
+
+
+
+} // namespace lmc
+// vim: ts=4 sw=4 et
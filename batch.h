@@ -0,0 +1,58 @@
+// Written by Alexis Wilke based on
+// https://en.wikipedia.org/wiki/Little_man_computer
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Source: 
+// https://github.com/AlexisWilke/little-man-computer
+
+
+#pragma once
+
+#include    "machine.h"
+
+
+namespace lmc
+{
+
+
+
+// one set of inputs and the results of running the program with them,
+// including the registers of the machine once it stopped
+//
+struct batch_job
+{
+    int                 f_line = 0;
+    std::vector<int>    f_inputs = {};
+    std::vector<int>    f_outputs = {};
+    status_t            f_status = STATUS_HALTED;
+    int                 f_pc = 0;
+    int                 f_acc = 0;
+    bool                f_overflow = false;
+    std::uint64_t       f_steps = 0;
+};
+
+
+class metrics;
+class result_cache;
+
+
+bool        load_batch(std::string const & filename, std::vector<batch_job> & jobs);
+void        run_batch(snapshot const & start, std::vector<batch_job> & jobs, engine_t engine, limits const & l, int threads, result_cache * cache = nullptr, metrics * stats = nullptr);
+void        print_batch(std::vector<batch_job> const & jobs, std::ostream & out);
+
+
+
+} // namespace lmc
+// vim: ts=4 sw=4 et
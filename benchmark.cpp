@@ -0,0 +1,401 @@
+// Written by Alexis Wilke based on
+// https://en.wikipedia.org/wiki/Little_man_computer
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Source: 
+// https://github.com/AlexisWilke/little-man-computer
+
+
+// Run the sample programs with scripted inputs on each engine and report
+// the speed of each combination, then square.lmc as a batch of 999 jobs
+// with and without the lock-step (simd) engine. When the path to the
+// little-man-computer binary is given, also time each sample from the
+// start of a new process to its HLT (the cold start).
+//
+// Usage: lmc-benchmark [<directory with the .lmc files>] [<seconds>] [<little-man-computer>]
+
+
+#include    "batch.h"
+#include    "machine.h"
+#include    "parser.h"
+
+#include    <algorithm>
+#include    <chrono>
+#include    <cstdlib>
+#include    <fstream>
+#include    <iomanip>
+#include    <iostream>
+
+#include    <fcntl.h>
+#include    <spawn.h>
+#include    <sys/wait.h>
+#include    <unistd.h>
+
+
+
+namespace
+{
+
+
+
+// the output goes nowhere; we only count it to make sure the engines do
+// the work
+//
+class null_output
+    : public lmc::output
+{
+public:
+    virtual void write(int value) override
+    {
+        f_sum += value;
+    }
+
+    long                f_sum = 0;
+};
+
+
+// the same inputs for each run; the machine is reused between runs like
+// in a batch so the engines which keep state (the JIT) do not pay for
+// their set up again and again
+//
+class replay_input
+    : public lmc::input
+{
+public:
+    replay_input(std::vector<int> const & values)
+        : f_values(values)
+    {
+    }
+
+    virtual bool read(int & value) override
+    {
+        if(f_pos >= f_values.size())
+        {
+            return false;
+        }
+        value = f_values[f_pos];
+        ++f_pos;
+        return true;
+    }
+
+    void rewind()
+    {
+        f_pos = 0;
+    }
+
+private:
+    std::vector<int> const &
+                        f_values;
+    std::size_t         f_pos = 0;
+};
+
+
+struct sample_t
+{
+    char const *        f_filename = nullptr;
+    std::vector<int>    f_inputs = {};
+};
+
+
+std::vector<sample_t> scripted_samples()
+{
+    std::vector<sample_t> samples;
+
+    // square every number from 1 to 999 then stop
+    //
+    sample_t square{ "square.lmc" };
+    for(int value(1); value <= 999; ++value)
+    {
+        square.f_inputs.push_back(value);
+    }
+    square.f_inputs.push_back(0);
+    samples.push_back(square);
+
+    // divisions with a remainder restart the program; 999 / 1 ends it
+    //
+    sample_t remainer{ "remainer.lmc" };
+    for(int divisor(2); divisor <= 100; ++divisor)
+    {
+        remainer.f_inputs.push_back(998);
+        remainer.f_inputs.push_back(divisor * 10 + 3);
+    }
+    remainer.f_inputs.push_back(999);
+    remainer.f_inputs.push_back(1);
+    samples.push_back(remainer);
+
+    samples.push_back({ "count-down.lmc", { 999 } });
+    samples.push_back({ "self.lmc", {} });
+
+    return samples;
+}
+
+
+// run the same batch with the threaded and simd engines; with "uniform"
+// all the jobs follow the same path, with "mixed" they square 1 to 999
+// and split at each BRZ
+//
+void benchmark_batch(lmc::program const & p, double seconds, int & errcount)
+{
+    for(int mixed(0); mixed < 2; ++mixed)
+    {
+        std::vector<lmc::batch_job> jobs(999);
+        for(std::size_t idx(0); idx < jobs.size(); ++idx)
+        {
+            jobs[idx].f_inputs = { mixed != 0 ? static_cast<int>(idx) + 1 : 999, 0 };
+        }
+        lmc::snapshot start;
+        start.f_program = p;
+        std::vector<std::vector<int>> expected;
+        for(lmc::engine_t engine : { lmc::ENGINE_THREADED, lmc::ENGINE_SIMD })
+        {
+            int runs(0);
+            auto const begin(std::chrono::steady_clock::now());
+            std::chrono::duration<double> elapsed(0);
+            do
+            {
+                for(auto & job : jobs)
+                {
+                    job.f_outputs.clear();
+                }
+                lmc::run_batch(start, jobs, engine, lmc::limits(), 1);
+                ++runs;
+                elapsed = std::chrono::steady_clock::now() - begin;
+            }
+            while(elapsed.count() < seconds);
+
+            std::vector<std::vector<int>> outputs;
+            for(auto const & job : jobs)
+            {
+                outputs.push_back(job.f_outputs);
+            }
+            if(engine == lmc::ENGINE_THREADED)
+            {
+                expected = outputs;
+            }
+            else if(outputs != expected)
+            {
+                std::cerr << "error: square.lmc batch output differs with the "
+                    << lmc::engine_name(engine) << " engine.\n";
+                ++errcount;
+            }
+
+            double const ns(elapsed.count() * 1.0e9);
+            std::cout << std::left << std::setw(16) << (mixed != 0 ? "square mixed" : "square uniform")
+                << std::setw(10) << lmc::engine_name(engine)
+                << std::right << std::setw(8) << runs
+                << std::setw(14) << runs * jobs.size()
+                << std::fixed << std::setprecision(1)
+                << std::setw(12) << ns / 1.0e6
+                << std::setprecision(2)
+                << std::setw(10) << ns / (runs * jobs.size()) / 1.0e3
+                << "\n";
+        }
+    }
+}
+
+
+
+// start the binary on each sample with its input in a file and the
+// output going to /dev/null; the time includes the fork, the dynamic
+// loader (unless linked statically), the assembling and the run
+//
+void benchmark_startup(std::string const & directory, std::string const & binary, double seconds, int & errcount)
+{
+    std::string const input_filename("lmc-benchmark-input.txt");
+    for(auto const & sample : scripted_samples())
+    {
+        {
+            std::ofstream input(input_filename);
+            for(int value : sample.f_inputs)
+            {
+                input << value << "\n";
+            }
+        }
+
+        posix_spawn_file_actions_t actions;
+        posix_spawn_file_actions_init(&actions);
+        posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, input_filename.c_str(), O_RDONLY, 0);
+        posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+        std::string const filename(directory + "/" + sample.f_filename);
+        char * const args[] =
+        {
+            const_cast<char *>(binary.c_str()),
+            const_cast<char *>("-n"),
+            const_cast<char *>(filename.c_str()),
+            nullptr
+        };
+
+        int runs(0);
+        std::chrono::duration<double> best(0);
+        auto const start(std::chrono::steady_clock::now());
+        std::chrono::duration<double> elapsed(0);
+        do
+        {
+            auto const begin(std::chrono::steady_clock::now());
+            pid_t pid(-1);
+            int status(0);
+            if(posix_spawn(&pid, binary.c_str(), &actions, nullptr, args, environ) != 0
+            || waitpid(pid, &status, 0) != pid
+            || !WIFEXITED(status)
+            || WEXITSTATUS(status) != 0)
+            {
+                std::cerr << "error: " << binary << " failed to run " << sample.f_filename << ".\n";
+                ++errcount;
+                break;
+            }
+            std::chrono::duration<double> const duration(std::chrono::steady_clock::now() - begin);
+            best = runs == 0 ? duration : std::min(best, duration);
+            ++runs;
+            elapsed = std::chrono::steady_clock::now() - start;
+        }
+        while(elapsed.count() < seconds);
+        posix_spawn_file_actions_destroy(&actions);
+
+        if(runs > 0)
+        {
+            std::cout << std::left << std::setw(16) << sample.f_filename
+                << std::right << std::setw(8) << runs
+                << std::fixed << std::setprecision(1)
+                << std::setw(12) << elapsed.count() * 1.0e6 / runs
+                << std::setw(12) << best.count() * 1.0e6
+                << "\n";
+        }
+    }
+    unlink(input_filename.c_str());
+}
+
+
+
+} // no name namespace
+
+
+
+int main(int argc, char * argv[])
+{
+    std::string directory(argc >= 2 ? argv[1] : ".");
+    double const seconds(argc >= 3 ? atof(argv[2]) : 0.25);
+
+    std::cout << std::left << std::setw(16) << "program"
+        << std::setw(10) << "engine"
+        << std::right << std::setw(8) << "runs"
+        << std::setw(14) << "instructions"
+        << std::setw(12) << "time (ms)"
+        << std::setw(10) << "ns/inst"
+        << std::setw(14) << "Minst/s"
+        << "\n";
+
+    int errcount(0);
+    lmc::program square;
+    for(auto const & sample : scripted_samples())
+    {
+        lmc::program p;
+        if(!lmc::parse(directory + "/" + sample.f_filename, p))
+        {
+            ++errcount;
+            continue;
+        }
+        long expected(0);
+        for(lmc::engine_t engine(0); engine < lmc::ENGINE_max; ++engine)
+        {
+            if(engine == lmc::ENGINE_SIMD
+            || engine == lmc::ENGINE_GPU)
+            {
+                // only differs from threaded in batches, see below
+                //
+                continue;
+            }
+            std::uint64_t steps(0);
+            int runs(0);
+            auto const start(std::chrono::steady_clock::now());
+            std::chrono::duration<double> elapsed(0);
+            replay_input in(sample.f_inputs);
+            null_output out;
+            lmc::machine m(p, in, out);
+            do
+            {
+                in.rewind();
+                out.f_sum = 0;
+                m.reset(p);
+                if(m.run(engine) != lmc::STATUS_HALTED)
+                {
+                    std::cerr << "error: " << sample.f_filename
+                        << " did not reach HLT with the "
+                        << lmc::engine_name(engine) << " engine.\n";
+                    ++errcount;
+                    break;
+                }
+                if(engine == 0 && runs == 0)
+                {
+                    expected = out.f_sum;
+                }
+                else if(out.f_sum != expected)
+                {
+                    // all the engines must produce the exact same output
+                    //
+                    std::cerr << "error: " << sample.f_filename
+                        << " output differs with the "
+                        << lmc::engine_name(engine) << " engine.\n";
+                    ++errcount;
+                    break;
+                }
+                steps += m.steps();
+                ++runs;
+                elapsed = std::chrono::steady_clock::now() - start;
+            }
+            while(elapsed.count() < seconds);
+
+            double const ns(elapsed.count() * 1.0e9);
+            std::cout << std::left << std::setw(16) << sample.f_filename
+                << std::setw(10) << lmc::engine_name(engine)
+                << std::right << std::setw(8) << runs
+                << std::setw(14) << steps
+                << std::fixed << std::setprecision(1)
+                << std::setw(12) << ns / 1.0e6
+                << std::setprecision(2)
+                << std::setw(10) << (steps == 0 ? 0.0 : ns / steps)
+                << std::setw(14) << (ns == 0.0 ? 0.0 : steps * 1.0e3 / ns)
+                << "\n";
+        }
+        if(std::string(sample.f_filename) == "square.lmc")
+        {
+            square = p;
+        }
+    }
+
+    std::cout << "\n"
+        << std::left << std::setw(16) << "batch"
+        << std::setw(10) << "engine"
+        << std::right << std::setw(8) << "runs"
+        << std::setw(14) << "jobs"
+        << std::setw(12) << "time (ms)"
+        << std::setw(10) << "us/job"
+        << "\n";
+    benchmark_batch(square, seconds, errcount);
+
+    if(argc >= 4)
+    {
+        std::cout << "\n"
+            << std::left << std::setw(16) << "cold start"
+            << std::right << std::setw(8) << "runs"
+            << std::setw(12) << "mean (us)"
+            << std::setw(12) << "best (us)"
+            << "\n";
+        benchmark_startup(directory, argv[3], seconds, errcount);
+    }
+
+    return errcount == 0 ? 0 : 1;
+}
+
+// vim: ts=4 sw=4 et
@@ -0,0 +1,246 @@
+// Written by Alexis Wilke based on
+// https://en.wikipedia.org/wiki/Little_man_computer
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Source: 
+// https://github.com/AlexisWilke/little-man-computer
+
+
+#include    "cache.h"
+
+#include    <cstdio>
+#include    <cstring>
+#include    <fstream>
+#include    <iterator>
+
+#include    <unistd.h>
+
+
+
+namespace lmc
+{
+
+
+
+namespace
+{
+
+
+
+char const  g_magic[4] = { 'L', 'M', 'C', 'R' };
+
+constexpr std::uint16_t     CACHE_VERSION = 1;
+constexpr std::size_t       CACHE_HEADER_SIZE = 40;
+
+
+void put16(std::string & buf, std::uint16_t value)
+{
+    buf += static_cast<char>(value);
+    buf += static_cast<char>(value >> 8);
+}
+
+
+void put32(std::string & buf, std::uint32_t value)
+{
+    put16(buf, value);
+    put16(buf, value >> 16);
+}
+
+
+void put64(std::string & buf, std::uint64_t value)
+{
+    put32(buf, value);
+    put32(buf, value >> 32);
+}
+
+
+std::uint16_t get16(unsigned char const * buf)
+{
+    return buf[0] | (buf[1] << 8);
+}
+
+
+std::uint32_t get32(unsigned char const * buf)
+{
+    return get16(buf) | (static_cast<std::uint32_t>(get16(buf + 2)) << 16);
+}
+
+
+std::uint64_t get64(unsigned char const * buf)
+{
+    return get32(buf) | (static_cast<std::uint64_t>(get32(buf + 4)) << 32);
+}
+
+
+
+} // no name namespace
+
+
+
+// an empty directory keeps the cache in memory: only the repeats within
+// one batch are found
+//
+result_cache::result_cache(std::string const & directory)
+    : f_directory(directory)
+{
+}
+
+
+std::string result_cache::key(snapshot const & start, limits const & l, std::vector<int> const & inputs)
+{
+    std::string result;
+    result.reserve(MEMORY_SIZE * 2 + 48 + inputs.size() * 4);
+    for(auto const cell : start.f_program.f_cells)
+    {
+        put16(result, cell);
+    }
+    put16(result, start.f_pc);
+    put16(result, start.f_acc);
+    put16(result, start.f_overflow ? 1 : 0);
+    put16(result, 0);
+    put64(result, start.f_steps);
+    put64(result, start.f_inputs);
+    put64(result, start.f_outputs);
+    put64(result, l.f_max_steps);
+    put64(result, inputs.size());
+    for(auto const value : inputs)
+    {
+        put32(result, value);
+    }
+    return result;
+}
+
+
+// on a hit, the outputs, status and registers of the job get replaced by
+// the ones saved in the cache
+//
+bool result_cache::lookup(std::string const & key, batch_job & job)
+{
+    if(!f_directory.empty())
+    {
+        std::ifstream in(filename(key), std::ios::binary);
+        std::string const data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        unsigned char const * const buf(reinterpret_cast<unsigned char const *>(data.data()));
+        if(data.size() >= CACHE_HEADER_SIZE
+        && memcmp(buf, g_magic, sizeof(g_magic)) == 0
+        && get16(buf + 4) == CACHE_VERSION
+        && get64(buf + 8) == key.size()
+        && data.size() == CACHE_HEADER_SIZE + key.size() + get64(buf + 16) * 4
+        && data.compare(CACHE_HEADER_SIZE, key.size(), key) == 0)
+        {
+            job.f_status = static_cast<std::int16_t>(get16(buf + 6));
+            job.f_steps = get64(buf + 24);
+            job.f_pc = get16(buf + 32);
+            job.f_acc = static_cast<std::int16_t>(get16(buf + 34));
+            job.f_overflow = (get16(buf + 36) & 1) != 0;
+            std::size_t const count(get64(buf + 16));
+            unsigned char const * const outputs(buf + CACHE_HEADER_SIZE + key.size());
+            job.f_outputs.clear();
+            job.f_outputs.reserve(count);
+            for(std::size_t idx(0); idx < count; ++idx)
+            {
+                job.f_outputs.push_back(static_cast<std::int32_t>(get32(outputs + idx * 4)));
+            }
+            ++f_hits;
+            return true;
+        }
+    }
+    ++f_misses;
+    return false;
+}
+
+
+// the file is written under a temporary name and renamed so another
+// process never sees a partial entry; errors are ignored, the job simply
+// runs again next time
+//
+void result_cache::store(std::string const & key, batch_job const & job)
+{
+    if(f_directory.empty()
+    || job.f_status == STATUS_TIMEOUT)
+    {
+        return;
+    }
+
+    std::string data(g_magic, sizeof(g_magic));
+    put16(data, CACHE_VERSION);
+    put16(data, job.f_status);
+    put64(data, key.size());
+    put64(data, job.f_outputs.size());
+    put64(data, job.f_steps);
+    put16(data, job.f_pc);
+    put16(data, job.f_acc);
+    put16(data, job.f_overflow ? 1 : 0);
+    put16(data, 0);
+    data += key;
+    for(auto const value : job.f_outputs)
+    {
+        put32(data, value);
+    }
+
+    std::string const name(filename(key));
+    std::string const tmp(name + ".tmp" + std::to_string(getpid()));
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        if(!out.write(data.data(), data.size()))
+        {
+            out.close();
+            unlink(tmp.c_str());
+            return;
+        }
+    }
+    if(rename(tmp.c_str(), name.c_str()) != 0)
+    {
+        unlink(tmp.c_str());
+    }
+}
+
+
+// a job with the same key as a previous job of the same batch
+//
+void result_cache::duplicate()
+{
+    ++f_hits;
+}
+
+
+std::uint64_t result_cache::hits() const
+{
+    return f_hits;
+}
+
+
+std::uint64_t result_cache::misses() const
+{
+    return f_misses;
+}
+
+
+std::string result_cache::filename(std::string const & key) const
+{
+    std::uint64_t h(14695981039346656037ULL);
+    for(auto const c : key)
+    {
+        h = (h ^ static_cast<unsigned char>(c)) * 1099511628211ULL;
+    }
+    char name[32];
+    snprintf(name, sizeof(name), "/%016llx.lmcr", static_cast<unsigned long long>(h));
+    return f_directory + name;
+}
+
+
+
+} // namespace lmc
+// vim: ts=4 sw=4 et
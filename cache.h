@@ -0,0 +1,83 @@
+// Written by Alexis Wilke based on
+// https://en.wikipedia.org/wiki/Little_man_computer
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Source: 
+// https://github.com/AlexisWilke/little-man-computer
+
+
+#pragma once
+
+#include    "batch.h"
+
+#include    <atomic>
+
+
+namespace lmc
+{
+
+
+
+// Results of batch jobs saved on disk, one file per job named after the
+// 64 bit FNV-1a hash of its key; the key is the starting state of the
+// machine (cells and registers), the step limit and the input values so
+// the same program with the same inputs always has the same key. Each
+// file is little endian:
+//
+//     offset  size  field
+//          0     4  magic "LMCR"
+//          4     2  version (1)
+//          6     2  status (STATUS_...)
+//          8     8  size of the key in bytes (k)
+//         16     8  number of outputs (n)
+//         24     8  number of instructions executed
+//         32     2  PC
+//         34     2  accumulator (signed)
+//         36     2  flags (bit 0: overflow)
+//         38     2  reserved (0)
+//         40     k  the key, compared on a lookup to rule out collisions
+//       40+k   4*n  the outputs, one signed 32 bit number each
+//
+// Jobs which time out are not saved since their result depends on the
+// speed of the computer.
+//
+class result_cache
+{
+public:
+                        result_cache(std::string const & directory);
+
+    static std::string  key(snapshot const & start, limits const & l, std::vector<int> const & inputs);
+
+    bool                lookup(std::string const & key, batch_job & job);
+    void                store(std::string const & key, batch_job const & job);
+    void                duplicate();
+
+    std::uint64_t       hits() const;
+    std::uint64_t       misses() const;
+
+private:
+    std::string         filename(std::string const & key) const;
+
+    std::string         f_directory = std::string();
+    std::atomic<std::uint64_t>
+                        f_hits = 0;
+    std::atomic<std::uint64_t>
+                        f_misses = 0;
+};
+
+
+
+} // namespace lmc
+// vim: ts=4 sw=4 et
@@ -0,0 +1,501 @@
+// Written by Alexis Wilke based on
+// https://en.wikipedia.org/wiki/Little_man_computer
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Source: 
+// https://github.com/AlexisWilke/little-man-computer
+
+
+#include    "debugger.h"
+
+#include    "image.h"
+
+#include    <algorithm>
+#include    <array>
+#include    <limits>
+#include    <sstream>
+
+
+
+namespace lmc
+{
+
+
+namespace
+{
+
+
+
+constexpr std::size_t       KEYFRAME_INTERVAL = 32;             // checkpoints per full copy of the memory
+constexpr std::uint64_t     CONTINUE_STEPS = 100'000'000;       // "c" stops after that many steps
+
+
+typedef std::array<short, MEMORY_SIZE>      image_t;
+
+
+struct cell_delta
+{
+    std::uint8_t        f_loc = 0;
+    short               f_value = 0;
+};
+
+
+// the registers at a multiple of the interval; the memory is the last
+// keyframe plus the deltas of the checkpoints since then
+//
+struct checkpoint
+{
+    int                 f_pc = 0;
+    int                 f_acc = 0;
+    bool                f_overflow = false;
+    std::uint64_t       f_steps = 0;
+    std::uint64_t       f_inputs = 0;
+    std::uint64_t       f_outputs = 0;
+    std::size_t         f_delta = 0;            // first entry in f_deltas
+    std::size_t         f_delta_count = 0;
+};
+
+
+class debugger
+    : public input
+    , public output
+    , public store_log
+{
+public:
+                        debugger(snapshot const & start, std::istream & in, std::ostream & out, std::uint64_t interval);
+
+    int                 run();
+
+    virtual bool        read(int & value) override;
+    virtual void        write(int value) override;
+    virtual void        on_store(std::uint64_t step, int loc) override;
+
+private:
+    void                forward(std::uint64_t count);
+    void                go_to(std::uint64_t step);
+    void                last_write(int loc);
+    void                add_checkpoint();
+    bool                halted() const;
+    void                show();
+    void                show_cell(int loc);
+
+    program const &     f_program;
+    std::istream &      f_in;
+    std::ostream &      f_out;
+    std::uint64_t       f_interval = 1000;
+    std::uint64_t       f_base = 0;             // steps of the start state
+    machine             f_machine;
+
+    std::vector<int>    f_inputs = {};          // all the values read so far
+    std::uint64_t       f_input_pos = 0;
+    std::uint64_t       f_output_pos = 0;
+    std::uint64_t       f_printed = 0;          // OUT already shown
+    std::string         f_pending = std::string();  // command typed instead of an INP value
+
+    std::vector<checkpoint>
+                        f_checkpoints = {};
+    std::vector<cell_delta>
+                        f_deltas = {};
+    std::vector<image_t>
+                        f_keyframes = {};
+    std::vector<std::uint64_t>
+                        f_writes[MEMORY_SIZE] = {};
+    bool                f_dirty[MEMORY_SIZE] = {};
+
+    std::uint64_t       f_end = 0;              // the furthest step reached
+    status_t            f_end_status = STATUS_RUNNING;
+};
+
+
+debugger::debugger(snapshot const & start, std::istream & in, std::ostream & out, std::uint64_t interval)
+    : f_program(start.f_program)
+    , f_in(in)
+    , f_out(out)
+    , f_interval(std::max(interval, static_cast<std::uint64_t>(1)))
+    , f_base(start.f_steps)
+    , f_machine(start.f_program, *this, *this)
+{
+    f_machine.restore(start);
+    f_input_pos = start.f_inputs;
+    f_output_pos = start.f_outputs;
+    f_printed = start.f_outputs;
+    f_inputs.resize(start.f_inputs);
+    f_end = f_base;
+    add_checkpoint();
+}
+
+
+int debugger::run()
+{
+    show();
+    std::string line;
+    for(;;)
+    {
+        f_out << "(lmc) " << std::flush;
+        if(!f_pending.empty())
+        {
+            line.swap(f_pending);
+            f_pending.clear();
+            f_out << line << "\n";
+        }
+        else if(!std::getline(f_in, line))
+        {
+            f_out << "\n";
+            return 0;
+        }
+        std::istringstream cmd(line);
+        std::string name;
+        if(!(cmd >> name))
+        {
+            continue;
+        }
+        std::uint64_t count(1);
+        bool const has_count(static_cast<bool>(cmd >> count));
+        std::uint64_t const steps(f_machine.steps());
+        if(name == "s")
+        {
+            forward(count);
+        }
+        else if(name == "b")
+        {
+            go_to(steps - std::min(count, steps - f_base));
+        }
+        else if(name == "g"
+             && has_count)
+        {
+            if(count < f_base)
+            {
+                count = f_base;
+            }
+            if(count <= f_end)
+            {
+                go_to(count);
+            }
+            else
+            {
+                forward(count - steps);
+            }
+        }
+        else if(name == "c")
+        {
+            forward(CONTINUE_STEPS);
+        }
+        else if(name == "w"
+             && has_count
+             && count < MEMORY_SIZE)
+        {
+            last_write(count);
+        }
+        else if(name == "m")
+        {
+            if(has_count)
+            {
+                if(count < MEMORY_SIZE)
+                {
+                    show_cell(count);
+                }
+            }
+            else
+            {
+                for(int loc(0); loc < static_cast<int>(MEMORY_SIZE); ++loc)
+                {
+                    if(loc < f_program.f_size
+                    || f_machine.cell(loc) != 0)
+                    {
+                        show_cell(loc);
+                    }
+                }
+            }
+            continue;
+        }
+        else if(name == "save")
+        {
+            std::istringstream args(line);
+            std::string filename;
+            args >> name >> filename;
+            if(filename.empty())
+            {
+                f_out << "save expects a filename.\n";
+            }
+            else if(halted())
+            {
+                f_out << "the program halted, go back first.\n";
+            }
+            else
+            {
+                snapshot s;
+                f_machine.save(s);
+                s.f_program.f_size = f_program.f_size;
+                s.f_program.f_labels = f_program.f_labels;
+                if(save_snapshot(filename, s))
+                {
+                    f_out << "saved \"" << filename << "\".\n";
+                }
+            }
+            continue;
+        }
+        else if(name == "q")
+        {
+            return 0;
+        }
+        else
+        {
+            f_out << "commands: s [N], b [N], g N, c, w X, m [X], save FILE, q\n";
+            continue;
+        }
+        show();
+    }
+}
+
+
+// values already read are given again when running the same steps; new
+// ones come from the same stream as the commands, a line which is not a
+// number stops the program on its INP and gets run as the next command
+//
+bool debugger::read(int & value)
+{
+    if(f_input_pos < f_inputs.size())
+    {
+        value = f_inputs[f_input_pos];
+        ++f_input_pos;
+        return true;
+    }
+    f_out << "INP? " << std::flush;
+    std::string line;
+    if(!std::getline(f_in, line))
+    {
+        f_out << "\n";
+        return false;
+    }
+    std::istringstream number(line);
+    if(!(number >> value))
+    {
+        f_pending = line.empty() ? std::string(" ") : line;
+        return false;
+    }
+    f_inputs.push_back(value);
+    ++f_input_pos;
+    return true;
+}
+
+
+void debugger::write(int value)
+{
+    if(f_output_pos >= f_printed)
+    {
+        f_out << "OUT " << value << "\n";
+        ++f_printed;
+    }
+    ++f_output_pos;
+}
+
+
+void debugger::on_store(std::uint64_t step, int loc)
+{
+    f_writes[loc].push_back(step);
+    f_dirty[loc] = true;
+}
+
+
+// the steps already known run again without being recorded, the others
+// get recorded up to each checkpoint
+//
+void debugger::forward(std::uint64_t count)
+{
+    std::uint64_t const steps(f_machine.steps());
+    std::uint64_t const target(count > std::numeric_limits<std::uint64_t>::max() - steps
+                                ? std::numeric_limits<std::uint64_t>::max()
+                                : steps + count);
+    if(steps < f_end)
+    {
+        f_machine.step(std::min(target, f_end) - steps);
+    }
+    while(f_machine.steps() < target)
+    {
+        if(f_end_status == STATUS_HALTED)
+        {
+            f_out << "the program halted.\n";
+            return;
+        }
+        std::uint64_t const next(f_base + f_checkpoints.size() * f_interval);
+        status_t const status(f_machine.step(std::min(target, next) - f_machine.steps(), this));
+        f_end = f_machine.steps();
+        if(f_end == next)
+        {
+            add_checkpoint();
+        }
+        if(status == STATUS_HALTED)
+        {
+            f_end_status = STATUS_HALTED;
+            return;
+        }
+        if(status == STATUS_NO_INPUT)
+        {
+            if(f_pending.empty())
+            {
+                f_out << "no more input.\n";
+            }
+            return;
+        }
+    }
+    if(count == CONTINUE_STEPS)
+    {
+        f_out << "still running after " << CONTINUE_STEPS << " steps.\n";
+    }
+}
+
+
+// restore the checkpoint just before `step` and run the few steps left
+//
+void debugger::go_to(std::uint64_t step)
+{
+    std::size_t const idx(std::min(static_cast<std::size_t>((step - f_base) / f_interval), f_checkpoints.size() - 1));
+    std::size_t const key(idx - idx % KEYFRAME_INTERVAL);
+    checkpoint const & c(f_checkpoints[idx]);
+
+    snapshot s;
+    image_t const & image(f_keyframes[key / KEYFRAME_INTERVAL]);
+    std::copy(image.begin(), image.end(), s.f_program.f_cells);
+    for(std::size_t i(key + 1); i <= idx; ++i)
+    {
+        checkpoint const & d(f_checkpoints[i]);
+        for(std::size_t j(0); j < d.f_delta_count; ++j)
+        {
+            cell_delta const & delta(f_deltas[d.f_delta + j]);
+            s.f_program.f_cells[delta.f_loc] = delta.f_value;
+        }
+    }
+    s.f_pc = c.f_pc;
+    s.f_acc = c.f_acc;
+    s.f_overflow = c.f_overflow;
+    s.f_steps = c.f_steps;
+    s.f_inputs = c.f_inputs;
+    s.f_outputs = c.f_outputs;
+    f_machine.restore(s);
+    f_input_pos = c.f_inputs;
+    f_output_pos = c.f_outputs;
+    f_machine.step(step - c.f_steps);
+}
+
+
+// go right after the last STA to `loc` which ran before the current step
+//
+void debugger::last_write(int loc)
+{
+    std::vector<std::uint64_t> const & writes(f_writes[loc]);
+    auto const it(std::lower_bound(writes.begin(), writes.end(), f_machine.steps()));
+    if(it == writes.begin())
+    {
+        f_out << "cell " << loc << " was not written before this step.\n";
+        return;
+    }
+    go_to(*(it - 1));
+}
+
+
+void debugger::add_checkpoint()
+{
+    checkpoint c;
+    c.f_pc = f_machine.pc();
+    c.f_acc = f_machine.acc();
+    c.f_overflow = f_machine.overflow();
+    c.f_steps = f_machine.steps();
+    c.f_inputs = f_machine.inputs();
+    c.f_outputs = f_machine.outputs();
+    c.f_delta = f_deltas.size();
+    if(f_checkpoints.size() % KEYFRAME_INTERVAL == 0)
+    {
+        image_t image;
+        std::copy(f_machine.memory(), f_machine.memory() + MEMORY_SIZE, image.begin());
+        f_keyframes.push_back(image);
+    }
+    else
+    {
+        for(std::size_t loc(0); loc < MEMORY_SIZE; ++loc)
+        {
+            if(f_dirty[loc])
+            {
+                f_deltas.push_back(cell_delta{ static_cast<std::uint8_t>(loc), f_machine.cell(loc) });
+            }
+        }
+    }
+    std::fill(std::begin(f_dirty), std::end(f_dirty), false);
+    c.f_delta_count = f_deltas.size() - c.f_delta;
+    f_checkpoints.push_back(c);
+}
+
+
+// once halted, the PC of the machine is past the HLT
+//
+bool debugger::halted() const
+{
+    return f_end_status == STATUS_HALTED
+        && f_machine.steps() == f_end;
+}
+
+
+void debugger::show()
+{
+    int const pc(f_machine.pc());
+    f_out << "step " << f_machine.steps() << ": ";
+    if(halted())
+    {
+        f_out << "halted";
+    }
+    else
+    {
+        std::string const label(label_name(f_program, pc));
+        f_out << "pc " << pc;
+        if(!label.empty())
+        {
+            f_out << " (" << label << ")";
+        }
+        f_out << " " << disassemble(f_program, f_machine.cell(pc));
+    }
+    f_out << ", acc " << f_machine.acc()
+        << ", overflow " << (f_machine.overflow() ? "yes" : "no")
+        << "\n";
+}
+
+
+void debugger::show_cell(int loc)
+{
+    std::string const label(label_name(f_program, loc));
+    f_out << "cell " << loc;
+    if(!label.empty())
+    {
+        f_out << " (" << label << ")";
+    }
+    f_out << ": " << f_machine.cell(loc)
+        << " " << disassemble(f_program, f_machine.cell(loc))
+        << "\n";
+}
+
+
+
+} // no name namespace
+
+
+
+int debug(snapshot const & start, std::istream & in, std::ostream & out, std::uint64_t interval)
+{
+    debugger d(start, in, out, interval);
+    return d.run();
+}
+
+
+
+} // namespace lmc
+// vim: ts=4 sw=4 et
@@ -0,0 +1,61 @@
+// Written by Alexis Wilke based on
+// https://en.wikipedia.org/wiki/Little_man_computer
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Source: 
+// https://github.com/AlexisWilke/little-man-computer
+
+
+#pragma once
+
+#include    "machine.h"
+
+#include    <iostream>
+
+
+namespace lmc
+{
+
+
+
+// A debugger which can go back in time. While the program runs forward
+// the debugger saves a checkpoint every `interval` steps: the registers
+// and the cells written since the previous checkpoint (every 32nd
+// checkpoint has a copy of the whole memory) and, for each cell, the
+// steps of the STA which wrote to it. Going back to step N restores the
+// checkpoint just before N, from its full copy and at most 31 deltas,
+// then runs less than `interval` steps; so going back costs the same
+// whatever the length of the run. The values read by INP are recorded so
+// running again gives the same results, and the OUT already printed are
+// not printed again.
+//
+// The commands are read from `in`, one per line, along with the values
+// of the INP which did not run yet:
+//
+//     s [N]        step N instructions forward (default 1)
+//     b [N]        step N instructions back (default 1)
+//     g N          go to step N (back or forward)
+//     c            continue until HLT or the end of the input
+//     w X          go back to the last STA to cell X
+//     m [X]        print cell X or all the used cells
+//     save FILE    save the current state in a snapshot (see image.h)
+//     q            quit
+//
+int         debug(snapshot const & start, std::istream & in, std::ostream & out, std::uint64_t interval = 1000);
+
+
+
+} // namespace lmc
+// vim: ts=4 sw=4 et
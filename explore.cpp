@@ -0,0 +1,567 @@
+// Written by Alexis Wilke based on
+// https://en.wikipedia.org/wiki/Little_man_computer
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Source: 
+// https://github.com/AlexisWilke/little-man-computer
+
+
+#include    "explore.h"
+
+#include    <algorithm>
+#include    <array>
+#include    <atomic>
+#include    <cstring>
+#include    <deque>
+#include    <memory>
+#include    <mutex>
+#include    <thread>
+#include    <unordered_map>
+
+
+
+namespace lmc
+{
+
+
+namespace
+{
+
+
+
+constexpr int                   CHUNK_SIZE = 50;        // values tried by one task
+constexpr std::size_t           SHARD_COUNT = 64;       // locks of the state set
+constexpr std::uint64_t         DEFAULT_MAX_STEPS = 1'000'000;
+
+
+typedef std::array<short, MEMORY_SIZE>      image_t;
+
+struct node;
+
+
+// what happened once INP got one of the values; a machine which stopped
+// on the next INP continues in f_next (nullptr at the maximum depth)
+//
+struct edge
+{
+    std::uint32_t       f_output = 0;           // first value in the chunk outputs
+    std::uint32_t       f_count = 0;
+    status_t            f_status = STATUS_HALTED;
+    int                 f_pc = 0;
+    node *              f_next = nullptr;
+};
+
+
+// a machine waiting on an INP; f_depth is the number of values it read
+//
+struct node
+{
+    std::shared_ptr<image_t const>
+                        f_image = nullptr;
+    int                 f_pc = 0;
+    int                 f_acc = 0;
+    bool                f_overflow = false;
+    int                 f_depth = 0;
+    std::uint64_t       f_hash = 0;
+    std::vector<edge>   f_edges = {};
+    std::vector<std::vector<int>>
+                        f_outputs = {};         // one vector per chunk
+
+    // index of the first edge which fails, directly or further down
+    // (-1 if none, -2 if not computed yet)
+    //
+    int                 f_failure = -2;
+};
+
+
+struct task
+{
+    node *              f_node = nullptr;
+    int                 f_chunk = 0;
+};
+
+
+// one value for the INP which forked the machine, then nothing so the
+// machine stops on the next INP
+//
+class explore_input
+    : public input
+{
+public:
+    virtual bool read(int & value) override
+    {
+        if(!f_ready)
+        {
+            return false;
+        }
+        value = f_value;
+        f_ready = false;
+        return true;
+    }
+
+    void set(int value)
+    {
+        f_value = value;
+        f_ready = true;
+    }
+
+    void clear()
+    {
+        f_ready = false;
+    }
+
+private:
+    int                 f_value = 0;
+    bool                f_ready = false;
+};
+
+
+bool failed(status_t status)
+{
+    return status == STATUS_STEP_LIMIT
+        || status == STATUS_TIMEOUT;
+}
+
+
+class explorer
+{
+public:
+                        explorer(snapshot const & start, explore_options const & opts);
+
+    status_t            run(std::ostream & out);
+
+private:
+    struct shard
+    {
+        std::mutex      f_mutex = std::mutex();
+        std::deque<node>
+                        f_nodes = {};
+        std::unordered_multimap<std::uint64_t, node *>
+                        f_index = {};
+    };
+
+    struct queue
+    {
+        std::mutex      f_mutex = std::mutex();
+        std::deque<task>
+                        f_tasks = {};
+    };
+
+    class worker;
+
+    void                work(std::size_t id);
+    node *              add(std::size_t id, node const * parent, machine const & m, int depth);
+    bool                pop(std::size_t id, task & t);
+    int                 first_failure(node * n);
+    void                print(edge const & e, std::vector<int> const & outputs, std::vector<int> & prefix, std::vector<int> & results, std::ostream & out) const;
+
+    snapshot const &    f_start;
+    explore_options     f_options;
+    int                 f_values = 0;
+    int                 f_chunks = 0;
+    shard               f_shards[SHARD_COUNT] = {};
+    std::vector<std::unique_ptr<queue>>
+                        f_queues = {};
+    std::atomic<std::size_t>
+                        f_pending = 0;
+    std::atomic<std::uint64_t>
+                        f_runs = 0;
+    std::atomic<std::uint64_t>
+                        f_duplicates = 0;
+    std::atomic<std::uint64_t>
+                        f_states = 0;
+    edge                f_root = edge();
+    std::vector<int>    f_root_outputs = {};
+};
+
+
+// the machine (and its JIT if any) of one thread; it gets restored to
+// the state of a node before each value
+//
+class explorer::worker
+    : public output
+{
+public:
+    worker(snapshot const & start, limits const & l)
+        : f_state(start)
+        , f_machine(start.f_program, f_input, *this)
+    {
+        f_machine.set_limits(l);
+    }
+
+    virtual void write(int value) override
+    {
+        f_outputs->push_back(value);
+    }
+
+    status_t run(node const * n, int const * value, std::vector<int> & outputs, engine_t engine)
+    {
+        if(n != nullptr)
+        {
+            std::copy(n->f_image->begin(), n->f_image->end(), f_state.f_program.f_cells);
+            f_state.f_pc = n->f_pc;
+            f_state.f_acc = n->f_acc;
+            f_state.f_overflow = n->f_overflow;
+        }
+        f_state.f_steps = 0;
+        f_state.f_inputs = 0;
+        f_state.f_outputs = 0;
+        f_machine.restore(f_state);
+        if(value == nullptr)
+        {
+            f_input.clear();
+        }
+        else
+        {
+            f_input.set(*value);
+        }
+        f_outputs = &outputs;
+        return f_machine.run(engine);
+    }
+
+    machine const & get_machine() const
+    {
+        return f_machine;
+    }
+
+private:
+    snapshot            f_state;
+    explore_input       f_input = explore_input();
+    machine             f_machine;
+    std::vector<int> *  f_outputs = nullptr;
+};
+
+
+explorer::explorer(snapshot const & start, explore_options const & opts)
+    : f_start(start)
+    , f_options(opts)
+{
+    if(f_options.f_limits.f_max_steps == 0)
+    {
+        f_options.f_limits.f_max_steps = DEFAULT_MAX_STEPS;
+    }
+    f_values = f_options.f_max - f_options.f_min + 1;
+    f_chunks = (f_values + CHUNK_SIZE - 1) / CHUNK_SIZE;
+}
+
+
+status_t explorer::run(std::ostream & out)
+{
+    int threads(f_options.f_threads);
+    if(threads <= 0)
+    {
+        threads = std::max(1U, std::thread::hardware_concurrency());
+    }
+    for(int t(0); t < threads; ++t)
+    {
+        f_queues.push_back(std::make_unique<queue>());
+    }
+
+    // the program runs up to its first INP once, that state is the root
+    //
+    {
+        worker w(f_start, f_options.f_limits);
+        f_root.f_status = w.run(nullptr, nullptr, f_root_outputs, f_options.f_engine);
+        f_root.f_count = f_root_outputs.size();
+        f_root.f_pc = w.get_machine().pc();
+        ++f_runs;
+        if(f_root.f_status == STATUS_NO_INPUT
+        && f_options.f_depth > 0)
+        {
+            f_root.f_next = add(0, nullptr, w.get_machine(), 0);
+        }
+    }
+
+    std::vector<std::thread> pool;
+    for(int t(1); t < threads; ++t)
+    {
+        pool.emplace_back(&explorer::work, this, t);
+    }
+    work(0);
+    for(auto & t : pool)
+    {
+        t.join();
+    }
+
+    std::cerr << "explored " << f_states << " states ("
+        << f_duplicates << " duplicates) in "
+        << f_runs << " runs.\n";
+
+    // search the first failing input before printing anything
+    //
+    std::vector<int> prefix;
+    edge const * e(&f_root);
+    while(!failed(e->f_status)
+       && e->f_next != nullptr)
+    {
+        int const idx(first_failure(e->f_next));
+        if(idx < 0)
+        {
+            break;
+        }
+        prefix.push_back(f_options.f_min + idx);
+        e = &e->f_next->f_edges[idx];
+    }
+    if(failed(e->f_status))
+    {
+        std::cerr << "error: "
+            << (e->f_status == STATUS_STEP_LIMIT ? "step limit" : "timeout")
+            << " reached with the input:";
+        for(auto const v : prefix)
+        {
+            std::cerr << ' ' << v;
+        }
+        std::cerr << " (PC: " << e->f_pc << ").\n";
+        return e->f_status;
+    }
+
+    std::vector<int> results;
+    print(f_root, f_root_outputs, prefix, results, out);
+    return STATUS_HALTED;
+}
+
+
+void explorer::work(std::size_t id)
+{
+    worker w(f_start, f_options.f_limits);
+    for(;;)
+    {
+        task t;
+        if(!pop(id, t))
+        {
+            if(f_pending == 0)
+            {
+                return;
+            }
+            std::this_thread::yield();
+            continue;
+        }
+
+        node & n(*t.f_node);
+        std::vector<int> & outputs(n.f_outputs[t.f_chunk]);
+        int const first(t.f_chunk * CHUNK_SIZE);
+        int const last(std::min(first + CHUNK_SIZE, f_values));
+        for(int idx(first); idx < last; ++idx)
+        {
+            int const value(f_options.f_min + idx);
+            edge & e(n.f_edges[idx]);
+            e.f_output = outputs.size();
+            e.f_status = w.run(&n, &value, outputs, f_options.f_engine);
+            e.f_count = outputs.size() - e.f_output;
+            e.f_pc = w.get_machine().pc();
+            if(e.f_status == STATUS_NO_INPUT
+            && n.f_depth + 1 < f_options.f_depth)
+            {
+                e.f_next = add(id, &n, w.get_machine(), n.f_depth + 1);
+            }
+        }
+        f_runs += last - first;
+
+        // the tasks of new nodes were counted before this one ends
+        //
+        --f_pending;
+    }
+}
+
+
+// return the node with the same state as the machine, a new one (and its
+// tasks) if that state was not seen yet; the memory is shared with the
+// parent when the last run did not change it
+//
+node * explorer::add(std::size_t id, node const * parent, machine const & m, int depth)
+{
+    short const * memory(m.memory());
+    int const pc(m.pc());
+    int const acc(m.acc());
+    bool const overflow(m.overflow());
+
+    std::uint64_t hash(14695981039346656037ULL);
+    auto const mix = [&hash](std::uint64_t value)
+    {
+        hash = (hash ^ value) * 1099511628211ULL;
+    };
+    for(std::size_t idx(0); idx < MEMORY_SIZE; ++idx)
+    {
+        mix(static_cast<std::uint16_t>(memory[idx]));
+    }
+    mix(pc);
+    mix(static_cast<std::uint32_t>(acc));
+    mix(overflow ? 1 : 0);
+    mix(depth);
+
+    shard & s(f_shards[hash % SHARD_COUNT]);
+    node * n(nullptr);
+    {
+        std::lock_guard<std::mutex> lock(s.f_mutex);
+        auto const range(s.f_index.equal_range(hash));
+        for(auto it(range.first); it != range.second; ++it)
+        {
+            node const & other(*it->second);
+            if(other.f_pc == pc
+            && other.f_acc == acc
+            && other.f_overflow == overflow
+            && other.f_depth == depth
+            && std::equal(other.f_image->begin(), other.f_image->end(), memory))
+            {
+                ++f_duplicates;
+                return it->second;
+            }
+        }
+
+        s.f_nodes.emplace_back();
+        n = &s.f_nodes.back();
+        if(parent != nullptr
+        && std::equal(parent->f_image->begin(), parent->f_image->end(), memory))
+        {
+            n->f_image = parent->f_image;
+        }
+        else
+        {
+            auto image(std::make_shared<image_t>());
+            std::copy(memory, memory + MEMORY_SIZE, image->begin());
+            n->f_image = image;
+        }
+        n->f_pc = pc;
+        n->f_acc = acc;
+        n->f_overflow = overflow;
+        n->f_depth = depth;
+        n->f_hash = hash;
+        n->f_edges.resize(f_values);
+        n->f_outputs.resize(f_chunks);
+        s.f_index.emplace(hash, n);
+    }
+    ++f_states;
+
+    // the owner takes the newest tasks (depth first), the others steal
+    // the oldest ones
+    //
+    f_pending += f_chunks;
+    queue & q(*f_queues[id]);
+    std::lock_guard<std::mutex> lock(q.f_mutex);
+    for(int chunk(0); chunk < f_chunks; ++chunk)
+    {
+        q.f_tasks.push_back(task{n, chunk});
+    }
+    return n;
+}
+
+
+bool explorer::pop(std::size_t id, task & t)
+{
+    {
+        queue & q(*f_queues[id]);
+        std::lock_guard<std::mutex> lock(q.f_mutex);
+        if(!q.f_tasks.empty())
+        {
+            t = q.f_tasks.back();
+            q.f_tasks.pop_back();
+            return true;
+        }
+    }
+
+    std::size_t const max(f_queues.size());
+    for(std::size_t idx(1); idx < max; ++idx)
+    {
+        queue & victim(*f_queues[(id + idx) % max]);
+        std::lock_guard<std::mutex> lock(victim.f_mutex);
+        if(!victim.f_tasks.empty())
+        {
+            t = victim.f_tasks.front();
+            victim.f_tasks.pop_front();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+// the nodes are shared by many paths so the result is saved in the node
+//
+int explorer::first_failure(node * n)
+{
+    if(n->f_failure == -2)
+    {
+        n->f_failure = -1;
+        for(int idx(0); idx < f_values; ++idx)
+        {
+            edge const & e(n->f_edges[idx]);
+            if(failed(e.f_status)
+            || (e.f_next != nullptr && first_failure(e.f_next) >= 0))
+            {
+                n->f_failure = idx;
+                break;
+            }
+        }
+    }
+    return n->f_failure;
+}
+
+
+// one line per path: the inputs, "->" and the outputs; "..." means the
+// machine expects more input
+//
+void explorer::print(edge const & e, std::vector<int> const & outputs, std::vector<int> & prefix, std::vector<int> & results, std::ostream & out) const
+{
+    std::size_t const size(results.size());
+    results.insert(results.end(), outputs.begin() + e.f_output, outputs.begin() + e.f_output + e.f_count);
+    if(e.f_next != nullptr)
+    {
+        node const & n(*e.f_next);
+        for(int idx(0); idx < f_values; ++idx)
+        {
+            prefix.push_back(f_options.f_min + idx);
+            print(n.f_edges[idx], n.f_outputs[idx / CHUNK_SIZE], prefix, results, out);
+            prefix.pop_back();
+        }
+    }
+    else
+    {
+        char const * sep("");
+        for(auto const v : prefix)
+        {
+            out << sep << v;
+            sep = " ";
+        }
+        out << (prefix.empty() ? "->" : " ->");
+        for(auto const v : results)
+        {
+            out << ' ' << v;
+        }
+        if(e.f_status == STATUS_NO_INPUT)
+        {
+            out << " ...";
+        }
+        out << '\n';
+    }
+    results.resize(size);
+}
+
+
+
+} // no name namespace
+
+
+
+status_t explore(snapshot const & start, explore_options const & opts, std::ostream & out)
+{
+    explorer e(start, opts);
+    return e.run(out);
+}
+
+
+
+} // namespace lmc
+// vim: ts=4 sw=4 et
@@ -0,0 +1,65 @@
+// Written by Alexis Wilke based on
+// https://en.wikipedia.org/wiki/Little_man_computer
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Source: 
+// https://github.com/AlexisWilke/little-man-computer
+
+
+#pragma once
+
+#include    "machine.h"
+
+#include    <iostream>
+
+
+namespace lmc
+{
+
+
+
+// Exhaustive exploration of the inputs: instead of running the program
+// once per input vector, the machine state gets forked each time it
+// reaches an INP, once per value of the range. The states waiting on an
+// INP are kept in a hash set so two input prefixes which lead to the
+// same memory and registers (and the same number of INP) only get
+// explored once; the memory of a state is shared with its parent until
+// the program writes to it (copy-on-write).
+//
+// The states get explored by f_threads threads which steal work from
+// each other. The result does not depend on the order in which states
+// were explored: the map is printed with the inputs in increasing order
+// and the failing input is the first one in that order.
+//
+// The limits apply to each part of the run between two INP; without
+// --max-steps a part stops after 1,000,000 instructions.
+//
+struct explore_options
+{
+    int                 f_depth = 1;            // number of INP to explore
+    int                 f_min = 0;              // values given to INP
+    int                 f_max = 999;
+    engine_t            f_engine = ENGINE_SWITCH;
+    limits              f_limits = limits();
+    int                 f_threads = 0;          // 0 = one per CPU
+};
+
+
+status_t    explore(snapshot const & start, explore_options const & opts, std::ostream & out);
+
+
+
+} // namespace lmc
+// vim: ts=4 sw=4 et
@@ -0,0 +1,287 @@
+// Written by Alexis Wilke based on
+// https://en.wikipedia.org/wiki/Little_man_computer
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Source: 
+// https://github.com/AlexisWilke/little-man-computer
+
+
+#include    "extended.h"
+
+
+
+namespace lmc
+{
+
+
+
+namespace
+{
+
+
+
+// number of steps between two checks of the clock
+//
+constexpr std::uint64_t     WATCHDOG_QUANTUM = 1'000'000;
+
+// the code of the cells which are not instructions
+//
+constexpr std::uint32_t     CODE_NOP = MNEMONIC_DAT;
+
+
+
+} // no name namespace
+
+
+
+// the cells keep their value as is, even outside of (-modulo, modulo)
+// since the assembler accepts a DAT such as -1500; like in run_switch(),
+// only the results of ADD and SUB get reduced
+//
+extended_machine::extended_machine(extended_program const & p, input & in, output & out)
+    : f_memory_size(p.f_memory_size)
+    , f_modulo(p.f_memory_size * 10)
+    , f_memory(p.f_memory_size)
+    , f_input(in)
+    , f_output(out)
+{
+    for(int idx(0); idx < f_memory_size; ++idx)
+    {
+        f_memory[idx].f_value = p.f_cells[idx];
+        decode(f_memory[idx]);
+    }
+}
+
+
+void extended_machine::decode(mailbox & m) const
+{
+    int const instruction(m.f_value / f_memory_size);
+    if(instruction < MNEMONIC_HLT
+    || instruction > MNEMONIC_OUT)
+    {
+        m.f_code = CODE_NOP;
+    }
+    else if(instruction == MNEMONIC_HLT)
+    {
+        m.f_code = MNEMONIC_HLT;
+    }
+    else
+    {
+        m.f_code = ((m.f_value % f_memory_size) << 4) | instruction;
+    }
+}
+
+
+void extended_machine::set_limits(limits const & l)
+{
+    f_limits = l;
+}
+
+
+int extended_machine::pc() const
+{
+    return f_pc;
+}
+
+
+int extended_machine::acc() const
+{
+    return f_acc;
+}
+
+
+bool extended_machine::overflow() const
+{
+    return f_overflow;
+}
+
+
+std::uint64_t extended_machine::steps() const
+{
+    return f_steps;
+}
+
+
+int extended_machine::cell(int loc) const
+{
+    return f_memory[loc].f_value;
+}
+
+
+// same as machine::watchdog()
+//
+status_t extended_machine::watchdog(std::uint64_t steps, std::uint64_t & check_at)
+{
+    if(f_limits.f_max_steps != 0
+    && steps >= f_limits.f_max_steps)
+    {
+        return STATUS_STEP_LIMIT;
+    }
+    if(f_limits.f_timeout != std::chrono::nanoseconds::zero()
+    && std::chrono::steady_clock::now() >= f_deadline)
+    {
+        return STATUS_TIMEOUT;
+    }
+    check_at = steps + WATCHDOG_QUANTUM;
+    if(f_limits.f_max_steps != 0
+    && check_at > f_limits.f_max_steps)
+    {
+        check_at = f_limits.f_max_steps;
+    }
+    return STATUS_RUNNING;
+}
+
+
+#define LMC_WATCHDOG() \
+    if(steps >= check_at) \
+    { \
+        status_t const status(watchdog(steps, check_at)); \
+        if(status != STATUS_RUNNING) \
+        { \
+            save(); \
+            return status; \
+        } \
+    }
+
+
+// same loop as machine::run_switch() on the decoded cells; the results of
+// ADD and SUB are within two modulos so a subtraction replaces the
+// division (the modulo is not a compile time constant here)
+//
+status_t extended_machine::run()
+{
+    if(f_limits.f_timeout != std::chrono::nanoseconds::zero())
+    {
+        f_deadline = std::chrono::steady_clock::now() + f_limits.f_timeout;
+    }
+
+    mailbox * const memory(f_memory.data());
+    int const memory_size(f_memory_size);
+    int const modulo(f_modulo);
+    int pc(f_pc);
+    int acc(f_acc);
+    bool overflow(f_overflow);
+    std::uint64_t steps(f_steps);
+    std::uint64_t check_at(steps);
+
+    // a branch in the last mailbox which is not taken stops with
+    // pc == memory_size
+    //
+    auto const save = [&]()
+    {
+        f_pc = pc >= memory_size ? 0 : pc;
+        f_acc = acc;
+        f_overflow = overflow;
+        f_steps = steps;
+    };
+
+    for(;;)
+    {
+        // the wrap around is checked once the instruction in the last
+        // mailbox executed, same as machine::run_switch()
+        //
+        if(pc >= memory_size)
+        {
+            pc = 0;
+            LMC_WATCHDOG();
+        }
+        std::uint32_t const code(memory[pc].f_code);
+        int const loc(code >> 4);
+        ++pc;
+        ++steps;
+        switch(code & 15)
+        {
+        case MNEMONIC_HLT:
+            save();
+            return STATUS_HALTED;
+
+        case MNEMONIC_ADD:
+            acc += memory[loc].f_value;
+            overflow = acc >= modulo;
+            if(overflow
+            || acc <= -modulo)
+            {
+                acc %= modulo;
+            }
+            break;
+
+        case MNEMONIC_SUB:
+            overflow = acc < memory[loc].f_value;
+            acc -= memory[loc].f_value;
+            if(acc >= modulo
+            || acc <= -modulo)
+            {
+                acc %= modulo;
+            }
+            break;
+
+        case MNEMONIC_STA:
+            memory[loc].f_value = acc;
+            decode(memory[loc]);
+            break;
+
+        case MNEMONIC_LDA:
+            acc = memory[loc].f_value;
+            break;
+
+        case MNEMONIC_BRA:
+            pc = loc;
+            LMC_WATCHDOG();
+            break;
+
+        case MNEMONIC_BRZ:
+            if(acc == 0)
+            {
+                pc = loc;
+            }
+            LMC_WATCHDOG();
+            break;
+
+        case MNEMONIC_BRP:
+            if(!overflow)
+            {
+                pc = loc;
+            }
+            LMC_WATCHDOG();
+            break;
+
+        case MNEMONIC_INP:
+            {
+                int value(0);
+                if(!f_input.read(value))
+                {
+                    // stay on the INP so we can resume later
+                    //
+                    --pc;
+                    --steps;
+                    save();
+                    return STATUS_NO_INPUT;
+                }
+                acc = value % modulo;
+            }
+            break;
+
+        case MNEMONIC_OUT:
+            f_output.write(acc);
+            break;
+
+        }
+    }
+}
+
+
+
+} // namespace lmc
+// vim: ts=4 sw=4 et
@@ -0,0 +1,88 @@
+// Written by Alexis Wilke based on
+// https://en.wikipedia.org/wiki/Little_man_computer
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Source: 
+// https://github.com/AlexisWilke/little-man-computer
+
+
+#pragma once
+
+#include    "machine.h"
+
+#include    <vector>
+
+
+namespace lmc
+{
+
+
+
+// A machine with 10^n mailboxes (see extended_program): the cells hold
+// n + 1 digits, ADD and SUB work modulo 10^(n+1) and the addresses have
+// n digits. With 100 mailboxes it behaves exactly like the machine class.
+//
+// The mailboxes are one contiguous array where each cell is kept next to
+// its decoded form (the instruction and its address packed in one word)
+// so an instruction is fetched with a single load and an address can't
+// be out of bounds: decoding applies the modulo once, when the program
+// is loaded or a STA changes a cell, instead of on each step.
+//
+class extended_machine
+{
+public:
+                        extended_machine(extended_program const & p, input & in, output & out);
+
+    status_t            run();
+
+    void                set_limits(limits const & l);
+
+    int                 pc() const;
+    int                 acc() const;
+    bool                overflow() const;
+    std::uint64_t       steps() const;
+    int                 cell(int loc) const;
+
+private:
+    struct mailbox
+    {
+        std::int32_t    f_value = 0;
+        std::uint32_t   f_code = 0;     // (address << 4) | instruction
+    };
+
+    static_assert(sizeof(mailbox) == 8);
+
+    void                decode(mailbox & m) const;
+    status_t            watchdog(std::uint64_t steps, std::uint64_t & check_at);
+
+    int                 f_memory_size = 0;
+    int                 f_modulo = 0;
+    std::vector<mailbox>
+                        f_memory = {};
+    int                 f_pc = 0;
+    int                 f_acc = 0;
+    bool                f_overflow = false;
+    std::uint64_t       f_steps = 0;
+    limits              f_limits = limits();
+    std::chrono::steady_clock::time_point
+                        f_deadline = std::chrono::steady_clock::time_point();
+    input &             f_input;
+    output &            f_output;
+};
+
+
+
+} // namespace lmc
+// vim: ts=4 sw=4 et
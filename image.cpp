@@ -0,0 +1,297 @@
+// Written by Alexis Wilke based on
+// https://en.wikipedia.org/wiki/Little_man_computer
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Source: 
+// https://github.com/AlexisWilke/little-man-computer
+
+
+#include    "image.h"
+
+#include    <cstring>
+#include    <fstream>
+#include    <iostream>
+
+#include    <fcntl.h>
+#include    <sys/mman.h>
+#include    <sys/stat.h>
+#include    <unistd.h>
+
+
+
+namespace lmc
+{
+
+
+
+namespace
+{
+
+
+
+char const  g_magic[4] = { 'L', 'M', 'C', 'B' };
+
+
+void put16(char * buf, std::uint16_t value)
+{
+    buf[0] = static_cast<char>(value);
+    buf[1] = static_cast<char>(value >> 8);
+}
+
+
+void put64(char * buf, std::uint64_t value)
+{
+    for(int idx(0); idx < 8; ++idx)
+    {
+        buf[idx] = static_cast<char>(value >> (idx * 8));
+    }
+}
+
+
+std::uint16_t get16(unsigned char const * buf)
+{
+    return buf[0] | (buf[1] << 8);
+}
+
+
+std::uint64_t get64(unsigned char const * buf)
+{
+    std::uint64_t result(0);
+    for(int idx(7); idx >= 0; --idx)
+    {
+        result = (result << 8) | buf[idx];
+    }
+    return result;
+}
+
+
+// the header and cells are the same for both types of images
+//
+void put_cells(char * buf, image_type_t type, program const & p)
+{
+    memcpy(buf, g_magic, sizeof(g_magic));
+    put16(buf + 4, IMAGE_VERSION);
+    put16(buf + 6, type);
+    put16(buf + 8, MEMORY_SIZE);
+    put16(buf + 10, p.f_size);
+    for(std::size_t idx(0); idx < MEMORY_SIZE; ++idx)
+    {
+        put16(buf + IMAGE_HEADER_SIZE + idx * 2, p.f_cells[idx]);
+    }
+}
+
+
+bool write_file(std::string const & filename, char const * buf, std::size_t size)
+{
+    std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+    if(!out.is_open()
+    || !out.write(buf, size))
+    {
+        std::cerr << "error: could not write image to \"" << filename
+            << "\".\n";
+        return false;
+    }
+    return true;
+}
+
+
+// a program image loads as the snapshot of a machine which did not start
+// yet; snapshot images are only accepted when `accept_snapshot` is true
+//
+bool decode(unsigned char const * buf, std::size_t file_size, std::string const & filename, snapshot & s, bool accept_snapshot)
+{
+    if(file_size < IMAGE_HEADER_SIZE)
+    {
+        std::cerr << "error:" << filename << ": file too small for an image.\n";
+        return false;
+    }
+
+    bool result(false);
+    std::uint16_t const type(get16(buf + 6));
+    std::uint16_t const count(get16(buf + 8));
+    std::uint16_t const size(get16(buf + 10));
+    std::size_t const state(IMAGE_HEADER_SIZE + count * 2);
+    if(memcmp(buf, g_magic, sizeof(g_magic)) != 0)
+    {
+        std::cerr << "error:" << filename << ": not an LMC image.\n";
+    }
+    else if(get16(buf + 4) != IMAGE_VERSION)
+    {
+        std::cerr << "error:" << filename << ": unsupported image version "
+            << get16(buf + 4) << ".\n";
+    }
+    else if(type != IMAGE_TYPE_PROGRAM
+         && (type != IMAGE_TYPE_SNAPSHOT || !accept_snapshot))
+    {
+        std::cerr << "error:" << filename << ": image is not a program.\n";
+    }
+    else if(count != MEMORY_SIZE
+         || size > count
+         || file_size < state + (type == IMAGE_TYPE_SNAPSHOT ? IMAGE_STATE_SIZE : 0))
+    {
+        std::cerr << "error:" << filename << ": invalid image size.\n";
+    }
+    else
+    {
+        result = true;
+        s = snapshot();
+        for(std::size_t idx(0); idx < MEMORY_SIZE; ++idx)
+        {
+            short const cell(get16(buf + IMAGE_HEADER_SIZE + idx * 2));
+            if(cell < -999 || cell > 999)
+            {
+                std::cerr << "error:" << filename << ": cell " << idx
+                    << " is out of range (" << cell << ").\n";
+                result = false;
+                break;
+            }
+            s.f_program.f_cells[idx] = cell;
+        }
+        s.f_program.f_size = size;
+        if(result
+        && type == IMAGE_TYPE_SNAPSHOT)
+        {
+            s.f_pc = get16(buf + state);
+            s.f_acc = static_cast<std::int16_t>(get16(buf + state + 2));
+            s.f_overflow = (get16(buf + state + 4) & 1) != 0;
+            s.f_steps = get64(buf + state + 8);
+            s.f_inputs = get64(buf + state + 16);
+            s.f_outputs = get64(buf + state + 24);
+            if(s.f_pc >= static_cast<int>(MEMORY_SIZE)
+            || s.f_acc < -999
+            || s.f_acc > 999)
+            {
+                std::cerr << "error:" << filename << ": invalid machine state"
+                    " (PC: " << s.f_pc << ", ACC: " << s.f_acc << ").\n";
+                result = false;
+            }
+        }
+    }
+    return result;
+}
+
+
+// the file gets mapped in memory and the cells copied directly from the
+// mapping; the labels are not saved in the image so f_labels remains empty
+//
+bool load_file(std::string const & filename, snapshot & s, bool accept_snapshot)
+{
+    int const fd(open(filename.c_str(), O_RDONLY | O_CLOEXEC));
+    if(fd < 0)
+    {
+        std::cerr << "error: could not open \"" << filename
+            << "\" for reading.\n";
+        return false;
+    }
+    struct stat st;
+    if(fstat(fd, &st) != 0
+    || static_cast<std::size_t>(st.st_size) < IMAGE_HEADER_SIZE)
+    {
+        close(fd);
+        std::cerr << "error:" << filename << ": file too small for an image.\n";
+        return false;
+    }
+    void * const map(mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0));
+    close(fd);
+    if(map == MAP_FAILED)
+    {
+        std::cerr << "error:" << filename << ": could not map image in memory.\n";
+        return false;
+    }
+    bool const result(decode(
+              reinterpret_cast<unsigned char const *>(map)
+            , st.st_size
+            , filename
+            , s
+            , accept_snapshot));
+    munmap(map, st.st_size);
+    return result;
+}
+
+
+
+} // no name namespace
+
+
+
+bool is_image(std::string const & filename)
+{
+    std::ifstream in(filename, std::ios::binary);
+    char magic[sizeof(g_magic)];
+    return in.read(magic, sizeof(magic))
+        && memcmp(magic, g_magic, sizeof(g_magic)) == 0;
+}
+
+
+bool save_image(std::string const & filename, program const & p)
+{
+    char buf[IMAGE_HEADER_SIZE + MEMORY_SIZE * 2] = {};
+    put_cells(buf, IMAGE_TYPE_PROGRAM, p);
+    return write_file(filename, buf, sizeof(buf));
+}
+
+
+bool load_image(std::string const & filename, program & p)
+{
+    snapshot s;
+    if(!load_file(filename, s, false))
+    {
+        return false;
+    }
+    p = s.f_program;
+    return true;
+}
+
+
+bool save_snapshot(std::string const & filename, snapshot const & s)
+{
+    char buf[IMAGE_HEADER_SIZE + MEMORY_SIZE * 2 + IMAGE_STATE_SIZE] = {};
+    put_cells(buf, IMAGE_TYPE_SNAPSHOT, s.f_program);
+    char * const state(buf + IMAGE_HEADER_SIZE + MEMORY_SIZE * 2);
+    put16(state, s.f_pc);
+    put16(state + 2, s.f_acc);
+    put16(state + 4, s.f_overflow ? 1 : 0);
+    put64(state + 8, s.f_steps);
+    put64(state + 16, s.f_inputs);
+    put64(state + 24, s.f_outputs);
+    return write_file(filename, buf, sizeof(buf));
+}
+
+
+// accepts program images as well, in which case the machine starts at 0
+//
+bool load_snapshot(std::string const & filename, snapshot & s)
+{
+    return load_file(filename, s, true);
+}
+
+
+// same as load_snapshot() for an image already in memory (i.e. received
+// by the server); `name` is only used in the error messages
+//
+bool load_snapshot(std::string_view const & data, std::string const & name, snapshot & s)
+{
+    return decode(
+              reinterpret_cast<unsigned char const *>(data.data())
+            , data.size()
+            , name
+            , s
+            , true);
+}
+
+
+
+} // namespace lmc
+// vim: ts=4 sw=4 et
@@ -0,0 +1,78 @@
+// Written by Alexis Wilke based on
+// https://en.wikipedia.org/wiki/Little_man_computer
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Source: 
+// https://github.com/AlexisWilke/little-man-computer
+
+
+#pragma once
+
+#include    "machine.h"
+
+#include    <cstdint>
+#include    <string_view>
+
+
+namespace lmc
+{
+
+
+
+// The precompiled image is a small header followed by the cells, all in
+// little endian:
+//
+//     offset  size  field
+//          0     4  magic "LMCB"
+//          4     2  version (1)
+//          6     2  type (IMAGE_TYPE_...)
+//          8     2  number of cells in the file (MEMORY_SIZE)
+//         10     2  number of cells used by the program (-s output)
+//         12     4  reserved (0)
+//         16   2*n  the cells, one signed 16 bit number each
+//
+// A snapshot (IMAGE_TYPE_SNAPSHOT) has the same header and cells followed
+// by the machine registers:
+//
+//     offset  size  field
+//     16+2*n     2  PC
+//     18+2*n     2  accumulator (signed)
+//     20+2*n     2  flags (bit 0: overflow)
+//     22+2*n     2  reserved (0)
+//     24+2*n     8  number of instructions executed
+//     32+2*n     8  number of values read by INP
+//     40+2*n     8  number of values written by OUT
+//
+typedef std::uint16_t image_type_t;
+
+constexpr image_type_t      IMAGE_TYPE_PROGRAM = 1;
+constexpr image_type_t      IMAGE_TYPE_SNAPSHOT = 2;
+
+constexpr std::uint16_t     IMAGE_VERSION = 1;
+constexpr std::size_t       IMAGE_HEADER_SIZE = 16;
+constexpr std::size_t       IMAGE_STATE_SIZE = 32;
+
+
+bool        is_image(std::string const & filename);
+bool        save_image(std::string const & filename, program const & p);
+bool        load_image(std::string const & filename, program & p);
+bool        save_snapshot(std::string const & filename, snapshot const & s);
+bool        load_snapshot(std::string const & filename, snapshot & s);
+bool        load_snapshot(std::string_view const & data, std::string const & name, snapshot & s);
+
+
+
+} // namespace lmc
+// vim: ts=4 sw=4 et
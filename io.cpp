@@ -0,0 +1,270 @@
+// Written by Alexis Wilke based on
+// https://en.wikipedia.org/wiki/Little_man_computer
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Source: 
+// https://github.com/AlexisWilke/little-man-computer
+
+
+#include    "io.h"
+
+#include    <cerrno>
+#include    <cctype>
+
+#include    <unistd.h>
+
+
+
+namespace lmc
+{
+
+
+
+stream_input::stream_input(std::istream & in, std::ostream * prompt)
+    : f_in(in)
+    , f_prompt(prompt)
+{
+}
+
+
+bool stream_input::read(int & value)
+{
+    if(f_prompt != nullptr)
+    {
+        *f_prompt << "lmc> " << std::flush;
+    }
+    return static_cast<bool>(f_in >> value);
+}
+
+
+vector_input::vector_input(std::vector<int> const & values)
+    : f_values(values)
+{
+}
+
+
+bool vector_input::read(int & value)
+{
+    if(f_pos >= f_values.size())
+    {
+        return false;
+    }
+    value = f_values[f_pos];
+    ++f_pos;
+    return true;
+}
+
+
+stream_output::stream_output(std::ostream & out)
+    : f_out(out)
+{
+}
+
+
+void stream_output::write(int value)
+{
+    f_out << value << "\n";
+}
+
+
+void stream_output::flush()
+{
+    f_out << std::flush;
+}
+
+
+
+fd_input::fd_input(int fd)
+    : f_fd(fd)
+{
+}
+
+
+bool fd_input::fill()
+{
+    if(f_eof)
+    {
+        return false;
+    }
+    for(;;)
+    {
+        ssize_t const r(::read(f_fd, f_buffer, sizeof(f_buffer)));
+        if(r > 0)
+        {
+            f_pos = 0;
+            f_end = r;
+            return true;
+        }
+        if(r < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        f_eof = true;
+        return false;
+    }
+}
+
+
+// same as `std::cin >> value`: skip spaces, accept an optional sign and
+// then digits; anything else is considered the end of the input
+//
+bool fd_input::read(int & value)
+{
+    for(;;)
+    {
+        if(f_pos >= f_end && !fill())
+        {
+            return false;
+        }
+        if(!isspace(f_buffer[f_pos]))
+        {
+            break;
+        }
+        ++f_pos;
+    }
+
+    bool negative(false);
+    if(f_buffer[f_pos] == '-' || f_buffer[f_pos] == '+')
+    {
+        negative = f_buffer[f_pos] == '-';
+        ++f_pos;
+        if(f_pos >= f_end && !fill())
+        {
+            return false;
+        }
+    }
+
+    int result(0);
+    int digits(0);
+    for(;;)
+    {
+        if(f_pos >= f_end && !fill())
+        {
+            break;
+        }
+        char const c(f_buffer[f_pos]);
+        if(c < '0' || c > '9')
+        {
+            break;
+        }
+        result = result * 10 + c - '0';
+        if(result >= 100'000'000)
+        {
+            // the machine only uses the value modulo 1000
+            //
+            result %= 1000;
+        }
+        ++digits;
+        ++f_pos;
+    }
+    if(digits == 0)
+    {
+        // not a number, the rest of the input is ignored
+        //
+        f_eof = true;
+        f_pos = f_end;
+        return false;
+    }
+
+    value = negative ? -result : result;
+    return true;
+}
+
+
+vector_output::vector_output(std::vector<int> & values)
+    : f_values(values)
+{
+}
+
+
+void vector_output::write(int value)
+{
+    f_values.push_back(value);
+}
+
+
+fd_output::fd_output(int fd)
+    : f_fd(fd)
+{
+}
+
+
+fd_output::~fd_output()
+{
+    flush();
+}
+
+
+void fd_output::write(int value)
+{
+    // worst case is "-2147483648\n"
+    //
+    if(f_pos + 12 > sizeof(f_buffer))
+    {
+        flush();
+    }
+
+    unsigned int v(value < 0 ? 0U - static_cast<unsigned int>(value) : value);
+    char digits[10];
+    int len(0);
+    do
+    {
+        digits[len] = v % 10 + '0';
+        v /= 10;
+        ++len;
+    }
+    while(v != 0);
+    if(value < 0)
+    {
+        f_buffer[f_pos] = '-';
+        ++f_pos;
+    }
+    while(len > 0)
+    {
+        --len;
+        f_buffer[f_pos] = digits[len];
+        ++f_pos;
+    }
+    f_buffer[f_pos] = '\n';
+    ++f_pos;
+}
+
+
+void fd_output::flush()
+{
+    char const * s(f_buffer);
+    while(f_pos > 0)
+    {
+        ssize_t const r(::write(f_fd, s, f_pos));
+        if(r < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            // nowhere to report the error, drop the data
+            //
+            break;
+        }
+        s += r;
+        f_pos -= r;
+    }
+    f_pos = 0;
+}
+
+
+
+} // namespace lmc
+// vim: ts=4 sw=4 et
@@ -0,0 +1,161 @@
+// Written by Alexis Wilke based on
+// https://en.wikipedia.org/wiki/Little_man_computer
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Source: 
+// https://github.com/AlexisWilke/little-man-computer
+
+
+#pragma once
+
+#include    <iostream>
+#include    <vector>
+
+
+namespace lmc
+{
+
+
+
+// where INP reads its values from
+//
+class input
+{
+public:
+    virtual             ~input() {}
+
+    // return false when no more input is available
+    //
+    virtual bool        read(int & value) = 0;
+};
+
+
+// where OUT writes its values to
+//
+class output
+{
+public:
+    virtual             ~output() {}
+
+    virtual void        write(int value) = 0;
+    virtual void        flush() {}
+};
+
+
+// the interactive console: print a prompt and read from a stream
+//
+class stream_input
+    : public input
+{
+public:
+                        stream_input(std::istream & in, std::ostream * prompt = nullptr);
+
+    virtual bool        read(int & value) override;
+
+private:
+    std::istream &      f_in;
+    std::ostream *      f_prompt = nullptr;
+};
+
+
+// a list of values ready in memory (i.e. batch mode)
+//
+class vector_input
+    : public input
+{
+public:
+                        vector_input(std::vector<int> const & values);
+
+    virtual bool        read(int & value) override;
+
+private:
+    std::vector<int> const &
+                        f_values;
+    std::size_t         f_pos = 0;
+};
+
+
+class stream_output
+    : public output
+{
+public:
+                        stream_output(std::ostream & out);
+
+    virtual void        write(int value) override;
+    virtual void        flush() override;
+
+private:
+    std::ostream &      f_out;
+};
+
+
+// non-interactive input: read the file descriptor in large blocks and
+// parse the numbers by hand instead of going through std::istream
+//
+class fd_input
+    : public input
+{
+public:
+                        fd_input(int fd);
+
+    virtual bool        read(int & value) override;
+
+private:
+    bool                fill();
+
+    int                 f_fd = -1;
+    char                f_buffer[64 * 1024];
+    std::size_t         f_pos = 0;
+    std::size_t         f_end = 0;
+    bool                f_eof = false;
+};
+
+
+class vector_output
+    : public output
+{
+public:
+                        vector_output(std::vector<int> & values);
+
+    virtual void        write(int value) override;
+
+private:
+    std::vector<int> &  f_values;
+};
+
+
+// non-interactive output: the values are converted by hand to a large
+// buffer which gets written when full and on flush() (i.e. at HLT)
+//
+class fd_output
+    : public output
+{
+public:
+                        fd_output(int fd);
+    virtual             ~fd_output() override;
+
+    virtual void        write(int value) override;
+    virtual void        flush() override;
+
+private:
+    int                 f_fd = -1;
+    char                f_buffer[64 * 1024];
+    std::size_t         f_pos = 0;
+};
+
+
+
+} // namespace lmc
+// vim: ts=4 sw=4 et
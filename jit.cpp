@@ -0,0 +1,574 @@
+// Written by Alexis Wilke based on
+// https://en.wikipedia.org/wiki/Little_man_computer
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Source: 
+// https://github.com/AlexisWilke/little-man-computer
+
+
+#include    "jit.h"
+
+#include    <algorithm>
+#include    <cstddef>
+#include    <cstring>
+#include    <iterator>
+
+#include    <sys/mman.h>
+#include    <unistd.h>
+
+
+
+namespace lmc
+{
+
+
+
+namespace
+{
+
+
+
+// each mailbox gets a slot this large; the longest one (BRZ/BRP with two
+// watchdog exits) is 47 bytes
+//
+constexpr std::size_t       SLOT_SIZE = 64;
+
+// slot MEMORY_SIZE is used when the PC wraps around
+//
+constexpr std::size_t       SLOT_COUNT = MEMORY_SIZE + 1;
+
+constexpr std::size_t       HEADER_SIZE = 256;
+
+
+// offsets used by the generated code, as disp8 from r15
+//
+constexpr std::uint8_t      OFFSET_MEMORY = offsetof(jit_state, f_memory);
+constexpr std::uint8_t      OFFSET_COMPILED = offsetof(jit_state, f_compiled);
+constexpr std::uint8_t      OFFSET_STEPS = offsetof(jit_state, f_steps);
+constexpr std::uint8_t      OFFSET_CHECK_AT = offsetof(jit_state, f_check_at);
+constexpr std::uint8_t      OFFSET_ACC = offsetof(jit_state, f_acc);
+constexpr std::uint8_t      OFFSET_OVERFLOW = offsetof(jit_state, f_overflow);
+constexpr std::uint8_t      OFFSET_PC = offsetof(jit_state, f_pc);
+constexpr std::uint8_t      OFFSET_LOC = offsetof(jit_state, f_loc);
+constexpr std::uint8_t      OFFSET_REASON = offsetof(jit_state, f_reason);
+
+static_assert(offsetof(jit_state, f_reason) < 128);
+
+
+// Register usage in the generated code:
+//
+//     rbx      memory (short *)
+//     rbp      compiled flags (uint8_t *)
+//     r12d     accumulator
+//     r13d     overflow flag (0 or 1)
+//     r14      step counter
+//     r15      jit_state *
+//     eax      PC at exit
+//     ecx      cell at exit (JIT_EXIT_INVALIDATE)
+//
+class emitter
+{
+public:
+    emitter(std::uint8_t * ptr)
+        : f_ptr(ptr)
+    {
+    }
+
+    std::uint8_t * ptr() const
+    {
+        return f_ptr;
+    }
+
+    void byte(std::uint8_t b)
+    {
+        *f_ptr = b;
+        ++f_ptr;
+    }
+
+    void bytes(std::initializer_list<std::uint8_t> list)
+    {
+        for(auto const b : list)
+        {
+            byte(b);
+        }
+    }
+
+    void imm32(std::int32_t value)
+    {
+        memcpy(f_ptr, &value, sizeof(value));
+        f_ptr += sizeof(value);
+    }
+
+    // jmp rel32
+    //
+    void jmp(std::uint8_t const * target)
+    {
+        byte(0xE9);
+        imm32(static_cast<std::int32_t>(target - (f_ptr + 4)));
+    }
+
+    // a short conditional jump to a label defined later with patch()
+    //
+    std::uint8_t * jcc8(std::uint8_t opcode)
+    {
+        byte(opcode);
+        byte(0);
+        return f_ptr - 1;
+    }
+
+    void patch(std::uint8_t * rel8)
+    {
+        *rel8 = static_cast<std::uint8_t>(f_ptr - (rel8 + 1));
+    }
+
+    // mov eax, pc; jmp trampoline
+    //
+    void exit(std::uint8_t const * trampoline, int pc)
+    {
+        byte(0xB8);
+        imm32(pc);
+        jmp(trampoline);
+    }
+
+    void inc_steps()
+    {
+        bytes({ 0x49, 0xFF, 0xC6 });                        // inc r14
+    }
+
+    // cmp r14, [r15 + check_at]; jae <returned label>
+    //
+    std::uint8_t * watchdog()
+    {
+        bytes({ 0x4D, 0x3B, 0x77, OFFSET_CHECK_AT });
+        return jcc8(0x73);
+    }
+
+    // bring the accumulator back in (-1000, 1000) like the `% 1000` of the
+    // interpreters; this works because all the cells and the accumulator
+    // are known to be in [-999, 999]
+    //
+    void modulo(bool set_overflow)
+    {
+        bytes({ 0x41, 0x81, 0xFC }); imm32(999);            // cmp r12d, 999
+        std::uint8_t * const not_above(jcc8(0x7E));         // jle
+        bytes({ 0x41, 0x81, 0xEC }); imm32(1000);           // sub r12d, 1000
+        if(set_overflow)
+        {
+            bytes({ 0x41, 0xBD }); imm32(1);                // mov r13d, 1
+        }
+        patch(not_above);
+        bytes({ 0x41, 0x81, 0xFC }); imm32(-999);           // cmp r12d, -999
+        std::uint8_t * const not_below(jcc8(0x7D));         // jge
+        bytes({ 0x41, 0x81, 0xC4 }); imm32(1000);           // add r12d, 1000
+        patch(not_below);
+    }
+
+private:
+    std::uint8_t *      f_ptr = nullptr;
+};
+
+
+std::size_t page_align(std::size_t size)
+{
+    std::size_t const page(sysconf(_SC_PAGESIZE));
+    return (size + page - 1) / page * page;
+}
+
+
+
+} // no name namespace
+
+
+
+bool jit::supported()
+{
+#if defined(__x86_64__)
+    return true;
+#else
+    return false;
+#endif
+}
+
+
+jit::jit()
+{
+    if(!supported())
+    {
+        return;
+    }
+
+    // the code is written through one mapping and executed through a
+    // second mapping of the same pages so compiling a block does not need
+    // any mprotect() (a system call which also serializes the threads);
+    // without memfd_create() we fall back to one mapping and mprotect()
+    //
+    f_size = page_align(HEADER_SIZE + SLOT_COUNT * SLOT_SIZE);
+    int const fd(memfd_create("lmc-jit", MFD_CLOEXEC));
+    if(fd >= 0)
+    {
+        if(ftruncate(fd, f_size) == 0)
+        {
+            void * const code(mmap(nullptr, f_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0));
+            void * const exec(mmap(nullptr, f_size, PROT_READ | PROT_EXEC, MAP_SHARED, fd, 0));
+            if(code != MAP_FAILED
+            && exec != MAP_FAILED)
+            {
+                f_code = reinterpret_cast<std::uint8_t *>(code);
+                f_exec = reinterpret_cast<std::uint8_t *>(exec);
+            }
+            else
+            {
+                if(code != MAP_FAILED)
+                {
+                    munmap(code, f_size);
+                }
+                if(exec != MAP_FAILED)
+                {
+                    munmap(exec, f_size);
+                }
+            }
+        }
+        close(fd);
+    }
+    if(f_code == nullptr)
+    {
+        void * const map(mmap(nullptr, f_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+        if(map == MAP_FAILED)
+        {
+            f_size = 0;
+            return;
+        }
+        f_code = reinterpret_cast<std::uint8_t *>(map);
+        f_exec = f_code;
+    }
+    memset(f_code, 0xCC, f_size);       // int3 everywhere else
+
+    // entry: void (*)(jit_state * state, void const * target)
+    //
+    emitter e(f_code);
+    e.bytes({ 0x53, 0x55, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57 });   // push rbx, rbp, r12-r15
+    e.bytes({ 0x49, 0x89, 0xFF });                          // mov r15, rdi
+    e.bytes({ 0x49, 0x8B, 0x5F, OFFSET_MEMORY });           // mov rbx, [r15 + memory]
+    e.bytes({ 0x49, 0x8B, 0x6F, OFFSET_COMPILED });         // mov rbp, [r15 + compiled]
+    e.bytes({ 0x45, 0x8B, 0x67, OFFSET_ACC });              // mov r12d, [r15 + acc]
+    e.bytes({ 0x45, 0x8B, 0x6F, OFFSET_OVERFLOW });         // mov r13d, [r15 + overflow]
+    e.bytes({ 0x4D, 0x8B, 0x77, OFFSET_STEPS });            // mov r14, [r15 + steps]
+    e.bytes({ 0xFF, 0xE6 });                                // jmp rsi
+
+    f_epilogue = e.ptr();
+    e.bytes({ 0x45, 0x89, 0x67, OFFSET_ACC });              // mov [r15 + acc], r12d
+    e.bytes({ 0x45, 0x89, 0x6F, OFFSET_OVERFLOW });         // mov [r15 + overflow], r13d
+    e.bytes({ 0x4D, 0x89, 0x77, OFFSET_STEPS });            // mov [r15 + steps], r14
+    e.bytes({ 0x41, 0x5F, 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0x5D, 0x5B });   // pop r15-r12, rbp, rbx
+    e.byte(0xC3);                                           // ret
+
+    for(jit_exit_t reason(0); reason <= JIT_EXIT_INVALIDATE; ++reason)
+    {
+        f_trampolines[reason] = e.ptr();
+        e.bytes({ 0x41, 0x89, 0x47, OFFSET_PC });           // mov [r15 + pc], eax
+        e.bytes({ 0x41, 0x89, 0x4F, OFFSET_LOC });          // mov [r15 + loc], ecx
+        e.bytes({ 0x41, 0xC7, 0x47, OFFSET_REASON });       // mov dword [r15 + reason], ...
+        e.imm32(reason);
+        e.jmp(f_epilogue);
+    }
+
+    f_slots = f_code + HEADER_SIZE;
+    for(std::size_t pc(0); pc < MEMORY_SIZE; ++pc)
+    {
+        emit_stub(pc);
+    }
+
+    // wrap around: check the watchdog and go to slot 0
+    //
+    emitter w(f_slots + MEMORY_SIZE * SLOT_SIZE);
+    std::uint8_t * const stop(w.watchdog());
+    w.jmp(f_slots);
+    w.patch(stop);
+    w.exit(f_trampolines[JIT_EXIT_WATCHDOG], 0);
+
+    writable(false);
+}
+
+
+jit::~jit()
+{
+    if(f_exec != f_code)
+    {
+        munmap(f_exec, f_size);
+    }
+    if(f_code != nullptr)
+    {
+        munmap(f_code, f_size);
+    }
+}
+
+
+bool jit::valid() const
+{
+    return f_code != nullptr;
+}
+
+
+std::uint8_t * jit::compiled()
+{
+    return f_compiled;
+}
+
+
+void jit::enter(jit_state & state, int pc)
+{
+    typedef void (*entry_t)(jit_state *, void const *);
+    state.f_compiled = f_compiled;
+    reinterpret_cast<entry_t>(f_exec)(&state, f_exec + (f_slots - f_code) + pc * SLOT_SIZE);
+}
+
+
+// compile the basic block starting at pc, i.e. up to the next branch or HLT;
+// when guard_stores is false, the caller determined that no STA can write
+// to code (see analyze()) so they do not check the compiled flags
+//
+void jit::compile(int pc, short const * memory, bool guard_stores)
+{
+    writable(true);
+    for(; pc < static_cast<int>(MEMORY_SIZE) && f_compiled[pc] == 0; ++pc)
+    {
+        f_compiled[pc] = 1;
+        f_sources[pc] = memory[pc];
+        int const instruction(emit_slot(pc, memory[pc], guard_stores));
+        if(instruction == MNEMONIC_HLT
+        || instruction == MNEMONIC_BRA
+        || instruction == MNEMONIC_BRZ
+        || instruction == MNEMONIC_BRP)
+        {
+            break;
+        }
+    }
+    writable(false);
+}
+
+
+// the cell was overwritten; it will be compiled again if it gets executed;
+// returns the number of times that cell was invalidated since the last
+// reset() so the caller can tell which cells keep changing
+//
+std::uint32_t jit::invalidate(int loc)
+{
+    writable(true);
+    f_compiled[loc] = 0;
+    emit_stub(loc);
+    writable(false);
+    ++f_invalidations[loc];
+    return f_invalidations[loc];
+}
+
+
+// the memory was replaced (i.e. the machine restarts the same program),
+// only forget the slots compiled from a cell which is now different
+//
+void jit::sync(short const * memory)
+{
+    bool changed(false);
+    for(std::size_t pc(0); pc < MEMORY_SIZE; ++pc)
+    {
+        if(f_compiled[pc] != 0
+        && f_sources[pc] != memory[pc])
+        {
+            if(!changed)
+            {
+                writable(true);
+                changed = true;
+            }
+            f_compiled[pc] = 0;
+            emit_stub(pc);
+        }
+    }
+    if(changed)
+    {
+        writable(false);
+    }
+}
+
+
+// forget all the compiled slots, i.e. before running another program
+//
+void jit::reset()
+{
+    std::fill(std::begin(f_invalidations), std::end(f_invalidations), 0);
+    if(std::find(std::begin(f_compiled), std::end(f_compiled), 1) == std::end(f_compiled))
+    {
+        return;
+    }
+    writable(true);
+    for(std::size_t pc(0); pc < MEMORY_SIZE; ++pc)
+    {
+        if(f_compiled[pc] != 0)
+        {
+            f_compiled[pc] = 0;
+            emit_stub(pc);
+        }
+    }
+    writable(false);
+}
+
+
+// only needed when the code could not be mapped twice
+//
+void jit::writable(bool w)
+{
+    if(f_exec == f_code)
+    {
+        mprotect(f_code, f_size, w ? PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC);
+    }
+}
+
+
+void jit::emit_stub(int pc)
+{
+    emitter e(f_slots + pc * SLOT_SIZE);
+    e.exit(f_trampolines[JIT_EXIT_COMPILE], pc);
+}
+
+
+// generate the code of one mailbox with the same semantics as the switch()
+// in machine::run_switch(); the slot ends with a jump to the next slot
+//
+int jit::emit_slot(int pc, short cell, bool guard_stores)
+{
+    std::uint8_t * const start(f_slots + pc * SLOT_SIZE);
+    std::uint8_t * const next(start + SLOT_SIZE);
+    emitter e(start);
+
+    int instruction(cell / 100);
+    int const loc(cell % 100);
+    std::int32_t const disp(loc * 2);
+    if(instruction < MNEMONIC_HLT || instruction > MNEMONIC_OUT)
+    {
+        instruction = -1;
+    }
+
+    e.inc_steps();
+    switch(instruction)
+    {
+    case MNEMONIC_HLT:
+        e.exit(f_trampolines[JIT_EXIT_HLT], pc + 1);
+        break;
+
+    case MNEMONIC_ADD:
+        e.bytes({ 0x0F, 0xBF, 0x83 }); e.imm32(disp);       // movsx eax, word [rbx + loc * 2]
+        e.bytes({ 0x41, 0x01, 0xC4 });                      // add r12d, eax
+        e.bytes({ 0x45, 0x31, 0xED });                      // xor r13d, r13d
+        e.modulo(true);
+        break;
+
+    case MNEMONIC_SUB:
+        e.bytes({ 0x0F, 0xBF, 0x83 }); e.imm32(disp);       // movsx eax, word [rbx + loc * 2]
+        e.bytes({ 0x45, 0x31, 0xED });                      // xor r13d, r13d
+        e.bytes({ 0x41, 0x39, 0xC4 });                      // cmp r12d, eax
+        e.bytes({ 0x41, 0x0F, 0x9C, 0xC5 });                // setl r13b
+        e.bytes({ 0x41, 0x29, 0xC4 });                      // sub r12d, eax
+        e.modulo(false);
+        break;
+
+    case MNEMONIC_STA:
+        {
+            e.bytes({ 0x66, 0x44, 0x89, 0xA3 }); e.imm32(disp); // mov word [rbx + loc * 2], r12w
+            if(!guard_stores)
+            {
+                break;
+            }
+            e.bytes({ 0x80, 0xBD }); e.imm32(loc); e.byte(0);   // cmp byte [rbp + loc], 0
+            std::uint8_t * const code(e.jcc8(0x75));            // jne
+            std::uint8_t * const data(e.jcc8(0xEB));            // jmp
+            e.patch(code);
+            e.bytes({ 0xB9 }); e.imm32(loc);                    // mov ecx, loc
+            e.exit(f_trampolines[JIT_EXIT_INVALIDATE], pc + 1);
+            e.patch(data);
+        }
+        break;
+
+    case MNEMONIC_LDA:
+        e.bytes({ 0x44, 0x0F, 0xBF, 0xA3 }); e.imm32(disp); // movsx r12d, word [rbx + loc * 2]
+        break;
+
+    case MNEMONIC_BRA:
+        {
+            std::uint8_t * const stop(e.watchdog());
+            e.jmp(f_slots + loc * SLOT_SIZE);
+            e.patch(stop);
+            e.exit(f_trampolines[JIT_EXIT_WATCHDOG], loc);
+        }
+        break;
+
+    case MNEMONIC_BRZ:
+    case MNEMONIC_BRP:
+        {
+            if(instruction == MNEMONIC_BRZ)
+            {
+                e.bytes({ 0x45, 0x85, 0xE4 });              // test r12d, r12d
+            }
+            else
+            {
+                e.bytes({ 0x45, 0x85, 0xED });              // test r13d, r13d
+            }
+            std::uint8_t * const not_taken(e.jcc8(0x75));   // jne
+            std::uint8_t * const stop_taken(e.watchdog());
+            e.jmp(f_slots + loc * SLOT_SIZE);
+            e.patch(stop_taken);
+            e.exit(f_trampolines[JIT_EXIT_WATCHDOG], loc);
+            e.patch(not_taken);
+            std::uint8_t * const stop(e.watchdog());
+            std::uint8_t * const go_on(e.jcc8(0xEB));
+            e.patch(stop);
+            e.exit(f_trampolines[JIT_EXIT_WATCHDOG], pc + 1);
+            e.patch(go_on);
+        }
+        break;
+
+    case MNEMONIC_INP:
+        e.exit(f_trampolines[JIT_EXIT_INP], pc);
+        break;
+
+    case MNEMONIC_OUT:
+        e.exit(f_trampolines[JIT_EXIT_OUT], pc + 1);
+        break;
+
+    default:
+        // not a valid instruction, ignored
+        break;
+
+    }
+
+    // fall through the next slot
+    //
+    if(e.ptr() + 2 <= next)
+    {
+        std::uint8_t * const fall(e.jcc8(0xEB));
+        *fall = static_cast<std::uint8_t>(next - (fall + 1));
+    }
+    else
+    {
+        while(e.ptr() < next)
+        {
+            e.byte(0x90);
+        }
+    }
+
+    return instruction;
+}
+
+
+
+} // namespace lmc
+// vim: ts=4 sw=4 et
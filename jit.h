@@ -0,0 +1,109 @@
+// Written by Alexis Wilke based on
+// https://en.wikipedia.org/wiki/Little_man_computer
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Source: 
+// https://github.com/AlexisWilke/little-man-computer
+
+
+#pragma once
+
+#include    "program.h"
+
+#include    <cstdint>
+
+
+namespace lmc
+{
+
+
+
+// The JIT translates each mailbox to a fixed size slot of native code the
+// first time it gets executed (one basic block at a time). The generated
+// code keeps the accumulator, overflow flag and step counter in registers
+// and returns to the host (machine::run_jit()) for I/O, HLT, the watchdog,
+// compiling the next block, and when an STA overwrites a cell which was
+// compiled (self-modifying code), in which case only that slot gets reset.
+// The slots remember the cell they were compiled from so a machine running
+// the same program again (see sync()) keeps all the slots which still match.
+//
+// Only x86-64 is supported; on other processors valid() returns false and
+// the machine uses the threaded interpreter instead.
+
+typedef std::int32_t jit_exit_t;
+
+constexpr jit_exit_t    JIT_EXIT_HLT = 0;
+constexpr jit_exit_t    JIT_EXIT_INP = 1;
+constexpr jit_exit_t    JIT_EXIT_OUT = 2;
+constexpr jit_exit_t    JIT_EXIT_WATCHDOG = 3;
+constexpr jit_exit_t    JIT_EXIT_COMPILE = 4;
+constexpr jit_exit_t    JIT_EXIT_INVALIDATE = 5;
+
+
+// the registers as exchanged between the host and the generated code; the
+// offsets are hard coded in the generated code (see jit.cpp)
+//
+struct jit_state
+{
+    short *             f_memory = nullptr;
+    std::uint8_t *      f_compiled = nullptr;
+    std::uint64_t       f_steps = 0;
+    std::uint64_t       f_check_at = 0;
+    std::int32_t        f_acc = 0;
+    std::int32_t        f_overflow = 0;
+    std::int32_t        f_pc = 0;           // where to resume, MEMORY_SIZE means "wrap to 0"
+    std::int32_t        f_loc = 0;          // JIT_EXIT_INVALIDATE: the cell overwritten
+    jit_exit_t          f_reason = JIT_EXIT_HLT;
+};
+
+
+class jit
+{
+public:
+                        jit();
+                        jit(jit const &) = delete;
+                        ~jit();
+    jit &               operator = (jit const &) = delete;
+
+    static bool         supported();
+
+    bool                valid() const;
+    std::uint8_t *      compiled();
+    void                enter(jit_state & state, int pc);
+    void                compile(int pc, short const * memory, bool guard_stores);
+    std::uint32_t       invalidate(int loc);
+    void                sync(short const * memory);
+    void                reset();
+
+private:
+    void                writable(bool w);
+    void                emit_stub(int pc);
+    int                 emit_slot(int pc, short cell, bool guard_stores);
+
+    std::uint8_t *      f_code = nullptr;       // where the code gets written
+    std::uint8_t *      f_exec = nullptr;       // where it gets executed (may be f_code)
+    std::size_t         f_size = 0;
+    std::uint8_t *      f_epilogue = nullptr;
+    std::uint8_t *      f_trampolines[JIT_EXIT_INVALIDATE + 1] = {};
+    std::uint8_t *      f_slots = nullptr;
+    std::uint8_t        f_compiled[MEMORY_SIZE] = {};
+    short               f_sources[MEMORY_SIZE] = {};           // the cells as compiled
+    std::uint32_t       f_invalidations[MEMORY_SIZE] = {};
+};
+
+
+
+} // namespace lmc
+// vim: ts=4 sw=4 et
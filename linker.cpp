@@ -0,0 +1,442 @@
+// Written by Alexis Wilke based on
+// https://en.wikipedia.org/wiki/Little_man_computer
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Source: 
+// https://github.com/AlexisWilke/little-man-computer
+
+
+#include    "linker.h"
+
+#include    "parser.h"
+
+#include    <algorithm>
+#include    <atomic>
+#include    <cstdio>
+#include    <cstring>
+#include    <fstream>
+#include    <iostream>
+#include    <iterator>
+#include    <thread>
+#include    <unordered_map>
+
+#include    <unistd.h>
+
+
+
+namespace lmc
+{
+
+
+
+namespace
+{
+
+
+
+char const  g_magic[4] = { 'L', 'M', 'C', 'O' };
+
+constexpr std::uint16_t     OBJECT_VERSION = 3;
+constexpr std::size_t       OBJECT_HEADER_SIZE = 16;
+
+
+void put8(std::string & buf, std::uint8_t value)
+{
+    buf += static_cast<char>(value);
+}
+
+
+void put16(std::string & buf, std::uint16_t value)
+{
+    buf += static_cast<char>(value);
+    buf += static_cast<char>(value >> 8);
+}
+
+
+void put32(std::string & buf, std::uint32_t value)
+{
+    put16(buf, value);
+    put16(buf, value >> 16);
+}
+
+
+// reads past the end of the data return 0 and mark the reader as failed
+// so a truncated file is detected once, at the end
+//
+class reader
+{
+public:
+    reader(std::string const & data)
+        : f_data(data)
+    {
+    }
+
+    std::uint8_t get8()
+    {
+        if(f_pos >= f_data.size())
+        {
+            f_failed = true;
+            return 0;
+        }
+        return static_cast<unsigned char>(f_data[f_pos++]);
+    }
+
+    std::uint16_t get16()
+    {
+        std::uint16_t const lo(get8());
+        return lo | (get8() << 8);
+    }
+
+    std::uint32_t get32()
+    {
+        std::uint32_t const lo(get16());
+        return lo | (static_cast<std::uint32_t>(get16()) << 16);
+    }
+
+    std::string get_name()
+    {
+        return get_bytes(get8());
+    }
+
+    std::string get_bytes(std::size_t size)
+    {
+        if(f_pos + size > f_data.size())
+        {
+            f_failed = true;
+            return std::string();
+        }
+        f_pos += size;
+        return f_data.substr(f_pos - size, size);
+    }
+
+    bool good() const
+    {
+        return !f_failed && f_pos == f_data.size();
+    }
+
+private:
+    std::string const & f_data;
+    std::size_t         f_pos = 0;
+    bool                f_failed = false;
+};
+
+
+std::string object_filename(std::string const & cache, std::string const & source)
+{
+    std::uint64_t h(14695981039346656037ULL);
+    for(auto const c : source)
+    {
+        h = (h ^ static_cast<unsigned char>(c)) * 1099511628211ULL;
+    }
+    char name[32];
+    snprintf(name, sizeof(name), "/%016llx.lmco", static_cast<unsigned long long>(h));
+    return cache + name;
+}
+
+
+// any invalid or truncated file is ignored, the unit gets assembled; the
+// file name is only a hash so the object is used only if the source it
+// saved is the exact same, like result_cache::lookup() with its key
+//
+bool load_object(std::string const & filename, std::string const & source, object_unit & u)
+{
+    std::ifstream in(filename, std::ios::binary);
+    if(!in.is_open())
+    {
+        return false;
+    }
+    std::string const data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    if(data.size() < OBJECT_HEADER_SIZE
+    || memcmp(data.data(), g_magic, sizeof(g_magic)) != 0)
+    {
+        return false;
+    }
+    reader r(data);
+    r.get32();
+    std::size_t const version(r.get16());
+    std::size_t const cells(r.get16());
+    std::size_t const labels(r.get16());
+    std::size_t const references(r.get16());
+    std::size_t const source_size(r.get32());
+    if(version != OBJECT_VERSION
+    || cells > MEMORY_SIZE
+    || source_size != source.size())
+    {
+        return false;
+    }
+
+    u.f_program = program();
+    u.f_references.clear();
+    for(std::size_t idx(0); idx < cells; ++idx)
+    {
+        u.f_program.f_cells[idx] = static_cast<std::int16_t>(r.get16());
+    }
+    u.f_program.f_size = cells;
+    for(std::size_t idx(0); idx < labels; ++idx)
+    {
+        int const pc(r.get16());
+        u.f_program.f_labels[r.get_name()] = pc;
+    }
+    for(std::size_t idx(0); idx < references; ++idx)
+    {
+        reference ref;
+        ref.f_cell = r.get16();
+        ref.f_local = (r.get8() & 1) != 0;
+        ref.f_line = r.get32();
+        ref.f_label = r.get_name();
+        if(ref.f_cell >= static_cast<int>(cells))
+        {
+            return false;
+        }
+        u.f_references.push_back(ref);
+    }
+    return r.get_bytes(source_size) == source
+        && r.good();
+}
+
+
+// same as result_cache::store(), errors are ignored; the temporary name
+// includes the unit number since two units may have the same source; a
+// unit with a name longer than 255 characters does not get cached since
+// the lengths are saved in one byte
+//
+void save_object(std::string const & filename, std::string const & source, object_unit const & u, std::size_t unit)
+{
+    std::string data(g_magic, sizeof(g_magic));
+    put16(data, OBJECT_VERSION);
+    put16(data, u.f_program.f_size);
+    put16(data, u.f_program.f_labels.size());
+    put16(data, u.f_references.size());
+    put32(data, source.size());
+    for(int idx(0); idx < u.f_program.f_size; ++idx)
+    {
+        put16(data, u.f_program.f_cells[idx]);
+    }
+    for(auto const & l : u.f_program.f_labels)
+    {
+        if(l.first.length() > 255)
+        {
+            return;
+        }
+        put16(data, l.second);
+        put8(data, l.first.length());
+        data += l.first;
+    }
+    for(auto const & ref : u.f_references)
+    {
+        if(ref.f_label.length() > 255)
+        {
+            return;
+        }
+        put16(data, ref.f_cell);
+        put8(data, ref.f_local ? 1 : 0);
+        put32(data, ref.f_line);
+        put8(data, ref.f_label.length());
+        data += ref.f_label;
+    }
+    data += source;
+
+    std::string const tmp(filename + ".tmp" + std::to_string(getpid()) + "-" + std::to_string(unit));
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        if(!out.write(data.data(), data.size()))
+        {
+            out.close();
+            unlink(tmp.c_str());
+            return;
+        }
+    }
+    if(rename(tmp.c_str(), filename.c_str()) != 0)
+    {
+        unlink(tmp.c_str());
+    }
+}
+
+
+bool read_source(std::string const & filename, std::string & source)
+{
+    std::ifstream in(filename, std::ios::binary);
+    if(!in.is_open())
+    {
+        std::cerr << "error: could not open \"" << filename
+            << "\" for reading.\n";
+        return false;
+    }
+    source.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    return true;
+}
+
+
+
+} // no name namespace
+
+
+
+// the units are loaded one after the other, in order; the program starts
+// with the first cell of the first unit
+//
+bool link(std::vector<object_unit> const & units, program & p, std::size_t max_errors)
+{
+    p = program();
+    std::vector<int> base(units.size());
+    int size(0);
+    for(std::size_t idx(0); idx < units.size(); ++idx)
+    {
+        base[idx] = size;
+        size += units[idx].f_program.f_size;
+    }
+    if(size > static_cast<int>(MEMORY_SIZE))
+    {
+        std::cerr << "error: program too long; the " << units.size()
+            << " files use " << size << " cells, the limit is "
+            << MEMORY_SIZE << ".\n";
+        return false;
+    }
+
+    // the unit defining each label, -1 if several do
+    //
+    std::unordered_map<std::string, int> owner;
+    for(std::size_t idx(0); idx < units.size(); ++idx)
+    {
+        program const & u(units[idx].f_program);
+        std::copy(u.f_cells, u.f_cells + u.f_size, p.f_cells + base[idx]);
+        for(auto const & l : u.f_labels)
+        {
+            auto const r(owner.emplace(l.first, idx));
+            if(!r.second)
+            {
+                r.first->second = -1;
+            }
+            p.f_labels.emplace(l.first, l.second + base[idx]);
+        }
+    }
+    p.f_size = size;
+
+    std::size_t errcount(0);
+    for(std::size_t idx(0); idx < units.size(); ++idx)
+    {
+        for(auto const & ref : units[idx].f_references)
+        {
+            if(max_errors != 0
+            && errcount >= max_errors)
+            {
+                std::cerr << "found " << errcount << " errors, stopped.\n";
+                return false;
+            }
+            short & cell(p.f_cells[base[idx] + ref.f_cell]);
+            if(ref.f_local)
+            {
+                cell += base[idx];
+                continue;
+            }
+            auto const it(owner.find(ref.f_label));
+            if(it == owner.end())
+            {
+                std::cerr << "error:" << units[idx].f_filename << ":" << ref.f_line
+                    << ": label \"" << ref.f_label << "\" was not found.\n";
+                ++errcount;
+            }
+            else if(it->second == -1)
+            {
+                std::cerr << "error:" << units[idx].f_filename << ":" << ref.f_line
+                    << ": label \"" << ref.f_label << "\" is defined in more than one file.\n";
+                ++errcount;
+            }
+            else
+            {
+                cell += base[it->second] + units[it->second].f_program.f_labels.at(ref.f_label);
+            }
+        }
+    }
+    return errcount == 0;
+}
+
+
+// each file is assembled on its own thread (or found in the cache when
+// not empty), then the units get linked; the errors are printed in the
+// order of the files
+//
+bool assemble_files(std::vector<std::string> const & filenames, program & p, std::string const & cache, int threads, std::size_t max_errors)
+{
+    std::size_t const count(filenames.size());
+    std::vector<std::string> sources(count);
+    for(std::size_t idx(0); idx < count; ++idx)
+    {
+        if(!read_source(filenames[idx], sources[idx]))
+        {
+            return false;
+        }
+    }
+
+    std::vector<object_unit> units(count);
+    std::vector<diagnostics> errors(count, diagnostics(max_errors));
+    std::atomic<std::size_t> next(0);
+    auto const work = [&]()
+    {
+        for(;;)
+        {
+            std::size_t const idx(next++);
+            if(idx >= count)
+            {
+                return;
+            }
+            units[idx].f_filename = filenames[idx];
+            std::string const name(cache.empty() ? std::string() : object_filename(cache, sources[idx]));
+            if(!cache.empty()
+            && load_object(name, sources[idx], units[idx]))
+            {
+                continue;
+            }
+            if(assemble(sources[idx], units[idx], errors[idx])
+            && !cache.empty())
+            {
+                save_object(name, sources[idx], units[idx], idx);
+            }
+        }
+    };
+
+    if(threads <= 0)
+    {
+        threads = std::max(1U, std::thread::hardware_concurrency());
+    }
+    std::size_t const workers(std::min(static_cast<std::size_t>(threads), count));
+    std::vector<std::thread> pool;
+    for(std::size_t idx(1); idx < workers; ++idx)
+    {
+        pool.emplace_back(work);
+    }
+    work();
+    for(auto & t : pool)
+    {
+        t.join();
+    }
+
+    int errcount(0);
+    for(std::size_t idx(0); idx < count; ++idx)
+    {
+        errors[idx].print(std::cerr, filenames[idx]);
+        errcount += errors[idx].error_count();
+    }
+    if(errcount != 0)
+    {
+        return false;
+    }
+    return link(units, p, max_errors);
+}
+
+
+
+} // namespace lmc
+// vim: ts=4 sw=4 et
@@ -0,0 +1,89 @@
+// Written by Alexis Wilke based on
+// https://en.wikipedia.org/wiki/Little_man_computer
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Source: 
+// https://github.com/AlexisWilke/little-man-computer
+
+
+#pragma once
+
+#include    "program.h"
+
+#include    <vector>
+
+
+namespace lmc
+{
+
+
+
+// a cell of a unit which uses a label: a local label is defined in the
+// same unit, the others are looked for in the other units of the program;
+// f_line is the line of the source where the label was used
+//
+struct reference
+{
+    int                 f_cell = 0;
+    bool                f_local = false;
+    std::string         f_label = std::string();
+    int                 f_line = 0;
+};
+
+
+// A program can be written in several files, each assembled on its own
+// as an object unit: its cells (as if loaded at address 0), its labels
+// and the references to labels which the linker has to patch once it
+// knows where each unit gets loaded. A label of a unit hides the labels
+// with the same name in other units, so each file has its own LOOP, END,
+// etc. and only the labels it does not define come from other units.
+//
+struct object_unit
+{
+    std::string         f_filename = std::string();
+    program             f_program = program();
+    std::vector<reference>
+                        f_references = {};
+};
+
+
+// The cache saves each unit in <directory>/<hash>.lmco where the hash is
+// the 64 bit FNV-1a of the source so a file which did not change is not
+// assembled again; the object ends with a copy of the source which has to
+// match exactly for the object to be used (the hash may collide); all
+// numbers are little endian:
+//
+//     offset  size  field
+//          0     4  magic "LMCO"
+//          4     2  version (3)
+//          6     2  number of cells (n)
+//          8     2  number of labels (l)
+//         10     2  number of references (r)
+//         12     4  size of the source in bytes
+//         16   2*n  the cells
+//          -     -  l labels: address (2), length (1), name
+//          -     -  r references: cell (2), flags (1, bit 0: local),
+//                   line (4), length (1), name
+//          -     -  the source
+//
+// Both functions stop after max_errors errors (0 = no limit).
+//
+bool        link(std::vector<object_unit> const & units, program & p, std::size_t max_errors = 0);
+bool        assemble_files(std::vector<std::string> const & filenames, program & p, std::string const & cache, int threads, std::size_t max_errors = 0);
+
+
+
+} // namespace lmc
+// vim: ts=4 sw=4 et
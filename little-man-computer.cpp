@@ -18,559 +18,557 @@
 // https://github.com/AlexisWilke/little-man-computer
 
 
+#include    "analysis.h"
+#include    "batch.h"
+#include    "cache.h"
+#include    "debugger.h"
+#include    "explore.h"
+#include    "extended.h"
+#include    "image.h"
+#include    "linker.h"
+#include    "metrics.h"
+#include    "offload.h"
+#include    "optimize.h"
+#include    "parser.h"
+#include    "server.h"
+#include    "transpile.h"
+
+#include    <algorithm>
+#include    <cerrno>
+#include    <chrono>
 #include    <cstring>
-#include    <fstream>
 #include    <iomanip>
 #include    <iostream>
-#include    <map>
+#include    <memory>
 #include    <string>
 #include    <vector>
 
-
-typedef int mnemonic_t;
-
-constexpr mnemonic_t    MNEMONIC_NONE = -1;
-constexpr mnemonic_t    MNEMONIC_HLT = 0;
-constexpr mnemonic_t    MNEMONIC_ADD = 1;
-constexpr mnemonic_t    MNEMONIC_SUB = 2;
-constexpr mnemonic_t    MNEMONIC_STA = 3;
-constexpr mnemonic_t    MNEMONIC_LDA = 4;
-constexpr mnemonic_t    MNEMONIC_BRA = 5;
-constexpr mnemonic_t    MNEMONIC_BRZ = 6;
-constexpr mnemonic_t    MNEMONIC_BRP = 7;
-constexpr mnemonic_t    MNEMONIC_INP = 8;
-constexpr mnemonic_t    MNEMONIC_OUT = 9;
-constexpr mnemonic_t    MNEMONIC_DAT = 10;
+#include    <sys/stat.h>
+#include    <unistd.h>
 
 
 std::string g_progname;
-int g_pc = 0;
-short g_program[100] = {};
 
 
-bool is_comment(char c)
+void usage()
 {
-    return c == '#' || c == '/' || c == ';';
+    std::cout << "Usage: " << g_progname << " [-opts] <file.lmc ... | file.lmcb>\n"
+        << "where -opts is one or more of:\n"
+        << "   -b <inputs> run the program once per line of numbers found in <inputs>\n"
+        << "   -c <file>   translate the program to C++ in <file> and exit\n"
+        << "   -e <engine> select the execution engine: switch (default), threaded,\n"
+        << "               fused, jit, simd (-b only, runs 8 jobs in lock-step) or gpu\n"
+        << "               (-b only, runs the jobs with OpenCL, see LMC_OPENCL)\n"
+        << "   -h          print out this help screen\n"
+        << "   -i          interactive mode: prompt for each INP (default when stdin is a TTY)\n"
+        << "   -j <count>  threads used by -b, --explore and --serve (default: one per CPU)\n"
+        << "   -n          non-interactive mode: no prompt, buffered I/O (default otherwise)\n"
+        << "   -o <image>  save the assembled program in a binary image and exit\n"
+        << "   -O          optimize the program: run what comes before the first INP,\n"
+        << "               remove unreachable cells and LDA of the cell just stored\n"
+        << "   -p          print an execution profile of each mailbox once the program stops\n"
+        << "   -s          show the assembled program, which cells are code or data and\n"
+        << "               its basic blocks instead of running it\n"
+        << "   -t          print the number of instructions executed and the time it took\n"
+        << "   --cache <directory>\n"
+        << "               with -b, reuse the results of jobs already run with the same\n"
+        << "               program and inputs (--cache= only skips repeats in the batch)\n"
+        << "   --checkpoint <file>\n"
+        << "               save the machine state in <file> once it stops; run the\n"
+        << "               file to resume from that point\n"
+        << "   --debug[=<interval>]\n"
+        << "               step through the program forward and back; the commands and the\n"
+        << "               INP values are read from stdin (see debugger.h), a checkpoint is\n"
+        << "               kept every <interval> instructions (default: 1000)\n"
+        << "   --explore <depth>\n"
+        << "               run the program with every value (0 to 999) for each of the\n"
+        << "               first <depth> INP and print the outputs of each input vector,\n"
+        << "               or the first input which hits --max-steps or --timeout\n"
+        << "   --explore-range <min>:<max>\n"
+        << "               the values given to INP by --explore (default: 0:999)\n"
+        << "   --memory <size>\n"
+        << "               run the program on a computer with that many mailboxes (100,\n"
+        << "               1000, 10000 or 100000); the addresses and cells get wider\n"
+        << "   --max-errors <count>\n"
+        << "               stop assembling after that many errors (default: no limit)\n"
+        << "   --max-steps <count>\n"
+        << "               stop the program (exit code 2) after about that many instructions\n"
+        << "   --metrics <file>\n"
+        << "               with -b or --serve, write the counters (jobs, instructions, cache\n"
+        << "               hits...) to <file> every second in the Prometheus text format\n"
+        << "   --objects <directory>\n"
+        << "               keep the assembled files in <directory> so only the files\n"
+        << "               which changed get assembled again\n"
+        << "   --serve <socket | ->\n"
+        << "               assemble and run the programs sent to the Unix <socket> (or\n"
+        << "               stdin with -) instead of a file; see server.h for the protocol\n"
+        << "   --timeout <seconds>\n"
+        << "               stop the program (exit code 3) after that much time\n"
+        << "   --trace <file>\n"
+        << "               record each instruction executed in <file> (see lmc-trace);\n"
+        << "               uses the switch engine\n";
 }
 
-
-std::vector<std::string> split(std::string const & input)
+// options which expect a value accept it glued to the letter (-ethreaded)
+// or as the next argument (-e threaded)
+//
+char const * option_value(int argc, char * argv[], int & i, size_t & j, size_t max)
 {
-    std::vector<std::string> words;
-    char const * s(input.c_str());
-    for(;;)
+    char const * value(argv[i] + j + 1);
+    if(*value == '\0')
     {
-        while(*s != '\0' && isspace(*s))
+        if(i + 1 >= argc)
         {
-            ++s;
+            std::cerr << "error: -" << argv[i][j] << " expects a value.\n";
+            return nullptr;
         }
-        if(*s == '\0' || is_comment(*s))
-        {
-            return words;
-        }
-        char const * w(s);
-        while(*s != '\0' && !isspace(*s) && !is_comment(*s))
-        {
-            ++s;
-        }
-        words.push_back(std::string(w, s - w));
+        ++i;
+        value = argv[i];
     }
+    j = max;
+    return value;
 }
 
 
-mnemonic_t is_mnemonic(std::string const & word)
+void print_timing(std::uint64_t steps, std::chrono::steady_clock::time_point start)
 {
-    std::string w;
-    for(auto const & c : word)
-    {
-        if(c >= 'a' && c <= 'z')
-        {
-            w += c - 0x20;
-        }
-        else
-        {
-            w += c;
-        }
-    }
-    if(w == "HLT")
-    {
-        return MNEMONIC_HLT;
-    }
-    if(w == "ADD")
-    {
-        return MNEMONIC_ADD;
-    }
-    if(w == "SUB")
-    {
-        return MNEMONIC_SUB;
-    }
-    if(w == "STA")
+    std::chrono::duration<double, std::nano> const duration(std::chrono::steady_clock::now() - start);
+    std::cerr << "instructions: " << steps
+        << ", time: " << std::fixed << std::setprecision(3) << duration.count() / 1.0e6
+        << " ms";
+    if(steps != 0)
     {
-        return MNEMONIC_STA;
+        std::cerr << ", " << std::setprecision(2) << duration.count() / steps
+            << " ns/instruction";
     }
-    if(w == "LDA")
-    {
-        return MNEMONIC_LDA;
-    }
-    if(w == "BRA")
-    {
-        return MNEMONIC_BRA;
-    }
-    if(w == "BRZ")
+    std::cerr << "\n";
+}
+
+
+// the exit code of the process once the machine stopped
+//
+template<typename M>
+int stop_status(lmc::status_t status, M const & m)
+{
+    switch(status)
     {
-        return MNEMONIC_BRZ;
+    case lmc::STATUS_NO_INPUT:
+        std::cerr << "\nerror: no more input available (PC: "
+            << m.pc()
+            << ").\n";
+        return 1;
+
+    case lmc::STATUS_STEP_LIMIT:
+    case lmc::STATUS_TIMEOUT:
+        std::cerr << "\nerror: "
+            << (status == lmc::STATUS_STEP_LIMIT ? "step limit" : "timeout")
+            << " reached after " << m.steps()
+            << " instructions (PC: " << m.pc()
+            << ", ACC: " << m.acc()
+            << ", overflow: " << (m.overflow() ? "yes" : "no")
+            << ").\n";
+        return status == lmc::STATUS_STEP_LIMIT ? 2 : 3;
+
     }
-    if(w == "BRP")
+
+    return 0;
+}
+
+
+std::unique_ptr<lmc::input> create_input(int interactive)
+{
+    if(interactive == 1)
     {
-        return MNEMONIC_BRP;
+        return std::make_unique<lmc::stream_input>(std::cin, &std::cout);
     }
-    if(w == "INP")
+    return std::make_unique<lmc::fd_input>(STDIN_FILENO);
+}
+
+
+std::unique_ptr<lmc::output> create_output(int interactive)
+{
+    if(interactive == 1)
     {
-        return MNEMONIC_INP;
+        return std::make_unique<lmc::stream_output>(std::cout);
     }
-    if(w == "OUT")
+    return std::make_unique<lmc::fd_output>(STDOUT_FILENO);
+}
+
+
+// --memory: the extended machine only runs source files, with its own
+// engine
+//
+int run_extended(std::string const & filename, std::size_t memory_size, std::size_t max_errors, int interactive, bool timing, lmc::limits const & limits)
+{
+    lmc::extended_program p;
+    p.f_memory_size = memory_size;
+    if(!lmc::parse(filename, p, max_errors))
     {
-        return MNEMONIC_OUT;
+        return 1;
     }
-    if(w == "DAT")
+    std::unique_ptr<lmc::input> in(create_input(interactive));
+    std::unique_ptr<lmc::output> out(create_output(interactive));
+    lmc::extended_machine m(p, *in, *out);
+    m.set_limits(limits);
+    auto const start(std::chrono::steady_clock::now());
+    lmc::status_t const status(m.run());
+    out->flush();
+    if(timing)
     {
-        return MNEMONIC_DAT;
+        print_timing(m.steps(), start);
     }
-
-    return MNEMONIC_NONE;
+    return stop_status(status, m);
 }
 
 
-bool parse(std::string const & filename)
+int main(int argc, char * argv[])
 {
-    std::ifstream in;
-    in.open(filename);
-    if(!in.is_open())
+    g_progname = argv[0];
+    std::string::size_type const pos(g_progname.rfind('/'));
+    if(pos != std::string::npos)
     {
-        std::cerr << "error: could not open \"" << filename
-            << "\" for reading.\n";
-        return false;
+        g_progname = g_progname.substr(pos + 1);
     }
-
-    int errcount(0);
-    int line(0);
-    std::map<std::string, int> label_pc;
-    std::map<int, std::string> label_ref;
-    std::string input;
-    while(std::getline(in, input))
+    bool show(false);
+    bool timing(false);
+    bool profiling(false);
+    bool optimizing(false);
+    std::string batch;
+    std::string image;
+    std::string cpp;
+    std::string cache;
+    bool use_cache(false);
+    std::string checkpoint;
+    std::string trace;
+    std::string serve;
+    bool use_serve(false);
+    std::size_t memory_size(0);
+    std::size_t max_errors(0);
+    std::string objects;
+    std::string metrics;
+    lmc::explore_options explore;
+    bool use_explore(false);
+    std::uint64_t debug_interval(0);
+    int threads(0);
+    int interactive(-1);
+    lmc::limits limits;
+    lmc::engine_t engine(lmc::ENGINE_SWITCH);
+    std::vector<std::string> filenames;
+    for(int i(1); i < argc; ++i)
     {
-        ++line;
-        std::vector<std::string> words(split(input));
-        if(words.empty())
-        {
-            continue;
-        }
-
-        std::string parameter;
-        mnemonic_t instruction(is_mnemonic(words[0]));
-        if(instruction != MNEMONIC_NONE)
+        if(argv[i][0] == '-' && argv[i][1] == '-')
         {
-            if(words.size() > 2)
-            {
-                ++errcount;
-                std::cerr << "error:" << filename << ":" << line
-                    << ": more than two words on the line is not legal.\n";
-                continue;
-            }
-
-            // no label
+            // long options: --name value or --name=value
             //
-            if(words.size() == 2)
-            {
-                parameter = words[1];
-            }
-        }
-        else if(words.size() < 2)
-        {
-            ++errcount;
-            std::cerr << "error:" << filename << ":" << line
-                << ": a word by itself, which is not a mnemonic, is not legal.\n";
-            continue;
-        }
-        else
-        {
-            instruction = is_mnemonic(words[1]);
-            if(instruction == MNEMONIC_NONE)
-            {
-                ++errcount;
-                std::cerr << "error: " << filename << ":" << line
-                    << ": a label must be followed by a mnemonic.\n";
-                continue;
-            }
-
-            // we have a label -- save its position
-            //
-            label_pc[words[0]] = g_pc;
-
-            if(words.size() == 3)
-            {
-                parameter = words[2];
-            }
-            else if(words.size() > 3)
-            {
-                ++errcount;
-                std::cerr << "error:" << filename << ":" << line
-                    << ": a mnemonic can be followed by at most one parameter.\n";
-                continue;
-            }
-        }
-
-        if(g_pc >= std::size(g_program))
-        {
-            std::cerr << "error:" << filename << ":" << line
-                << ": program too long; limit is 1000 instructions/data.\n";
-            continue;
-        }
-
-        switch(instruction)
-        {
-        case MNEMONIC_NONE:
-            throw std::logic_error("instruction still undefined.");
-
-        case MNEMONIC_HLT:
-            if(!parameter.empty())
-            {
-                ++errcount;
-                std::cerr << "error:" << filename << ":" << line
-                    << ": the HTL instruction does not accept a parameter.\n";
-            }
-            else
-            {
-                g_program[g_pc] = 0;
-                ++g_pc;
-            }
-            break;
-
-        case MNEMONIC_ADD:
-            if(parameter.empty())
-            {
-                ++errcount;
-                std::cerr << "error:" << filename << ":" << line
-                    << ": the ADD instruction requires a parameter (label reference).\n";
-            }
-            else
-            {
-                g_program[g_pc] = 100;
-                label_ref[g_pc] = parameter;
-                ++g_pc;
-            }
-            break;
-
-        case MNEMONIC_SUB:
-            if(parameter.empty())
+            std::string name(argv[i] + 2);
+            char const * value(nullptr);
+            std::string::size_type const equal(name.find('='));
+            if(equal != std::string::npos)
             {
-                ++errcount;
-                std::cerr << "error:" << filename << ":" << line
-                    << ": the SUB instruction requires a parameter (label reference).\n";
+                value = argv[i] + 2 + equal + 1;
+                name = name.substr(0, equal);
             }
-            else
+            auto const need_value = [&]()
             {
-                g_program[g_pc] = 200;
-                label_ref[g_pc] = parameter;
-                ++g_pc;
-            }
-            break;
-
-        case MNEMONIC_STA:
-            if(parameter.empty())
-            {
-                ++errcount;
-                std::cerr << "error:" << filename << ":" << line
-                    << ": the STA instruction requires a parameter (label reference).\n";
-            }
-            else
-            {
-                g_program[g_pc] = 300;
-                label_ref[g_pc] = parameter;
-                ++g_pc;
-            }
-            break;
-
-        case MNEMONIC_LDA:
-            if(parameter.empty())
-            {
-                ++errcount;
-                std::cerr << "error:" << filename << ":" << line
-                    << ": the LDA instruction requires a parameter (label reference).\n";
-            }
-            else
-            {
-                g_program[g_pc] = 400;
-                label_ref[g_pc] = parameter;
-                ++g_pc;
-            }
-            break;
-
-        case MNEMONIC_BRA:
-            if(parameter.empty())
+                if(value == nullptr)
+                {
+                    if(i + 1 >= argc)
+                    {
+                        std::cerr << "error: --" << name << " expects a value.\n";
+                        return false;
+                    }
+                    ++i;
+                    value = argv[i];
+                }
+                return true;
+            };
+            if(name == "cache")
             {
-                ++errcount;
-                std::cerr << "error:" << filename << ":" << line
-                    << ": the BRA instruction requires a parameter (label reference).\n";
+                if(!need_value())
+                {
+                    return 1;
+                }
+                cache = value;
+                use_cache = true;
             }
-            else
+            else if(name == "checkpoint")
             {
-                g_program[g_pc] = 500;
-                label_ref[g_pc] = parameter;
-                ++g_pc;
+                if(!need_value())
+                {
+                    return 1;
+                }
+                checkpoint = value;
             }
-            break;
-
-        case MNEMONIC_BRZ:
-            if(parameter.empty())
+            else if(name == "debug")
             {
-                ++errcount;
-                std::cerr << "error:" << filename << ":" << line
-                    << ": the BRZ instruction requires a parameter (label reference).\n";
+                // the value is optional so it has to be given as --debug=<interval>
+                //
+                debug_interval = 1000;
+                if(value != nullptr)
+                {
+                    char * end(nullptr);
+                    debug_interval = strtoull(value, &end, 10);
+                    if(*value == '\0' || *end != '\0' || debug_interval == 0)
+                    {
+                        std::cerr << "error: --debug expects a positive number of instructions between checkpoints.\n";
+                        return 1;
+                    }
+                }
             }
-            else
+            else if(name == "explore")
             {
-                g_program[g_pc] = 600;
-                label_ref[g_pc] = parameter;
-                ++g_pc;
+                if(!need_value())
+                {
+                    return 1;
+                }
+                char * end(nullptr);
+                long const depth(strtol(value, &end, 10));
+                if(*value == '\0' || *end != '\0' || depth <= 0 || depth > 1000)
+                {
+                    std::cerr << "error: --explore expects a depth from 1 to 1000.\n";
+                    return 1;
+                }
+                explore.f_depth = depth;
+                use_explore = true;
             }
-            break;
-
-        case MNEMONIC_BRP:
-            if(parameter.empty())
+            else if(name == "explore-range")
             {
-                ++errcount;
-                std::cerr << "error:" << filename << ":" << line
-                    << ": the BRP instruction requires a parameter (label reference).\n";
+                if(!need_value())
+                {
+                    return 1;
+                }
+                char * end(nullptr);
+                long const min(strtol(value, &end, 10));
+                long max(-1);
+                if(end != value && *end == ':')
+                {
+                    char const * const second(end + 1);
+                    max = strtol(second, &end, 10);
+                    if(end == second)
+                    {
+                        max = -1;
+                    }
+                }
+                if(*end != '\0' || min < 0 || max < min || max > 999)
+                {
+                    std::cerr << "error: --explore-range expects <min>:<max> with 0 <= min <= max <= 999.\n";
+                    return 1;
+                }
+                explore.f_min = min;
+                explore.f_max = max;
             }
-            else
+            else if(name == "max-errors")
             {
-                g_program[g_pc] = 700;
-                label_ref[g_pc] = parameter;
-                ++g_pc;
+                if(!need_value())
+                {
+                    return 1;
+                }
+                char * end(nullptr);
+                max_errors = strtoull(value, &end, 10);
+                if(*value == '\0' || *end != '\0' || max_errors == 0)
+                {
+                    std::cerr << "error: --max-errors expects a positive number of errors.\n";
+                    return 1;
+                }
             }
-            break;
-
-        case MNEMONIC_INP:
-            if(!parameter.empty())
+            else if(name == "max-steps")
             {
-                ++errcount;
-                std::cerr << "error:" << filename << ":" << line
-                    << ": the INP instruction does not accept a parameter.\n";
+                if(!need_value())
+                {
+                    return 1;
+                }
+                char * end(nullptr);
+                limits.f_max_steps = strtoull(value, &end, 10);
+                if(*value == '\0' || *end != '\0' || limits.f_max_steps == 0)
+                {
+                    std::cerr << "error: --max-steps expects a positive number of instructions.\n";
+                    return 1;
+                }
             }
-            else
+            else if(name == "memory")
             {
-                g_program[g_pc] = 800;
-                ++g_pc;
+                if(!need_value())
+                {
+                    return 1;
+                }
+                char * end(nullptr);
+                memory_size = strtoull(value, &end, 10);
+                if(*value == '\0' || *end != '\0' || !lmc::is_memory_size(memory_size))
+                {
+                    std::cerr << "error: --memory expects 100, 1000, 10000 or 100000 mailboxes.\n";
+                    return 1;
+                }
             }
-            break;
-
-        case MNEMONIC_OUT:
-            if(!parameter.empty())
+            else if(name == "metrics")
             {
-                ++errcount;
-                std::cerr << "error:" << filename << ":" << line
-                    << ": the OUT instruction does not accept a parameter.\n";
+                if(!need_value())
+                {
+                    return 1;
+                }
+                metrics = value;
             }
-            else
+            else if(name == "objects")
             {
-                g_program[g_pc] = 900;
-                ++g_pc;
+                if(!need_value())
+                {
+                    return 1;
+                }
+                objects = value;
             }
-            break;
-
-        case MNEMONIC_DAT:
-            if(parameter.empty())
+            else if(name == "serve")
             {
-                g_program[g_pc] = 0;
-                ++g_pc;
+                if(!need_value())
+                {
+                    return 1;
+                }
+                serve = value;
+                use_serve = true;
             }
-            else
+            else if(name == "timeout")
             {
-                int const value(atoi(parameter.c_str()));
-                if(value > 999)
+                if(!need_value())
                 {
-                    std::cerr << "error:" << filename << ":" << line
-                        << ": DAT supports numbers between 0 and 999.\n";
+                    return 1;
                 }
-                else
+                char * end(nullptr);
+                double const seconds(strtod(value, &end));
+                if(*value == '\0' || *end != '\0' || seconds <= 0.0)
                 {
-                    g_program[g_pc] = value;
-                    ++g_pc;
+                    std::cerr << "error: --timeout expects a positive number of seconds.\n";
+                    return 1;
                 }
+                limits.f_timeout = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                        std::chrono::duration<double>(seconds));
             }
-            break;
-
-        }
-    }
-
-    // second pass to enter the label positions
-    //
-    for(auto const & l : label_ref)
-    {
-        int number(0);
-        for(auto const & c : l.second)
-        {
-            if(c >= '0' && c <= '9')
+            else if(name == "trace")
             {
-                number = number * 10 + c - '0';
+                if(!need_value())
+                {
+                    return 1;
+                }
+                trace = value;
             }
-            else
+            else if(name == "help")
             {
-                number = -1;
-                break;
+                usage();
+                return 1;
             }
-        }
-        if(number != -1)
-        {
-            if(number > 999)
+            else
             {
-                ++errcount;
-                std::cerr << "error:" << filename << ":" << line
-                    << ": label \"" << l.second
-                    << "\" is too large a number.\n";
-                continue;
+                std::cerr << "error: unknown command line option \"--"
+                    << name
+                    << "\". Try -h for help.\n";
+                return 1;
             }
-            g_program[l.first] += number;
         }
-        else
+        else if(argv[i][0] == '-')
         {
-            auto const f(label_pc.find(l.second));
-            if(f == label_pc.end())
-            {
-                ++errcount;
-                std::cerr << "error:" << filename << ":" << line
-                    << ": label \"" << l.second
-                    << "\" was not found.\n";
-                continue;
-            }
-            if(f->second > 99)
+            size_t const max(strlen(argv[i]));
+            for(size_t j(1); j < max; ++j)
             {
-                ++errcount;
-                std::cerr << "error:" << filename << ":" << line
-                    << ": offset of label \"" << l.second
-                    << "\" is too large (" << f->second
-                    << ").\n";
-            }
-            g_program[l.first] += f->second;
-        }
-    }
-
-    if(errcount != 0)
-    {
-        std::cerr << "found " << errcount << " errors.\n";
-        return false;
-    }
-
-    return true;
-}
-
+                switch(argv[i][j])
+                {
+                case 'b':
+                    {
+                        char const * name(option_value(argc, argv, i, j, max));
+                        if(name == nullptr)
+                        {
+                            return 1;
+                        }
+                        batch = name;
+                    }
+                    break;
 
-void execute()
-{
-    g_pc = 0;
-    int acc(0);
-    bool overflow(false);
+                case 'c':
+                    {
+                        char const * name(option_value(argc, argv, i, j, max));
+                        if(name == nullptr)
+                        {
+                            return 1;
+                        }
+                        cpp = name;
+                    }
+                    break;
 
-    for(;;)
-    {
-        int const instruction(g_program[g_pc] / 100);
-        int const loc(g_program[g_pc] % 100);
-        ++g_pc;
-        switch(instruction)
-        {
-        case MNEMONIC_HLT:
-            // done
-            return;
-
-        case MNEMONIC_ADD:
-            overflow = acc + g_program[loc] > 999;
-            acc = (acc + g_program[loc]) % 1000;
-            break;
-
-        case MNEMONIC_SUB:
-            overflow = acc < g_program[loc];
-            acc = (acc - g_program[loc]) % 1000;
-            break;
-
-        case MNEMONIC_STA:
-            g_program[loc] = acc;
-            break;
-
-        case MNEMONIC_LDA:
-            acc = g_program[loc];
-            break;
-
-        case MNEMONIC_BRA:
-            g_pc = loc;
-            break;
-
-        case MNEMONIC_BRZ:
-            if(acc == 0)
-            {
-                g_pc = loc;
-            }
-            break;
+                case 'e':
+                    {
+                        char const * name(option_value(argc, argv, i, j, max));
+                        if(name == nullptr)
+                        {
+                            return 1;
+                        }
+                        engine = lmc::engine_by_name(name);
+                        if(engine == lmc::ENGINE_NONE)
+                        {
+                            std::cerr << "error: unknown engine \""
+                                << name
+                                << "\". Try -h for help.\n";
+                            return 1;
+                        }
+                        if(engine == lmc::ENGINE_GPU
+                        && !lmc::offload_supported())
+                        {
+                            std::cerr << "error: this build does not support the gpu engine (see LMC_OPENCL in CMakeLists.txt).\n";
+                            return 1;
+                        }
+                    }
+                    break;
 
-        case MNEMONIC_BRP:
-            if(!overflow)
-            {
-                g_pc = loc;
-            }
-            break;
+                case 'h':
+                    usage();
+                    return 1;
 
-        case MNEMONIC_INP:
-            std::cout << "lmc> " << std::flush;
-            {
-                int value;
-                std::cin >> value;
-                acc = value % 1000;
-            }
-            break;
+                case 'i':
+                    interactive = 1;
+                    break;
 
-        case MNEMONIC_OUT:
-            std::cout << acc << "\n";
-            break;
+                case 'j':
+                    {
+                        char const * count(option_value(argc, argv, i, j, max));
+                        if(count == nullptr)
+                        {
+                            return 1;
+                        }
+                        threads = atoi(count);
+                        if(threads <= 0)
+                        {
+                            std::cerr << "error: -j expects a positive number of threads.\n";
+                            return 1;
+                        }
+                    }
+                    break;
 
-        }
-    }
-}
+                case 'n':
+                    interactive = 0;
+                    break;
 
+                case 'o':
+                    {
+                        char const * name(option_value(argc, argv, i, j, max));
+                        if(name == nullptr)
+                        {
+                            return 1;
+                        }
+                        image = name;
+                    }
+                    break;
 
-void usage()
-{
-    std::cout << "Usage: " << g_progname << " [-opts] <file.lmc>\n"
-        << "where -opts is one or more of:\n"
-        << "   -h          print out this help screen\n";
-}
+                case 'O':
+                    optimizing = true;
+                    break;
 
-int main(int argc, char * argv[])
-{
-    g_progname = argv[0];
-    std::string::size_type const pos(g_progname.rfind('/'));
-    if(pos != std::string::npos)
-    {
-        g_progname = g_progname.substr(pos + 1);
-    }
-    bool show(false);
-    std::string filename;
-    for(int i(1); i < argc; ++i)
-    {
-        if(argv[i][0] == '-')
-        {
-            size_t const max(strlen(argv[i]));
-            for(size_t j(1); j < max; ++j)
-            {
-                switch(argv[i][j])
-                {
-                case 'h':
-                    usage();
-                    return 1;
+                case 'p':
+                    profiling = true;
+                    break;
 
                 case 's':
                     show = true;
                     break;
 
+                case 't':
+                    timing = true;
+                    break;
+
                 default:
                     std::cerr << "error: unknown command line option '"
                         << argv[i][j]
@@ -580,40 +578,278 @@ int main(int argc, char * argv[])
                 }
             }
         }
-        else if(filename.empty())
+        else
         {
-            filename = argv[i];
+            filenames.push_back(argv[i]);
         }
-        else
+    }
+
+    if(use_serve)
+    {
+        if(!filenames.empty())
         {
-            std::cerr << "error: enter no more than one filename.\n";
+            std::cerr << "error: --serve does not expect a filename.\n";
             return 1;
         }
+        lmc::metrics stats;
+        if(!metrics.empty())
+        {
+            stats.start_dump(metrics);
+        }
+        return lmc::serve(serve == "-" ? std::string() : serve, engine, limits, threads, &stats);
     }
 
-    if(filename.empty())
+    if(filenames.empty())
     {
         std::cerr << "error: filename missing.\n";
         return 1;
     }
+    if(!metrics.empty()
+    && batch.empty())
+    {
+        std::cerr << "error: --metrics can only be used with -b or --serve.\n";
+        return 1;
+    }
+    std::string const & filename(filenames[0]);
+    if(filenames.size() > 1
+    && std::any_of(filenames.begin(), filenames.end(), lmc::is_image))
+    {
+        std::cerr << "error: an image can't be linked with other files; enter it by itself.\n";
+        return 1;
+    }
+
+    if(interactive == -1)
+    {
+        interactive = isatty(STDIN_FILENO) ? 1 : 0;
+    }
 
-    if(!parse(filename))
+    if(memory_size != 0)
+    {
+        if(!batch.empty()
+        || !image.empty()
+        || !cpp.empty()
+        || !checkpoint.empty()
+        || !trace.empty()
+        || show
+        || profiling
+        || use_cache
+        || use_explore
+        || debug_interval != 0
+        || optimizing
+        || engine != lmc::ENGINE_SWITCH
+        || filenames.size() > 1
+        || !objects.empty()
+        || lmc::is_image(filename))
+        {
+            std::cerr << "error: --memory only runs one source file and can only be used with -i, -n, -t,"
+                " --max-steps and --timeout.\n";
+            return 1;
+        }
+        return run_extended(filename, memory_size, max_errors, interactive, timing, limits);
+    }
+
+    // a snapshot resumes where the machine stopped, a program starts at 0
+    //
+    lmc::snapshot state;
+    if(lmc::is_image(filename))
+    {
+        if(!lmc::load_snapshot(filename, state))
+        {
+            return 1;
+        }
+    }
+    else if(filenames.size() > 1
+         || !objects.empty())
+    {
+        if(!objects.empty()
+        && mkdir(objects.c_str(), 0777) != 0
+        && errno != EEXIST)
+        {
+            std::cerr << "error: could not create objects directory \""
+                << objects << "\".\n";
+            return 1;
+        }
+        if(!lmc::assemble_files(filenames, state.f_program, objects, threads, max_errors))
+        {
+            return 1;
+        }
+    }
+    else if(!lmc::parse(filename, state.f_program, max_errors))
     {
         return 1;
     }
+    lmc::program const & p(state.f_program);
+
+    // the C++ translation starts at 0 so nothing can be folded
+    //
+    lmc::optimize_report report;
+    if(optimizing)
+    {
+        lmc::optimize(state, cpp.empty(), report);
+        lmc::print_report(report, std::cerr);
+    }
+
+    if(!image.empty()
+    || !cpp.empty())
+    {
+        // a folded program starts where the folding stopped
+        //
+        if(!image.empty()
+        && !(report.f_steps_folded != 0
+                ? lmc::save_snapshot(image, state)
+                : lmc::save_image(image, p)))
+        {
+            return 1;
+        }
+        if(!cpp.empty()
+        && !lmc::transpile(p, cpp))
+        {
+            return 1;
+        }
+        if(!show)
+        {
+            return 0;
+        }
+    }
 
     if(show)
     {
-        for(int pc(0); pc < g_pc; ++pc)
+        lmc::analysis a;
+        lmc::analyze(p.f_cells, a, state.f_pc);
+        lmc::print_analysis(p, a, std::cout);
+        return 0;
+    }
+
+    if(debug_interval != 0)
+    {
+        if(!batch.empty()
+        || !checkpoint.empty()
+        || !trace.empty()
+        || profiling
+        || use_explore)
         {
-            std::cout << std::setw(3) << pc << ":    " << g_program[pc] << "\n";
+            std::cerr << "error: --debug can't be used with -b, -p, --checkpoint, --explore or --trace.\n";
+            return 1;
+        }
+        return lmc::debug(state, std::cin, std::cout, debug_interval);
+    }
+
+    if(use_explore)
+    {
+        if(!batch.empty()
+        || !checkpoint.empty()
+        || !trace.empty()
+        || profiling)
+        {
+            std::cerr << "error: --explore can't be used with -b, -p, --checkpoint or --trace.\n";
+            return 1;
+        }
+        explore.f_engine = engine;
+        explore.f_limits = limits;
+        explore.f_threads = threads;
+        lmc::status_t const status(lmc::explore(state, explore, std::cout));
+        return status == lmc::STATUS_STEP_LIMIT
+                    ? 2
+                    : (status == lmc::STATUS_TIMEOUT ? 3 : 0);
+    }
+
+    if(!batch.empty())
+    {
+        std::vector<lmc::batch_job> jobs;
+        if(!lmc::load_batch(batch, jobs))
+        {
+            return 1;
+        }
+
+        // the last dump happens when `stats` gets destroyed
+        //
+        std::unique_ptr<lmc::metrics> stats;
+        if(!metrics.empty())
+        {
+            stats = std::make_unique<lmc::metrics>();
+            stats->start_dump(metrics);
+        }
+        if(use_cache)
+        {
+            if(!cache.empty()
+            && mkdir(cache.c_str(), 0777) != 0
+            && errno != EEXIST)
+            {
+                std::cerr << "error: could not create cache directory \""
+                    << cache << "\".\n";
+                return 1;
+            }
+            lmc::result_cache results(cache);
+            lmc::run_batch(state, jobs, engine, limits, threads, &results, stats.get());
+            lmc::print_batch(jobs, std::cout);
+            std::cerr << "cache: " << results.hits() << " hits, "
+                << results.misses() << " misses.\n";
+        }
+        else
+        {
+            lmc::run_batch(state, jobs, engine, limits, threads, nullptr, stats.get());
+            lmc::print_batch(jobs, std::cout);
         }
         return 0;
     }
 
-    execute();
+    std::unique_ptr<lmc::input> in(create_input(interactive));
+    std::unique_ptr<lmc::output> out(create_output(interactive));
+    lmc::machine m(p, *in, *out);
+    m.restore(state);
+    m.set_limits(limits);
 
-    return 0;
+    // only allocated when used so a short program starts faster
+    //
+    std::unique_ptr<lmc::profile> prof;
+    if(profiling)
+    {
+        prof = std::make_unique<lmc::profile>();
+        m.set_profile(prof.get());
+    }
+    std::unique_ptr<lmc::trace> t;
+    if(!trace.empty())
+    {
+        t = std::make_unique<lmc::trace>();
+        if(!t->open(trace))
+        {
+            return 1;
+        }
+        m.set_trace(t.get());
+    }
+    auto const start(std::chrono::steady_clock::now());
+    lmc::status_t const status(m.run(engine));
+    if(timing)
+    {
+        print_timing(m.steps(), start);
+    }
+    if(profiling)
+    {
+        prof->print(p, std::cerr);
+    }
+    if(t != nullptr
+    && !t->close())
+    {
+        std::cerr << "error: could not write the trace to \"" << trace << "\".\n";
+        return 1;
+    }
+    if(!checkpoint.empty())
+    {
+        // running out of input is the expected end of a set-up phase
+        //
+        lmc::snapshot s;
+        m.save(s);
+        s.f_program.f_size = p.f_size;
+        if(!lmc::save_snapshot(checkpoint, s))
+        {
+            return 1;
+        }
+        if(status == lmc::STATUS_NO_INPUT)
+        {
+            return 0;
+        }
+    }
+    return stop_status(status, m);
 }
 
 // vim: ts=4 sw=4 et
@@ -0,0 +1,568 @@
+// Written by Alexis Wilke based on
+// https://en.wikipedia.org/wiki/Little_man_computer
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Source: 
+// https://github.com/AlexisWilke/little-man-computer
+
+
+// Differential testing of the engines: generate random 100 cell programs
+// with random inputs, run each one on every engine with a step limit and
+// compare the final state (status, registers, counters and memory) and
+// the OUT stream with the ones of the switch() engine, the reference.
+//
+// Each thread owns one program and one machine per engine which get
+// reset before each run so an iteration does not allocate. Program N of
+// a given seed is always the same so a failure can be reproduced with
+// `-s <seed> -f N -n 1`; the failing programs are also saved as images
+// when -o is used.
+//
+// With -b <jobs>, each program runs instead as a batch of that many random
+// input vectors (see run_batch()) with the lock-step simd engine and with
+// the jit (one machine per thread reused from job to job) and each job
+// gets compared with the same batch run on the switch() engine.
+//
+// Usage: lmc-fuzz [-j <threads>] [-n <count>] [-s <seed>] [-f <first>]
+//                 [-m <max-steps>] [-o <directory>] [-b <jobs>]
+
+
+#include    "batch.h"
+#include    "image.h"
+#include    "machine.h"
+
+#include    <algorithm>
+#include    <atomic>
+#include    <chrono>
+#include    <cstdlib>
+#include    <cstring>
+#include    <iomanip>
+#include    <iostream>
+#include    <mutex>
+#include    <thread>
+#include    <vector>
+
+
+
+namespace
+{
+
+
+
+constexpr std::size_t       MAX_INPUTS = 8;
+constexpr int               MAX_FAILURES = 10;
+
+lmc::engine_t const         g_engines[] =
+{
+    lmc::ENGINE_SWITCH,     // the reference, must be first
+    lmc::ENGINE_THREADED,
+    lmc::ENGINE_FUSED,
+    lmc::ENGINE_JIT,
+};
+
+constexpr std::size_t       ENGINE_COUNT = std::size(g_engines);
+
+// compared with a batch run on the switch() engine
+//
+lmc::engine_t const         g_batch_engines[] =
+{
+    lmc::ENGINE_SIMD,
+    lmc::ENGINE_JIT,
+};
+
+
+// splitmix64: fast and good enough to generate programs
+//
+class random
+{
+public:
+    random(std::uint64_t seed)
+        : f_state(seed)
+    {
+    }
+
+    std::uint64_t next()
+    {
+        std::uint64_t z(f_state += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+    int below(int max)
+    {
+        return static_cast<int>(next() % max);
+    }
+
+private:
+    std::uint64_t       f_state = 0;
+};
+
+
+class fuzz_input
+    : public lmc::input
+{
+public:
+    virtual bool read(int & value) override
+    {
+        if(f_pos >= f_count)
+        {
+            return false;
+        }
+        value = f_values[f_pos];
+        ++f_pos;
+        return true;
+    }
+
+    void reset(int const * values, std::size_t count)
+    {
+        std::copy(values, values + count, f_values);
+        f_count = count;
+        f_pos = 0;
+    }
+
+private:
+    int                 f_values[MAX_INPUTS] = {};
+    std::size_t         f_count = 0;
+    std::size_t         f_pos = 0;
+};
+
+
+// the stream is compared through its length and a hash of the values
+//
+class fuzz_output
+    : public lmc::output
+{
+public:
+    virtual void write(int value) override
+    {
+        f_hash = (f_hash ^ static_cast<std::uint32_t>(value)) * 1099511628211ULL;
+        ++f_count;
+    }
+
+    void reset()
+    {
+        f_hash = 14695981039346656037ULL;
+        f_count = 0;
+    }
+
+    std::uint64_t       f_hash = 14695981039346656037ULL;
+    std::uint64_t       f_count = 0;
+};
+
+
+// mostly valid values, some out of range ones
+//
+int random_input(random & r)
+{
+    return r.below(8) == 0 ? r.below(20000) - 10000 : r.below(1000);
+}
+
+
+// mostly instructions with an address so the programs loop, compute and
+// modify themselves; some data, a few HLT and out of range cells; one
+// program in eight also has cells outside of [-999, 999] (a DAT -1500
+// assembles) which the jit and simd engines do not run natively
+//
+void generate(std::uint64_t seed, std::uint64_t number, lmc::program & p, int * inputs, std::size_t & input_count)
+{
+    random r(seed ^ (number * 0xD1B54A32D192ED03ULL));
+    bool const wide(r.below(8) == 0);
+    for(auto & cell : p.f_cells)
+    {
+        int const kind(r.below(20));
+        if(kind < 14)
+        {
+            cell = (1 + r.below(9)) * 100 + r.below(100);
+        }
+        else if(kind < 15)
+        {
+            cell = 0;
+        }
+        else if(kind < 19)
+        {
+            cell = r.below(1000);
+        }
+        else if(wide && r.below(4) == 0)
+        {
+            cell = r.below(20000) - 10000;
+        }
+        else
+        {
+            cell = -r.below(1000);
+        }
+    }
+    p.f_size = lmc::MEMORY_SIZE;
+
+    input_count = r.below(MAX_INPUTS + 1);
+    for(std::size_t idx(0); idx < input_count; ++idx)
+    {
+        inputs[idx] = random_input(r);
+    }
+}
+
+
+// the input vectors of the batch of program `number` (-b)
+//
+void generate_batch(std::uint64_t seed, std::uint64_t number, std::vector<lmc::batch_job> & jobs)
+{
+    random r(~seed ^ (number * 0xD1B54A32D192ED03ULL));
+    for(auto & job : jobs)
+    {
+        job.f_inputs.resize(r.below(MAX_INPUTS + 1));
+        for(auto & value : job.f_inputs)
+        {
+            value = random_input(r);
+        }
+    }
+}
+
+
+struct options
+{
+    int                 f_threads = 0;
+    std::uint64_t       f_count = 1'000'000;
+    std::uint64_t       f_seed = 0;
+    std::uint64_t       f_first = 0;
+    std::uint64_t       f_max_steps = 1000;
+    std::uint64_t       f_batch = 0;                // jobs per batch, 0 = no batch
+    std::string         f_directory = std::string();
+};
+
+
+std::atomic<std::uint64_t>  g_next(0);
+std::atomic<std::uint64_t>  g_executed(0);
+std::atomic<int>            g_failures(0);
+std::mutex                  g_report_mutex;
+
+
+void report(options const & opts, std::uint64_t number, lmc::program const & p,
+            int const * inputs, std::size_t input_count,
+            lmc::machine const * const * machines, fuzz_output const * outputs, std::size_t engine)
+{
+    std::lock_guard<std::mutex> lock(g_report_mutex);
+    std::cerr << "error: program " << number << " differs between the "
+        << lmc::engine_name(g_engines[0]) << " and "
+        << lmc::engine_name(g_engines[engine]) << " engines; inputs:";
+    for(std::size_t idx(0); idx < input_count; ++idx)
+    {
+        std::cerr << ' ' << inputs[idx];
+    }
+    std::cerr << "\n";
+    for(std::size_t e : { static_cast<std::size_t>(0), engine })
+    {
+        lmc::machine const & m(*machines[e]);
+        std::cerr << "  " << std::setw(8) << lmc::engine_name(g_engines[e])
+            << ": PC: " << m.pc()
+            << ", ACC: " << m.acc()
+            << ", overflow: " << (m.overflow() ? "yes" : "no")
+            << ", steps: " << m.steps()
+            << ", inputs: " << m.inputs()
+            << ", outputs: " << m.outputs()
+            << " (" << outputs[e].f_count << ", hash " << std::hex << outputs[e].f_hash << std::dec << ")\n";
+    }
+    for(std::size_t loc(0); loc < lmc::MEMORY_SIZE; ++loc)
+    {
+        if(machines[0]->cell(loc) != machines[engine]->cell(loc))
+        {
+            std::cerr << "  cell " << loc << ": " << machines[0]->cell(loc)
+                << " vs " << machines[engine]->cell(loc) << "\n";
+        }
+    }
+    if(!opts.f_directory.empty())
+    {
+        lmc::save_image(opts.f_directory + "/fuzz-" + std::to_string(opts.f_seed)
+                            + "-" + std::to_string(number) + ".lmcb", p);
+    }
+}
+
+
+void fuzz(options const & opts)
+{
+    lmc::program p;
+    int inputs[MAX_INPUTS];
+    std::size_t input_count(0);
+    fuzz_input in[ENGINE_COUNT];
+    fuzz_output out[ENGINE_COUNT];
+    std::unique_ptr<lmc::machine> machines[ENGINE_COUNT];
+    lmc::machine const * views[ENGINE_COUNT];
+    lmc::limits l;
+    l.f_max_steps = opts.f_max_steps;
+    lmc::status_t status[ENGINE_COUNT];
+    for(std::size_t e(0); e < ENGINE_COUNT; ++e)
+    {
+        machines[e] = std::make_unique<lmc::machine>(p, in[e], out[e]);
+        machines[e]->set_limits(l);
+        views[e] = machines[e].get();
+    }
+
+    std::uint64_t executed(0);
+    for(;;)
+    {
+        std::uint64_t const number(g_next++);
+        if(number >= opts.f_count
+        || g_failures >= MAX_FAILURES)
+        {
+            break;
+        }
+        generate(opts.f_seed, opts.f_first + number, p, inputs, input_count);
+        for(std::size_t e(0); e < ENGINE_COUNT; ++e)
+        {
+            in[e].reset(inputs, input_count);
+            out[e].reset();
+            machines[e]->reset(p);
+            status[e] = machines[e]->run(g_engines[e]);
+        }
+        ++executed;
+
+        lmc::machine const & ref(*machines[0]);
+        for(std::size_t e(1); e < ENGINE_COUNT; ++e)
+        {
+            lmc::machine const & m(*machines[e]);
+            if(status[e] != status[0]
+            || m.pc() != ref.pc()
+            || m.acc() != ref.acc()
+            || m.overflow() != ref.overflow()
+            || m.steps() != ref.steps()
+            || m.inputs() != ref.inputs()
+            || m.outputs() != ref.outputs()
+            || out[e].f_count != out[0].f_count
+            || out[e].f_hash != out[0].f_hash
+            || memcmp(m.memory(), ref.memory(), sizeof(p.f_cells)) != 0)
+            {
+                ++g_failures;
+                report(opts, opts.f_first + number, p, inputs, input_count, views, out, e);
+                break;
+            }
+        }
+    }
+    g_executed += executed;
+}
+
+
+bool same_job(lmc::batch_job const & a, lmc::batch_job const & b)
+{
+    return a.f_status == b.f_status
+        && a.f_pc == b.f_pc
+        && a.f_acc == b.f_acc
+        && a.f_overflow == b.f_overflow
+        && a.f_steps == b.f_steps
+        && a.f_outputs == b.f_outputs;
+}
+
+
+void report_job(options const & opts, std::uint64_t number, lmc::program const & p,
+            std::size_t idx, lmc::batch_job const & ref, lmc::batch_job const & job, lmc::engine_t engine)
+{
+    std::lock_guard<std::mutex> lock(g_report_mutex);
+    std::cerr << "error: job " << idx << " of program " << number << " differs between the "
+        << lmc::engine_name(lmc::ENGINE_SWITCH) << " and "
+        << lmc::engine_name(engine) << " batches; inputs:";
+    for(auto const value : ref.f_inputs)
+    {
+        std::cerr << ' ' << value;
+    }
+    std::cerr << "\n";
+    for(auto const * j : { &ref, &job })
+    {
+        std::cerr << "  " << std::setw(8) << lmc::engine_name(j == &ref ? lmc::ENGINE_SWITCH : engine)
+            << ": status: " << j->f_status
+            << ", PC: " << j->f_pc
+            << ", ACC: " << j->f_acc
+            << ", overflow: " << (j->f_overflow ? "yes" : "no")
+            << ", steps: " << j->f_steps
+            << ", outputs:";
+        for(auto const value : j->f_outputs)
+        {
+            std::cerr << ' ' << value;
+        }
+        std::cerr << "\n";
+    }
+    if(!opts.f_directory.empty())
+    {
+        lmc::save_image(opts.f_directory + "/fuzz-" + std::to_string(opts.f_seed)
+                            + "-" + std::to_string(number) + ".lmcb", p);
+    }
+}
+
+
+// each thread runs its batches with a single thread so the jobs are
+// spread between the lanes of the simd engine but not between threads
+//
+void fuzz_batch(options const & opts)
+{
+    lmc::snapshot start;
+    std::vector<lmc::batch_job> ref(opts.f_batch);
+    std::vector<lmc::batch_job> jobs;
+    int inputs[MAX_INPUTS];
+    std::size_t input_count(0);
+    lmc::limits l;
+    l.f_max_steps = opts.f_max_steps;
+
+    std::uint64_t executed(0);
+    for(;;)
+    {
+        std::uint64_t const number(g_next++);
+        if(number >= opts.f_count
+        || g_failures >= MAX_FAILURES)
+        {
+            break;
+        }
+        generate(opts.f_seed, opts.f_first + number, start.f_program, inputs, input_count);
+        generate_batch(opts.f_seed, opts.f_first + number, ref);
+        for(auto & job : ref)
+        {
+            job.f_outputs.clear();
+        }
+        lmc::run_batch(start, ref, lmc::ENGINE_SWITCH, l, 1);
+        ++executed;
+
+        for(auto const engine : g_batch_engines)
+        {
+            jobs.resize(ref.size());
+            for(std::size_t idx(0); idx < ref.size(); ++idx)
+            {
+                jobs[idx].f_inputs = ref[idx].f_inputs;
+                jobs[idx].f_outputs.clear();
+            }
+            lmc::run_batch(start, jobs, engine, l, 1);
+            auto const diff(std::mismatch(ref.begin(), ref.end(), jobs.begin(), same_job));
+            if(diff.first != ref.end())
+            {
+                ++g_failures;
+                report_job(opts, opts.f_first + number, start.f_program,
+                        diff.first - ref.begin(), *diff.first, *diff.second, engine);
+                break;
+            }
+        }
+    }
+    g_executed += executed;
+}
+
+
+bool to_number(char const * value, std::uint64_t & n)
+{
+    char * end(nullptr);
+    n = strtoull(value, &end, 10);
+    return value != nullptr && *value != '\0' && *end == '\0';
+}
+
+
+
+} // no name namespace
+
+
+
+int main(int argc, char * argv[])
+{
+    options opts;
+    opts.f_seed = std::chrono::steady_clock::now().time_since_epoch().count();
+    for(int i(1); i < argc; ++i)
+    {
+        char const * const value(i + 1 < argc ? argv[i + 1] : nullptr);
+        std::uint64_t n(0);
+        if(argv[i][0] != '-'
+        || argv[i][1] == '\0'
+        || argv[i][2] != '\0'
+        || value == nullptr)
+        {
+            std::cerr << "Usage: lmc-fuzz [-j <threads>] [-n <count>] [-s <seed>] [-f <first>]\n"
+                         "                [-m <max-steps>] [-o <directory>] [-b <jobs>]\n";
+            return 1;
+        }
+        ++i;
+        switch(argv[i - 1][1])
+        {
+        case 'o':
+            opts.f_directory = value;
+            continue;
+
+        case 'j':
+        case 'n':
+        case 's':
+        case 'f':
+        case 'm':
+        case 'b':
+            if(!to_number(value, n))
+            {
+                std::cerr << "error: " << argv[i - 1] << " expects a number.\n";
+                return 1;
+            }
+            break;
+
+        default:
+            std::cerr << "error: unknown option \"" << argv[i - 1] << "\".\n";
+            return 1;
+
+        }
+        switch(argv[i - 1][1])
+        {
+        case 'j':
+            opts.f_threads = n;
+            break;
+
+        case 'n':
+            opts.f_count = n;
+            break;
+
+        case 's':
+            opts.f_seed = n;
+            break;
+
+        case 'f':
+            opts.f_first = n;
+            break;
+
+        case 'm':
+            opts.f_max_steps = n;
+            break;
+
+        case 'b':
+            opts.f_batch = n;
+            break;
+
+        }
+    }
+    if(opts.f_threads <= 0)
+    {
+        opts.f_threads = std::max(1U, std::thread::hardware_concurrency());
+    }
+
+    std::cout << "seed " << opts.f_seed << ", " << opts.f_count << " programs, "
+        << opts.f_threads << " threads, " << opts.f_max_steps << " steps at most";
+    if(opts.f_batch != 0)
+    {
+        std::cout << ", batches of " << opts.f_batch << " jobs";
+    }
+    std::cout << "\n";
+    auto const start(std::chrono::steady_clock::now());
+    std::vector<std::thread> pool;
+    for(int idx(0); idx < opts.f_threads; ++idx)
+    {
+        pool.emplace_back(opts.f_batch == 0 ? fuzz : fuzz_batch, std::cref(opts));
+    }
+    for(auto & t : pool)
+    {
+        t.join();
+    }
+    std::chrono::duration<double> const duration(std::chrono::steady_clock::now() - start);
+    std::cout << g_executed << " programs in " << std::fixed << std::setprecision(3)
+        << duration.count() << " s (" << std::setprecision(0)
+        << g_executed / duration.count() << " programs/s), "
+        << g_failures << " failures\n";
+
+    return g_failures == 0 ? 0 : 1;
+}
+
+// vim: ts=4 sw=4 et
@@ -0,0 +1,58 @@
+// Written by Alexis Wilke based on
+// https://en.wikipedia.org/wiki/Little_man_computer
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Source: 
+// https://github.com/AlexisWilke/little-man-computer
+
+
+// Print a trace recorded with `little-man-computer --trace <file>`; with
+// the program, the addresses and operands are shown with their labels.
+//
+// Usage: lmc-trace <trace> [<file.lmc | file.lmcb>]
+
+
+#include    "image.h"
+#include    "parser.h"
+#include    "trace.h"
+
+#include    <iostream>
+
+
+
+int main(int argc, char * argv[])
+{
+    if(argc < 2 || argc > 3)
+    {
+        std::cerr << "Usage: lmc-trace <trace> [<file.lmc | file.lmcb>]\n";
+        return 1;
+    }
+
+    lmc::program p;
+    if(argc == 3)
+    {
+        std::string const filename(argv[2]);
+        if(lmc::is_image(filename)
+                ? !lmc::load_image(filename, p)
+                : !lmc::parse(filename, p))
+        {
+            return 1;
+        }
+    }
+
+    return lmc::print_trace(argv[1], p, std::cout) ? 0 : 1;
+}
+
+// vim: ts=4 sw=4 et
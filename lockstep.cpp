@@ -0,0 +1,437 @@
+// Written by Alexis Wilke based on
+// https://en.wikipedia.org/wiki/Little_man_computer
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Source: 
+// https://github.com/AlexisWilke/little-man-computer
+
+
+#include    "lockstep.h"
+
+#include    "analysis.h"
+#include    "io.h"
+
+#include    <cstdint>
+#include    <cstring>
+
+
+
+namespace lmc
+{
+
+
+
+namespace
+{
+
+
+
+// one int per machine; GCC vector extensions compile this to AVX2, SSE2
+// or NEON depending on the target (-march) without any intrinsics
+//
+typedef std::int32_t lanes_t __attribute__((vector_size(LOCKSTEP_LANES * sizeof(std::int32_t))));
+
+constexpr std::uint64_t     WATCHDOG_QUANTUM = 1'000'000;
+
+
+// the vectors are passed by reference; by value their ABI depends on
+// whether AVX is enabled
+//
+void broadcast(lanes_t & lanes, int value)
+{
+    lanes = lanes_t{} + value;
+}
+
+
+// same as `value %= 1000` for values in [-1998, 1998], which is all the
+// ADD and SUB instructions can produce; the comparisons are -1 or 0
+//
+void modulo(lanes_t & value)
+{
+    value = value
+          - ((value > 999) & 1000)
+          + ((value < -999) & 1000);
+}
+
+
+bool equal(lanes_t const & a, lanes_t const & b)
+{
+    return memcmp(&a, &b, sizeof(lanes_t)) == 0;
+}
+
+
+
+} // no name namespace
+
+
+
+// Run up to LOCKSTEP_LANES jobs from the same starting state with one
+// shared PC. The memory is laid out structure-of-arrays style (cell by
+// cell, one lane per machine) so each instruction runs on all the lanes
+// at once. When a BRZ or BRP sends the lanes in different directions, the
+// lanes in the minority leave the group and finish on their own with the
+// threaded engine; for self-modifying programs, lanes whose next
+// instruction differs from the others leave the same way. INP and OUT are
+// done lane by lane since each lane has its own input and output.
+//
+void run_lockstep(snapshot const & start, batch_job * jobs, std::size_t count, limits const & l)
+{
+    // modulo() expects the cells and the accumulator to be in [-999, 999],
+    // which is always the case for assembled programs except for a DAT
+    // out of that range; such programs run one job at a time
+    //
+    bool in_range(start.f_acc >= -999 && start.f_acc <= 999);
+    for(auto const c : start.f_program.f_cells)
+    {
+        if(c < -999 || c > 999)
+        {
+            in_range = false;
+            break;
+        }
+    }
+    if(!in_range)
+    {
+        for(std::size_t lane(0); lane < count; ++lane)
+        {
+            batch_job & job(jobs[lane]);
+            vector_input in(job.f_inputs);
+            vector_output out(job.f_outputs);
+            machine m(start.f_program, in, out);
+            m.restore(start);
+            m.set_limits(l);
+            job.f_status = m.run(ENGINE_THREADED);
+            job.f_pc = m.pc();
+            job.f_acc = m.acc();
+            job.f_overflow = m.overflow();
+            job.f_steps = m.steps();
+        }
+        return;
+    }
+
+    auto const started(std::chrono::steady_clock::now());
+
+    lanes_t memory[MEMORY_SIZE];
+    for(std::size_t idx(0); idx < MEMORY_SIZE; ++idx)
+    {
+        broadcast(memory[idx], start.f_program.f_cells[idx]);
+    }
+    lanes_t acc;
+    lanes_t overflow;
+    broadcast(acc, start.f_acc);
+    broadcast(overflow, start.f_overflow ? -1 : 0);
+    int pc(start.f_pc);
+    std::uint64_t steps(start.f_steps);
+    std::uint64_t check_at(steps);
+
+    std::vector<vector_input> in;
+    std::vector<vector_output> out;
+    std::uint64_t inputs[LOCKSTEP_LANES];
+    std::uint64_t outputs[LOCKSTEP_LANES];
+    in.reserve(count);
+    out.reserve(count);
+    for(std::size_t lane(0); lane < count; ++lane)
+    {
+        in.emplace_back(jobs[lane].f_inputs);
+        out.emplace_back(jobs[lane].f_outputs);
+        inputs[lane] = start.f_inputs;
+        outputs[lane] = start.f_outputs;
+    }
+    // the same set of lanes as a bit mask and as a vector of -1 and 0
+    //
+    std::uint32_t active((1U << count) - 1);
+    lanes_t live;
+    for(std::size_t lane(0); lane < LOCKSTEP_LANES; ++lane)
+    {
+        live[lane] = lane < count ? -1 : 0;
+    }
+
+    // without self-modification all the lanes always see the same code
+    //
+    analysis a;
+    analyze(start.f_program.f_cells, a, start.f_pc);
+    bool const self_modifying(a.f_self_modifying);
+
+    auto const finish = [&](int lane, status_t status, int where, std::uint64_t executed)
+    {
+        batch_job & job(jobs[lane]);
+        job.f_status = status;
+        job.f_pc = where >= static_cast<int>(MEMORY_SIZE) ? 0 : where;
+        job.f_acc = acc[lane];
+        job.f_overflow = overflow[lane] != 0;
+        job.f_steps = executed;
+        active &= ~(1U << lane);
+        live[lane] = 0;
+    };
+
+    auto const stop = [&](status_t status)
+    {
+        for(std::size_t lane(0); lane < count; ++lane)
+        {
+            if((active & (1U << lane)) != 0)
+            {
+                finish(lane, status, pc, steps);
+            }
+        }
+    };
+
+    // finish that lane on its own from `next`; a lane leaving on a branch
+    // gets the watchdog check of that branch first, like on the other
+    // engines
+    //
+    auto const leave = [&](int lane, int next, bool branched)
+    {
+        active &= ~(1U << lane);
+        live[lane] = 0;
+
+        snapshot s;
+        for(std::size_t idx(0); idx < MEMORY_SIZE; ++idx)
+        {
+            s.f_program.f_cells[idx] = memory[idx][lane];
+        }
+        s.f_program.f_size = start.f_program.f_size;
+        s.f_pc = next;
+        s.f_acc = acc[lane];
+        s.f_overflow = overflow[lane] != 0;
+        s.f_steps = steps;
+        s.f_inputs = inputs[lane];
+        s.f_outputs = outputs[lane];
+
+        if(branched
+        && l.f_max_steps != 0
+        && steps >= l.f_max_steps)
+        {
+            finish(lane, STATUS_STEP_LIMIT, next, steps);
+            return;
+        }
+
+        limits remaining(l);
+        if(l.f_timeout != std::chrono::nanoseconds::zero())
+        {
+            remaining.f_timeout -= std::chrono::steady_clock::now() - started;
+            if(remaining.f_timeout <= std::chrono::nanoseconds::zero())
+            {
+                finish(lane, STATUS_TIMEOUT, next, steps);
+                return;
+            }
+        }
+
+        machine m(s.f_program, in[lane], out[lane]);
+        m.restore(s);
+        m.set_limits(remaining);
+        status_t const status(m.run(ENGINE_THREADED));
+        batch_job & job(jobs[lane]);
+        job.f_status = status;
+        job.f_pc = m.pc();
+        job.f_acc = m.acc();
+        job.f_overflow = m.overflow();
+        job.f_steps = m.steps();
+    };
+
+    // same checks as machine::watchdog(); when a limit is reached, all
+    // the lanes still in the group stop
+    //
+    auto const watchdog = [&]()
+    {
+        if(steps < check_at)
+        {
+            return;
+        }
+        if(l.f_max_steps != 0
+        && steps >= l.f_max_steps)
+        {
+            stop(STATUS_STEP_LIMIT);
+            return;
+        }
+        if(l.f_timeout != std::chrono::nanoseconds::zero()
+        && std::chrono::steady_clock::now() - started >= l.f_timeout)
+        {
+            stop(STATUS_TIMEOUT);
+            return;
+        }
+        check_at = steps + WATCHDOG_QUANTUM;
+        if(l.f_max_steps != 0
+        && check_at > l.f_max_steps)
+        {
+            check_at = l.f_max_steps;
+        }
+    };
+
+    // lanes for which `taken` is true continue at loc, the others at
+    // pc + 1; the smaller group leaves
+    //
+    lanes_t const none = {};
+    auto const branch = [&](lanes_t const & taken, int loc)
+    {
+        // the usual case: all the lanes go the same way
+        //
+        lanes_t const live_taken(taken & live);
+        if(equal(live_taken, none))
+        {
+            return;
+        }
+        if(equal(live_taken, live))
+        {
+            pc = loc;
+            return;
+        }
+
+        std::uint32_t mask(0);
+        for(std::size_t lane(0); lane < count; ++lane)
+        {
+            if(taken[lane] != 0)
+            {
+                mask |= 1U << lane;
+            }
+        }
+        mask &= active;
+        std::uint32_t const others(active & ~mask);
+        if(mask == 0)
+        {
+            return;
+        }
+        if(others == 0)
+        {
+            pc = loc;
+            return;
+        }
+        bool const follow(__builtin_popcount(mask) >= __builtin_popcount(others));
+        std::uint32_t const leaving(follow ? others : mask);
+        int const next(follow ? pc : loc);
+        for(std::size_t lane(0); lane < count; ++lane)
+        {
+            if((leaving & (1U << lane)) != 0)
+            {
+                leave(lane, next, true);
+            }
+        }
+        if(follow)
+        {
+            pc = loc;
+        }
+    };
+
+    while(active != 0)
+    {
+        int const lead(__builtin_ctz(active));
+        int const cell(memory[pc][lead]);
+        if(self_modifying)
+        {
+            lanes_t const same(memory[pc] == cell);
+            for(std::size_t lane(0); lane < count; ++lane)
+            {
+                if((active & (1U << lane)) != 0
+                && same[lane] == 0)
+                {
+                    leave(lane, pc, false);
+                }
+            }
+        }
+
+        int const instruction(cell / 100);
+        int const loc(cell % 100);
+        ++steps;
+        ++pc;
+        switch(instruction)
+        {
+        case MNEMONIC_HLT:
+            stop(STATUS_HALTED);
+            break;
+
+        case MNEMONIC_ADD:
+            acc += memory[loc];
+            overflow = acc > 999;
+            modulo(acc);
+            break;
+
+        case MNEMONIC_SUB:
+            overflow = acc < memory[loc];
+            acc -= memory[loc];
+            modulo(acc);
+            break;
+
+        case MNEMONIC_STA:
+            memory[loc] = acc;
+            break;
+
+        case MNEMONIC_LDA:
+            acc = memory[loc];
+            break;
+
+        case MNEMONIC_BRA:
+            pc = loc;
+            watchdog();
+            break;
+
+        case MNEMONIC_BRZ:
+            {
+                lanes_t const taken(acc == 0);
+                branch(taken, loc);
+            }
+            watchdog();
+            break;
+
+        case MNEMONIC_BRP:
+            {
+                lanes_t const taken(overflow == 0);
+                branch(taken, loc);
+            }
+            watchdog();
+            break;
+
+        case MNEMONIC_INP:
+            for(std::size_t lane(0); lane < count; ++lane)
+            {
+                if((active & (1U << lane)) == 0)
+                {
+                    continue;
+                }
+                int value(0);
+                if(!in[lane].read(value))
+                {
+                    // stay on the INP like the other engines
+                    //
+                    finish(lane, STATUS_NO_INPUT, pc - 1, steps - 1);
+                    continue;
+                }
+                acc[lane] = value % 1000;
+                ++inputs[lane];
+            }
+            break;
+
+        case MNEMONIC_OUT:
+            for(std::size_t lane(0); lane < count; ++lane)
+            {
+                if((active & (1U << lane)) != 0)
+                {
+                    out[lane].write(acc[lane]);
+                    ++outputs[lane];
+                }
+            }
+            break;
+
+        }
+
+        if(pc >= static_cast<int>(MEMORY_SIZE))
+        {
+            pc = 0;
+            watchdog();
+        }
+    }
+}
+
+
+
+} // namespace lmc
+// vim: ts=4 sw=4 et
@@ -0,0 +1,41 @@
+// Written by Alexis Wilke based on
+// https://en.wikipedia.org/wiki/Little_man_computer
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Source: 
+// https://github.com/AlexisWilke/little-man-computer
+
+
+#pragma once
+
+#include    "batch.h"
+
+
+namespace lmc
+{
+
+
+
+// number of machines stepped together by run_lockstep()
+//
+constexpr std::size_t       LOCKSTEP_LANES = 8;
+
+
+void        run_lockstep(snapshot const & start, batch_job * jobs, std::size_t count, limits const & l);
+
+
+
+} // namespace lmc
+// vim: ts=4 sw=4 et
@@ -0,0 +1,1103 @@
+// Written by Alexis Wilke based on
+// https://en.wikipedia.org/wiki/Little_man_computer
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Source: 
+// https://github.com/AlexisWilke/little-man-computer
+
+
+#include    "machine.h"
+
+#include    "analysis.h"
+#include    "jit.h"
+
+#include    <algorithm>
+#include    <iterator>
+#include    <type_traits>
+
+
+
+namespace lmc
+{
+
+
+
+namespace
+{
+
+
+
+char const * const g_engine_names[] =
+{
+    "switch",       // ENGINE_SWITCH
+    "threaded",     // ENGINE_THREADED
+    "jit",          // ENGINE_JIT
+    "fused",        // ENGINE_FUSED
+    "simd",         // ENGINE_SIMD
+    "gpu",          // ENGINE_GPU
+};
+
+static_assert(std::size(g_engine_names) == ENGINE_max);
+
+
+// number of steps between two checks of the clock
+//
+constexpr std::uint64_t     WATCHDOG_QUANTUM = 1'000'000;
+
+
+// once an STA overwrote the same compiled cell that many times, the JIT
+// gives the rest of the run, and the next runs of the same program, to
+// the threaded interpreter
+//
+constexpr std::uint32_t     JIT_HOT_CELL = 16;
+
+
+// the engines call these hooks; this one compiles to nothing so a
+// machine without a profile runs at full speed
+//
+struct null_probe
+{
+    void on_step(int pc) { (void)pc; }
+    void on_branch(int pc, bool taken) { (void)pc; (void)taken; }
+    void on_store(int loc) { (void)loc; }
+    void on_executed(int pc, short cell, int acc, bool overflow) { (void)pc; (void)cell; (void)acc; (void)overflow; }
+};
+
+
+// stop the switch() engine after an exact number of steps (the limits
+// are only checked on branches) and report the STA to a store_log
+//
+struct step_probe
+    : public null_probe
+{
+    void on_step(int pc) { (void)pc; ++f_steps; }
+    void on_store(int loc) { if(f_log != nullptr) { f_log->on_store(f_steps, loc); } }
+
+    std::uint64_t   f_stop_at = 0;
+    std::uint64_t   f_steps = 0;
+    store_log *     f_log = nullptr;
+};
+
+
+// to trace and profile at the same time
+//
+template<typename A, typename B>
+struct probe_pair
+{
+    void on_step(int pc) { f_a.on_step(pc); f_b.on_step(pc); }
+    void on_branch(int pc, bool taken) { f_a.on_branch(pc, taken); f_b.on_branch(pc, taken); }
+    void on_store(int loc) { f_a.on_store(loc); f_b.on_store(loc); }
+    void on_executed(int pc, short cell, int acc, bool overflow) { f_a.on_executed(pc, cell, acc, overflow); f_b.on_executed(pc, cell, acc, overflow); }
+
+    A &     f_a;
+    B &     f_b;
+};
+
+
+
+} // no name namespace
+
+
+
+engine_t engine_by_name(std::string const & name)
+{
+    for(engine_t e(0); e < ENGINE_max; ++e)
+    {
+        if(name == g_engine_names[e])
+        {
+            return e;
+        }
+    }
+    return ENGINE_NONE;
+}
+
+
+char const * engine_name(engine_t engine)
+{
+    if(engine < 0 || engine >= ENGINE_max)
+    {
+        return "unknown";
+    }
+    return g_engine_names[engine];
+}
+
+
+
+machine::machine(program const & p, input & in, output & out)
+    : f_input(in)
+    , f_output(out)
+{
+    reset(p);
+}
+
+
+void machine::reset(program const & p)
+{
+    std::copy(std::begin(p.f_cells), std::end(p.f_cells), f_memory);
+    f_pc = 0;
+    f_acc = 0;
+    f_overflow = false;
+    f_steps = 0;
+    f_inputs = 0;
+    f_outputs = 0;
+    f_jit_current = false;
+}
+
+
+// copy the memory and registers so the machine can later be restored
+// in that exact state, possibly by another process (see save_snapshot())
+//
+void machine::save(snapshot & s) const
+{
+    s.f_program = program();
+    std::copy(std::begin(f_memory), std::end(f_memory), s.f_program.f_cells);
+    s.f_program.f_size = MEMORY_SIZE;
+    s.f_pc = f_pc;
+    s.f_acc = f_acc;
+    s.f_overflow = f_overflow;
+    s.f_steps = f_steps;
+    s.f_inputs = f_inputs;
+    s.f_outputs = f_outputs;
+}
+
+
+// the next run() resumes from that state; the input object is expected to
+// return the values which follow the f_inputs values already read
+//
+void machine::restore(snapshot const & s)
+{
+    std::copy(std::begin(s.f_program.f_cells), std::end(s.f_program.f_cells), f_memory);
+    f_pc = s.f_pc;
+    f_acc = s.f_acc;
+    f_overflow = s.f_overflow;
+    f_steps = s.f_steps;
+    f_inputs = s.f_inputs;
+    f_outputs = s.f_outputs;
+    f_jit_current = false;
+}
+
+
+// run until HLT or INP has no more input; the registers are saved in the
+// object so calling run() again resumes where it stopped (i.e. after more
+// input becomes available)
+//
+status_t machine::run(engine_t engine)
+{
+    if(f_limits.f_timeout != std::chrono::nanoseconds::zero())
+    {
+        f_deadline = std::chrono::steady_clock::now() + f_limits.f_timeout;
+    }
+
+    status_t result(STATUS_HALTED);
+    null_probe none;
+    if(f_trace != nullptr)
+    {
+        // only the switch() engine calls on_executed() after each step
+        //
+        engine = ENGINE_SWITCH;
+    }
+    if(engine != ENGINE_JIT
+    || f_profile != nullptr)
+    {
+        // the other engines may modify the memory behind the JIT's back
+        //
+        f_jit_current = false;
+    }
+    switch(engine)
+    {
+    case ENGINE_SIMD:
+    case ENGINE_GPU:
+        // the lanes are machines so a single machine is a single lane
+        //
+    case ENGINE_THREADED:
+        result = f_profile != nullptr
+                    ? run_threaded(*f_profile, false)
+                    : run_threaded(none, false);
+        break;
+
+    case ENGINE_FUSED:
+        result = f_profile != nullptr
+                    ? run_threaded(*f_profile, true)
+                    : run_threaded(none, true);
+        break;
+
+    case ENGINE_JIT:
+        // the native code has no probe hooks
+        //
+        result = f_profile != nullptr
+                    ? run_threaded(*f_profile, false)
+                    : run_jit();
+        break;
+
+    default:
+        if(f_trace != nullptr)
+        {
+            if(f_profile != nullptr)
+            {
+                probe_pair<profile, trace> both{ *f_profile, *f_trace };
+                result = run_switch(both);
+            }
+            else
+            {
+                result = run_switch(*f_trace);
+            }
+        }
+        else
+        {
+            result = f_profile != nullptr
+                        ? run_switch(*f_profile)
+                        : run_switch(none);
+        }
+        break;
+
+    }
+    f_output.flush();
+    return result;
+}
+
+
+// run `count` instructions at most with the switch() engine, without the
+// profile and trace; returns STATUS_STEP_LIMIT once they all ran
+//
+status_t machine::step(std::uint64_t count, store_log * log)
+{
+    if(f_limits.f_timeout != std::chrono::nanoseconds::zero())
+    {
+        f_deadline = std::chrono::steady_clock::now() + f_limits.f_timeout;
+    }
+
+    f_jit_current = false;
+
+    step_probe probe;
+    probe.f_stop_at = f_steps + count;
+    probe.f_steps = f_steps;
+    probe.f_log = log;
+    status_t const result(run_switch(probe));
+    f_output.flush();
+    return result;
+}
+
+
+int machine::pc() const
+{
+    return f_pc;
+}
+
+
+int machine::acc() const
+{
+    return f_acc;
+}
+
+
+bool machine::overflow() const
+{
+    return f_overflow;
+}
+
+
+// the number of instructions executed since the last reset()
+//
+std::uint64_t machine::steps() const
+{
+    return f_steps;
+}
+
+
+// the number of values read by INP since the last reset()
+//
+std::uint64_t machine::inputs() const
+{
+    return f_inputs;
+}
+
+
+// the number of values written by OUT since the last reset()
+//
+std::uint64_t machine::outputs() const
+{
+    return f_outputs;
+}
+
+
+// when set, the engines count the instructions in that profile; the
+// profile must remain valid while run() is called
+//
+void machine::set_profile(profile * p)
+{
+    f_profile = p;
+}
+
+
+// when set, each instruction executed gets recorded in that trace, which
+// forces the switch() engine; the trace must remain valid while run() is
+// called
+//
+void machine::set_trace(trace * t)
+{
+    f_trace = t;
+}
+
+
+// the timeout restarts on each call to run()
+//
+void machine::set_limits(limits const & l)
+{
+    f_limits = l;
+}
+
+
+short machine::cell(int loc) const
+{
+    return f_memory[loc];
+}
+
+
+short const * machine::memory() const
+{
+    return f_memory;
+}
+
+
+// The engines only compare the step counter against check_at, on branches
+// and when the PC wraps around; every loop goes through one of those so
+// the check is amortized over the basic block. Here we do the real work
+// and return STATUS_RUNNING if the machine can continue.
+//
+status_t machine::watchdog(std::uint64_t steps, std::uint64_t & check_at)
+{
+    if(f_limits.f_max_steps != 0
+    && steps >= f_limits.f_max_steps)
+    {
+        return STATUS_STEP_LIMIT;
+    }
+    if(f_limits.f_timeout != std::chrono::nanoseconds::zero()
+    && std::chrono::steady_clock::now() >= f_deadline)
+    {
+        return STATUS_TIMEOUT;
+    }
+    check_at = steps + WATCHDOG_QUANTUM;
+    if(f_limits.f_max_steps != 0
+    && check_at > f_limits.f_max_steps)
+    {
+        check_at = f_limits.f_max_steps;
+    }
+    return STATUS_RUNNING;
+}
+
+
+#define LMC_WATCHDOG() \
+    if(steps >= check_at) \
+    { \
+        status_t const status(watchdog(steps, check_at)); \
+        if(status != STATUS_RUNNING) \
+        { \
+            save(); \
+            return status; \
+        } \
+    }
+
+
+template<typename P>
+status_t machine::run_switch(P & probe)
+{
+    int pc(f_pc);
+    int acc(f_acc);
+    bool overflow(f_overflow);
+    std::uint64_t steps(f_steps);
+    std::uint64_t check_at(steps);
+
+    // a branch at 99 which is not taken stops with pc == MEMORY_SIZE
+    //
+    auto const save = [&]()
+    {
+        f_pc = pc >= static_cast<int>(MEMORY_SIZE) ? 0 : pc;
+        f_acc = acc;
+        f_overflow = overflow;
+        f_steps = steps;
+    };
+
+    for(;;)
+    {
+        if constexpr(std::is_same_v<P, step_probe>)
+        {
+            if(steps >= probe.f_stop_at)
+            {
+                save();
+                return STATUS_STEP_LIMIT;
+            }
+        }
+
+        // the wrap around is checked once the instruction at 99 executed,
+        // same as the other engines
+        //
+        if(pc >= static_cast<int>(MEMORY_SIZE))
+        {
+            pc = 0;
+            LMC_WATCHDOG();
+        }
+        int const here(pc);
+        short const cell(f_memory[pc]);
+        int const instruction(cell / 100);
+        int const loc(cell % 100);
+        probe.on_step(pc);
+        ++pc;
+        ++steps;
+        switch(instruction)
+        {
+        case MNEMONIC_HLT:
+            // done
+            probe.on_executed(here, cell, acc, overflow);
+            save();
+            return STATUS_HALTED;
+
+        case MNEMONIC_ADD:
+            overflow = acc + f_memory[loc] > 999;
+            acc = (acc + f_memory[loc]) % 1000;
+            break;
+
+        case MNEMONIC_SUB:
+            overflow = acc < f_memory[loc];
+            acc = (acc - f_memory[loc]) % 1000;
+            break;
+
+        case MNEMONIC_STA:
+            probe.on_store(loc);
+            f_memory[loc] = acc;
+            break;
+
+        case MNEMONIC_LDA:
+            acc = f_memory[loc];
+            break;
+
+        case MNEMONIC_BRA:
+            pc = loc;
+            probe.on_executed(here, cell, acc, overflow);
+            LMC_WATCHDOG();
+            continue;
+
+        case MNEMONIC_BRZ:
+            probe.on_branch(here, acc == 0);
+            if(acc == 0)
+            {
+                pc = loc;
+            }
+            probe.on_executed(here, cell, acc, overflow);
+            LMC_WATCHDOG();
+            continue;
+
+        case MNEMONIC_BRP:
+            probe.on_branch(here, !overflow);
+            if(!overflow)
+            {
+                pc = loc;
+            }
+            probe.on_executed(here, cell, acc, overflow);
+            LMC_WATCHDOG();
+            continue;
+
+        case MNEMONIC_INP:
+            {
+                int value(0);
+                if(!f_input.read(value))
+                {
+                    // stay on the INP so we can resume later
+                    //
+                    pc = here;
+                    --steps;
+                    save();
+                    return STATUS_NO_INPUT;
+                }
+                acc = value % 1000;
+                ++f_inputs;
+            }
+            break;
+
+        case MNEMONIC_OUT:
+            f_output.write(acc);
+            ++f_outputs;
+            break;
+
+        }
+        probe.on_executed(here, cell, acc, overflow);
+    }
+}
+
+
+// The threaded engine decodes each cell the first time it runs and then
+// jumps directly from one handler to the next using computed gotos (a GNU
+// extension, hence the gnu++17 in the CMakeLists.txt file). An STA only
+// marks the cell to be decoded again; the division and modulo happen if
+// and when that cell runs.
+//
+// With `fused` set, the decoding also replaces the start of common
+// sequences by a superinstruction which carries the operands of the
+// whole group and executes it in one dispatch:
+//
+//     LDA X / ADD Y / STA Z        LDA X / SUB Y / STA Z
+//     LDA X / BRZ L                LDA X / OUT
+//     SUB X / BRZ L                SUB X / BRP L
+//     SUB X / OUT                  ADD X / STA Y
+//     STA X / LDA Y
+//
+// Only the first cell of a group is changed, so a branch to the middle of
+// a group still works. An STA also marks the two cells before it, so a
+// group including the cell it wrote is decoded again, possibly as a new
+// group. The cells themselves are never modified so -s is not affected.
+//
+template<typename P>
+status_t machine::run_threaded(P & probe, bool fused)
+{
+    // the extra handlers are for the cells to be decoded, cells which are
+    // not a valid instruction (i.e. negative numbers below -99), the PC
+    // wrapping at the end, and the superinstructions
+    //
+    enum
+    {
+        OPCODE_DECODE = MNEMONIC_OUT + 1,
+        OPCODE_NOP,
+        OPCODE_WRAP,
+        OPCODE_LDA_ADD_STA,
+        OPCODE_LDA_SUB_STA,
+        OPCODE_LDA_BRZ,
+        OPCODE_LDA_OUT,
+        OPCODE_SUB_BRZ,
+        OPCODE_SUB_BRP,
+        OPCODE_SUB_OUT,
+        OPCODE_ADD_STA,
+        OPCODE_STA_LDA,
+    };
+    static void * const handlers[] =
+    {
+        &&op_hlt,     // MNEMONIC_HLT
+        &&op_add,     // MNEMONIC_ADD
+        &&op_sub,     // MNEMONIC_SUB
+        &&op_sta,     // MNEMONIC_STA
+        &&op_lda,     // MNEMONIC_LDA
+        &&op_bra,     // MNEMONIC_BRA
+        &&op_brz,     // MNEMONIC_BRZ
+        &&op_brp,     // MNEMONIC_BRP
+        &&op_inp,     // MNEMONIC_INP
+        &&op_out,     // MNEMONIC_OUT
+        &&op_decode,  // OPCODE_DECODE
+        &&op_nop,     // OPCODE_NOP
+        &&op_wrap,    // OPCODE_WRAP
+        &&op_lda_add_sta,   // OPCODE_LDA_ADD_STA
+        &&op_lda_sub_sta,   // OPCODE_LDA_SUB_STA
+        &&op_lda_brz,       // OPCODE_LDA_BRZ
+        &&op_lda_out,       // OPCODE_LDA_OUT
+        &&op_sub_brz,       // OPCODE_SUB_BRZ
+        &&op_sub_brp,       // OPCODE_SUB_BRP
+        &&op_sub_out,       // OPCODE_SUB_OUT
+        &&op_add_sta,       // OPCODE_ADD_STA
+        &&op_sta_lda,       // OPCODE_STA_LDA
+    };
+
+    // f_loc2 and f_loc3 are the operands of the 2nd and 3rd instructions
+    // of a group
+    //
+    struct decoded_t
+    {
+        void *          f_handler = nullptr;
+        int             f_loc = 0;
+        std::uint8_t    f_loc2 = 0;
+        std::uint8_t    f_loc3 = 0;
+    };
+
+    // two entries before the cells so an STA to 0 or 1 can mark the "cells"
+    // before it without a test
+    //
+    decoded_t cells[MEMORY_SIZE + 3];
+    decoded_t * const code(cells + 2);
+    for(std::size_t pc(0); pc < MEMORY_SIZE; ++pc)
+    {
+        code[pc].f_handler = handlers[OPCODE_DECODE];
+    }
+    code[MEMORY_SIZE].f_handler = handlers[OPCODE_WRAP];
+
+    auto const opcode = [this](int loc)
+    {
+        return loc < static_cast<int>(MEMORY_SIZE) && f_memory[loc] >= 0
+                    ? f_memory[loc] / 100
+                    : -1;
+    };
+
+    // same interpretation as the switch() in run_switch(); values which do
+    // not match any case are ignored
+    //
+    auto const decode = [&](int pc)
+    {
+        decoded_t & d(code[pc]);
+        short const cell(f_memory[pc]);
+        int const instruction(cell / 100);
+        d.f_handler = handlers[instruction >= MNEMONIC_HLT && instruction <= MNEMONIC_OUT
+                                    ? instruction
+                                    : OPCODE_NOP];
+        d.f_loc = cell % 100;
+        if(!fused
+        || cell < 0)
+        {
+            return;
+        }
+
+        int const second(opcode(pc + 1));
+        int const third(opcode(pc + 2));
+        int group(-1);
+        switch(instruction)
+        {
+        case MNEMONIC_LDA:
+            if(second == MNEMONIC_ADD && third == MNEMONIC_STA)
+            {
+                group = OPCODE_LDA_ADD_STA;
+            }
+            else if(second == MNEMONIC_SUB && third == MNEMONIC_STA)
+            {
+                group = OPCODE_LDA_SUB_STA;
+            }
+            else if(second == MNEMONIC_BRZ)
+            {
+                group = OPCODE_LDA_BRZ;
+            }
+            else if(second == MNEMONIC_OUT)
+            {
+                group = OPCODE_LDA_OUT;
+            }
+            break;
+
+        case MNEMONIC_SUB:
+            if(second == MNEMONIC_BRZ)
+            {
+                group = OPCODE_SUB_BRZ;
+            }
+            else if(second == MNEMONIC_BRP)
+            {
+                group = OPCODE_SUB_BRP;
+            }
+            else if(second == MNEMONIC_OUT)
+            {
+                group = OPCODE_SUB_OUT;
+            }
+            break;
+
+        case MNEMONIC_ADD:
+            if(second == MNEMONIC_STA)
+            {
+                group = OPCODE_ADD_STA;
+            }
+            break;
+
+        case MNEMONIC_STA:
+            // the LDA runs once the STA wrote, so it can't be the target
+            //
+            if(second == MNEMONIC_LDA
+            && d.f_loc != pc + 1)
+            {
+                group = OPCODE_STA_LDA;
+            }
+            break;
+
+        }
+        if(group != -1)
+        {
+            d.f_handler = handlers[group];
+            d.f_loc2 = f_memory[pc + 1] % 100;
+            if(third != -1)
+            {
+                d.f_loc3 = f_memory[pc + 2] % 100;
+            }
+        }
+    };
+
+    // the cell may be code (i.e. self.lmc) or part of a group
+    //
+    auto const store = [&](int loc, int value)
+    {
+        f_memory[loc] = value;
+        code[loc].f_handler = handlers[OPCODE_DECODE];
+        code[loc - 1].f_handler = handlers[OPCODE_DECODE];
+        code[loc - 2].f_handler = handlers[OPCODE_DECODE];
+    };
+
+    int pc(f_pc);
+    int acc(f_acc);
+    bool overflow(f_overflow);
+    std::uint64_t steps(f_steps);
+    std::uint64_t check_at(steps);
+    decoded_t const * d(nullptr);
+
+    // a branch at 99 which is not taken stops with pc == MEMORY_SIZE
+    //
+    auto const save = [&]()
+    {
+        f_pc = pc >= static_cast<int>(MEMORY_SIZE) ? 0 : pc;
+        f_acc = acc;
+        f_overflow = overflow;
+        f_steps = steps;
+    };
+
+#define LMC_DISPATCH()  do { d = code + pc++; ++steps; goto *d->f_handler; } while(false)
+
+    LMC_DISPATCH();
+
+op_decode:
+    // pc and steps were already updated by the dispatch
+    //
+    decode(d - code);
+    goto *d->f_handler;
+
+op_hlt:
+    probe.on_step(d - code);
+    save();
+    return STATUS_HALTED;
+
+op_add:
+    probe.on_step(d - code);
+    overflow = acc + f_memory[d->f_loc] > 999;
+    acc = (acc + f_memory[d->f_loc]) % 1000;
+    LMC_DISPATCH();
+
+op_sub:
+    probe.on_step(d - code);
+    overflow = acc < f_memory[d->f_loc];
+    acc = (acc - f_memory[d->f_loc]) % 1000;
+    LMC_DISPATCH();
+
+op_sta:
+    probe.on_step(d - code);
+    probe.on_store(d->f_loc);
+    store(d->f_loc, acc);
+    LMC_DISPATCH();
+
+op_lda:
+    probe.on_step(d - code);
+    acc = f_memory[d->f_loc];
+    LMC_DISPATCH();
+
+op_bra:
+    probe.on_step(d - code);
+    pc = d->f_loc;
+    LMC_WATCHDOG();
+    LMC_DISPATCH();
+
+op_brz:
+    probe.on_step(d - code);
+    probe.on_branch(d - code, acc == 0);
+    if(acc == 0)
+    {
+        pc = d->f_loc;
+    }
+    LMC_WATCHDOG();
+    LMC_DISPATCH();
+
+op_brp:
+    probe.on_step(d - code);
+    probe.on_branch(d - code, !overflow);
+    if(!overflow)
+    {
+        pc = d->f_loc;
+    }
+    LMC_WATCHDOG();
+    LMC_DISPATCH();
+
+op_inp:
+    probe.on_step(d - code);
+    {
+        int value(0);
+        if(!f_input.read(value))
+        {
+            pc = d - code;
+            --steps;
+            save();
+            return STATUS_NO_INPUT;
+        }
+        acc = value % 1000;
+        ++f_inputs;
+    }
+    LMC_DISPATCH();
+
+op_out:
+    probe.on_step(d - code);
+    f_output.write(acc);
+    ++f_outputs;
+    LMC_DISPATCH();
+
+op_nop:
+    probe.on_step(d - code);
+    LMC_DISPATCH();
+
+op_wrap:
+    // not an instruction
+    //
+    --steps;
+    pc = 0;
+    LMC_WATCHDOG();
+    LMC_DISPATCH();
+
+op_lda_add_sta:
+    probe.on_step(d - code);
+    probe.on_step(d - code + 1);
+    probe.on_step(d - code + 2);
+    acc = f_memory[d->f_loc];
+    overflow = acc + f_memory[d->f_loc2] > 999;
+    acc = (acc + f_memory[d->f_loc2]) % 1000;
+    probe.on_store(d->f_loc3);
+    store(d->f_loc3, acc);
+    steps += 2;
+    pc += 2;
+    LMC_DISPATCH();
+
+op_lda_sub_sta:
+    probe.on_step(d - code);
+    probe.on_step(d - code + 1);
+    probe.on_step(d - code + 2);
+    acc = f_memory[d->f_loc];
+    overflow = acc < f_memory[d->f_loc2];
+    acc = (acc - f_memory[d->f_loc2]) % 1000;
+    probe.on_store(d->f_loc3);
+    store(d->f_loc3, acc);
+    steps += 2;
+    pc += 2;
+    LMC_DISPATCH();
+
+op_lda_brz:
+    probe.on_step(d - code);
+    probe.on_step(d - code + 1);
+    acc = f_memory[d->f_loc];
+    probe.on_branch(d - code + 1, acc == 0);
+    ++steps;
+    pc = acc == 0 ? d->f_loc2 : pc + 1;
+    LMC_WATCHDOG();
+    LMC_DISPATCH();
+
+op_lda_out:
+    probe.on_step(d - code);
+    probe.on_step(d - code + 1);
+    acc = f_memory[d->f_loc];
+    f_output.write(acc);
+    ++f_outputs;
+    ++steps;
+    ++pc;
+    LMC_DISPATCH();
+
+op_sub_brz:
+    probe.on_step(d - code);
+    probe.on_step(d - code + 1);
+    overflow = acc < f_memory[d->f_loc];
+    acc = (acc - f_memory[d->f_loc]) % 1000;
+    probe.on_branch(d - code + 1, acc == 0);
+    ++steps;
+    pc = acc == 0 ? d->f_loc2 : pc + 1;
+    LMC_WATCHDOG();
+    LMC_DISPATCH();
+
+op_sub_brp:
+    probe.on_step(d - code);
+    probe.on_step(d - code + 1);
+    overflow = acc < f_memory[d->f_loc];
+    acc = (acc - f_memory[d->f_loc]) % 1000;
+    probe.on_branch(d - code + 1, !overflow);
+    ++steps;
+    pc = !overflow ? d->f_loc2 : pc + 1;
+    LMC_WATCHDOG();
+    LMC_DISPATCH();
+
+op_sub_out:
+    probe.on_step(d - code);
+    probe.on_step(d - code + 1);
+    overflow = acc < f_memory[d->f_loc];
+    acc = (acc - f_memory[d->f_loc]) % 1000;
+    f_output.write(acc);
+    ++f_outputs;
+    ++steps;
+    ++pc;
+    LMC_DISPATCH();
+
+op_add_sta:
+    probe.on_step(d - code);
+    probe.on_step(d - code + 1);
+    overflow = acc + f_memory[d->f_loc] > 999;
+    acc = (acc + f_memory[d->f_loc]) % 1000;
+    probe.on_store(d->f_loc2);
+    store(d->f_loc2, acc);
+    ++steps;
+    ++pc;
+    LMC_DISPATCH();
+
+op_sta_lda:
+    probe.on_step(d - code);
+    probe.on_step(d - code + 1);
+    probe.on_store(d->f_loc);
+    store(d->f_loc, acc);
+    acc = f_memory[d->f_loc2];
+    ++steps;
+    ++pc;
+    LMC_DISPATCH();
+
+#undef LMC_DISPATCH
+}
+
+
+#undef LMC_WATCHDOG
+
+
+// The JIT runs the native code until it needs help: compile the next
+// block, invalidate a slot after an STA to a compiled cell, I/O, HLT, or
+// the watchdog. See jit.h for details.
+//
+status_t machine::run_jit()
+{
+    // the generated code expects the cells and the accumulator to be in
+    // [-999, 999], which is always the case for assembled programs
+    //
+    bool in_range(f_acc >= -999 && f_acc <= 999);
+    for(auto const c : f_memory)
+    {
+        if(c < -999 || c > 999)
+        {
+            in_range = false;
+            break;
+        }
+    }
+    if(f_jit == nullptr)
+    {
+        f_jit = std::make_unique<jit>();
+        f_analysis = std::make_unique<analysis>();
+    }
+    jit & code(*f_jit);
+    if(!in_range || !code.valid())
+    {
+        f_jit_current = false;
+        null_probe none;
+        return run_threaded(none, false);
+    }
+
+    // the code compiled by a previous run may not match the memory anymore;
+    // when the same program gets restarted (i.e. reset() or restore() with
+    // the same cells, one job after another) the analysis remains valid and
+    // only the slots of the cells which changed need to be compiled again
+    //
+    // the STA instructions only need to check whether they overwrite
+    // compiled code when the program may modify itself
+    //
+    if(!f_jit_current)
+    {
+        if(f_pc != f_jit_pc
+        || !std::equal(std::begin(f_memory), std::end(f_memory), f_jit_memory))
+        {
+            code.reset();
+            analyze(f_memory, *f_analysis, f_pc);
+            std::copy(std::begin(f_memory), std::end(f_memory), f_jit_memory);
+            f_jit_pc = f_pc;
+            f_jit_interpret = false;
+        }
+        else if(!f_jit_interpret)
+        {
+            code.sync(f_memory);
+        }
+        f_jit_current = true;
+    }
+    if(f_jit_interpret)
+    {
+        // this program was found to keep modifying its code (see below)
+        //
+        f_jit_current = false;
+        null_probe none;
+        return run_threaded(none, false);
+    }
+    bool const self_modifying(f_analysis->f_self_modifying);
+
+    jit_state state;
+    state.f_memory = f_memory;
+    state.f_steps = f_steps;
+    state.f_check_at = f_steps;
+    state.f_acc = f_acc;
+    state.f_overflow = f_overflow ? 1 : 0;
+
+    auto const save = [&](int pc)
+    {
+        f_pc = pc >= static_cast<int>(MEMORY_SIZE) ? 0 : pc;
+        f_acc = state.f_acc;
+        f_overflow = state.f_overflow != 0;
+        f_steps = state.f_steps;
+    };
+
+    int pc(f_pc);
+    for(;;)
+    {
+        code.enter(state, pc);
+        pc = state.f_pc;
+        switch(state.f_reason)
+        {
+        case JIT_EXIT_COMPILE:
+            code.compile(pc, f_memory, self_modifying);
+            break;
+
+        case JIT_EXIT_INVALIDATE:
+            if(code.invalidate(state.f_loc) >= JIT_HOT_CELL)
+            {
+                // that cell keeps changing, compiling it again after each
+                // store costs a lot more than interpreting it
+                //
+                save(pc);
+                f_jit_current = false;
+                f_jit_interpret = true;
+                null_probe none;
+                return run_threaded(none, false);
+            }
+            break;
+
+        case JIT_EXIT_HLT:
+            save(pc);
+            return STATUS_HALTED;
+
+        case JIT_EXIT_INP:
+            {
+                int value(0);
+                if(!f_input.read(value))
+                {
+                    --state.f_steps;
+                    save(pc);
+                    return STATUS_NO_INPUT;
+                }
+                state.f_acc = value % 1000;
+                ++f_inputs;
+                ++pc;
+            }
+            break;
+
+        case JIT_EXIT_OUT:
+            f_output.write(state.f_acc);
+            ++f_outputs;
+            break;
+
+        case JIT_EXIT_WATCHDOG:
+            {
+                status_t const status(watchdog(state.f_steps, state.f_check_at));
+                if(status != STATUS_RUNNING)
+                {
+                    save(pc);
+                    return status;
+                }
+            }
+            break;
+
+        }
+    }
+}
+
+
+
+} // namespace lmc
+// vim: ts=4 sw=4 et
@@ -0,0 +1,174 @@
+// Written by Alexis Wilke based on
+// https://en.wikipedia.org/wiki/Little_man_computer
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Source: 
+// https://github.com/AlexisWilke/little-man-computer
+
+
+#pragma once
+
+#include    "analysis.h"
+#include    "io.h"
+#include    "jit.h"
+#include    "profile.h"
+#include    "program.h"
+#include    "trace.h"
+
+#include    <chrono>
+#include    <cstdint>
+#include    <memory>
+
+
+namespace lmc
+{
+
+
+
+typedef int engine_t;
+
+constexpr engine_t      ENGINE_NONE = -1;
+constexpr engine_t      ENGINE_SWITCH = 0;
+constexpr engine_t      ENGINE_THREADED = 1;
+constexpr engine_t      ENGINE_JIT = 2;
+constexpr engine_t      ENGINE_FUSED = 3;
+constexpr engine_t      ENGINE_SIMD = 4;        // batches only (see run_lockstep())
+constexpr engine_t      ENGINE_GPU = 5;         // batches only (see run_offload())
+
+constexpr engine_t      ENGINE_max = ENGINE_GPU + 1;
+
+engine_t                engine_by_name(std::string const & name);
+char const *            engine_name(engine_t engine);
+
+
+typedef int status_t;
+
+constexpr status_t      STATUS_RUNNING = -1;    // internal, machine did not stop
+constexpr status_t      STATUS_HALTED = 0;      // HLT reached
+constexpr status_t      STATUS_NO_INPUT = 1;    // INP found no more input
+constexpr status_t      STATUS_STEP_LIMIT = 2;  // limits::f_max_steps reached
+constexpr status_t      STATUS_TIMEOUT = 3;     // limits::f_timeout reached
+
+
+// A runaway program (i.e. BRA to itself) gets stopped by these limits;
+// they are only checked on branches and when the PC wraps around, so a
+// machine may run up to 100 instructions past f_max_steps
+//
+struct limits
+{
+    std::uint64_t               f_max_steps = 0;                            // 0 = no limit
+    std::chrono::nanoseconds    f_timeout = std::chrono::nanoseconds::zero();   // 0 = no limit
+};
+
+
+// everything needed to resume a machine where it stopped; f_program holds
+// the cells as they were at the time, f_inputs and f_outputs are the
+// number of values read by INP and written by OUT so far
+//
+struct snapshot
+{
+    program             f_program = program();
+    int                 f_pc = 0;
+    int                 f_acc = 0;
+    bool                f_overflow = false;
+    std::uint64_t       f_steps = 0;
+    std::uint64_t       f_inputs = 0;
+    std::uint64_t       f_outputs = 0;
+};
+
+
+// told about each STA executed by machine::step(); `step` is the value
+// of machine::steps() once the STA ran
+//
+class store_log
+{
+public:
+    virtual             ~store_log() {}
+
+    virtual void        on_store(std::uint64_t step, int loc) = 0;
+};
+
+
+// A machine owns a copy of the memory cells and all the registers; the
+// only things it shares are the input and output objects it was given so
+// any number of machines can run in parallel, one per thread
+//
+class machine
+{
+public:
+                        machine(program const & p, input & in, output & out);
+
+    void                reset(program const & p);
+    void                save(snapshot & s) const;
+    void                restore(snapshot const & s);
+    status_t            run(engine_t engine = ENGINE_SWITCH);
+    status_t            step(std::uint64_t count, store_log * log = nullptr);
+    void                set_profile(profile * p);
+    void                set_trace(trace * t);
+    void                set_limits(limits const & l);
+
+    int                 pc() const;
+    int                 acc() const;
+    bool                overflow() const;
+    std::uint64_t       steps() const;
+    std::uint64_t       inputs() const;
+    std::uint64_t       outputs() const;
+    short               cell(int loc) const;
+    short const *       memory() const;
+
+private:
+    template<typename P>
+    status_t            run_switch(P & probe);
+    template<typename P>
+    status_t            run_threaded(P & probe, bool fused);
+    status_t            run_jit();
+    status_t            watchdog(std::uint64_t steps, std::uint64_t & check_at);
+
+    short               f_memory[MEMORY_SIZE] = {};
+    int                 f_pc = 0;
+    int                 f_acc = 0;
+    bool                f_overflow = false;
+    std::uint64_t       f_steps = 0;
+    std::uint64_t       f_inputs = 0;
+    std::uint64_t       f_outputs = 0;
+    profile *           f_profile = nullptr;
+    trace *             f_trace = nullptr;
+    limits              f_limits = limits();
+    std::chrono::steady_clock::time_point
+                        f_deadline = std::chrono::steady_clock::time_point();
+    input &             f_input;
+    output &            f_output;
+
+    // kept between runs so reset() + run() with the JIT does not allocate;
+    // f_jit_memory is the memory as analyzed, when the same program gets
+    // restarted the analysis and all the slots which still match are kept;
+    // f_jit_current is true while the slots match the memory as is and
+    // f_jit_interpret once that program was found to modify its code in
+    // a loop (it then runs with the threaded interpreter)
+    //
+    std::unique_ptr<jit>
+                        f_jit = nullptr;
+    std::unique_ptr<analysis>
+                        f_analysis = nullptr;
+    short               f_jit_memory[MEMORY_SIZE] = {};
+    int                 f_jit_pc = -1;
+    bool                f_jit_current = false;
+    bool                f_jit_interpret = false;
+};
+
+
+
+} // namespace lmc
+// vim: ts=4 sw=4 et
@@ -0,0 +1,232 @@
+// Written by Alexis Wilke based on
+// https://en.wikipedia.org/wiki/Little_man_computer
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Source: 
+// https://github.com/AlexisWilke/little-man-computer
+
+
+#include    "metrics.h"
+
+#include    <algorithm>
+#include    <cstdio>
+#include    <fstream>
+#include    <iomanip>
+#include    <sstream>
+
+#include    <unistd.h>
+
+
+
+namespace lmc
+{
+
+
+
+void thread_metrics::run(engine_t engine, status_t status, std::uint64_t steps)
+{
+    f_runs.add();
+    f_steps.add(steps);
+    if(engine >= 0
+    && engine < ENGINE_max)
+    {
+        f_engines[engine].add();
+    }
+    switch(status)
+    {
+    case STATUS_NO_INPUT:
+        f_input_waits.add();
+        break;
+
+    case STATUS_STEP_LIMIT:
+        f_step_limits.add();
+        break;
+
+    case STATUS_TIMEOUT:
+        f_timeouts.add();
+        break;
+
+    }
+}
+
+
+void thread_metrics::job_done()
+{
+    f_jobs.add();
+}
+
+
+metrics::metrics()
+    : f_start(std::chrono::steady_clock::now())
+{
+}
+
+
+metrics::~metrics()
+{
+    if(f_dumper.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(f_mutex);
+            f_quit = true;
+        }
+        f_cond.notify_all();
+        f_dumper.join();
+    }
+}
+
+
+// the object stays in place until the metrics get destroyed
+//
+thread_metrics & metrics::add_thread()
+{
+    std::lock_guard<std::mutex> lock(f_mutex);
+    f_threads.emplace_back();
+    return f_threads.back();
+}
+
+
+void metrics::print(std::ostream & out) const
+{
+    std::uint64_t jobs(0);
+    std::uint64_t runs(0);
+    std::uint64_t steps(0);
+    std::uint64_t input_waits(0);
+    std::uint64_t step_limits(0);
+    std::uint64_t timeouts(0);
+    std::uint64_t cache_hits(0);
+    std::uint64_t cache_misses(0);
+    std::uint64_t engines[ENGINE_max] = {};
+    std::size_t threads(0);
+    {
+        std::lock_guard<std::mutex> lock(f_mutex);
+        for(auto const & t : f_threads)
+        {
+            jobs += t.f_jobs.get();
+            runs += t.f_runs.get();
+            steps += t.f_steps.get();
+            input_waits += t.f_input_waits.get();
+            step_limits += t.f_step_limits.get();
+            timeouts += t.f_timeouts.get();
+            cache_hits += t.f_cache_hits.get();
+            cache_misses += t.f_cache_misses.get();
+            for(int e(0); e < ENGINE_max; ++e)
+            {
+                engines[e] += t.f_engines[e].get();
+            }
+        }
+        threads = f_threads.size();
+    }
+    std::chrono::duration<double> const uptime(std::chrono::steady_clock::now() - f_start);
+
+    auto const metric = [&out](char const * name, char const * type, char const * help)
+    {
+        out << "# HELP " << name << ' ' << help << "\n"
+               "# TYPE " << name << ' ' << type << "\n";
+    };
+
+    metric("lmc_jobs_total", "counter", "Programs which ran to completion.");
+    out << "lmc_jobs_total " << jobs << "\n";
+    metric("lmc_runs_total", "counter", "Runs of a machine (a suspended machine runs again once resumed), per engine.");
+    for(int e(0); e < ENGINE_max; ++e)
+    {
+        out << "lmc_runs_total{engine=\"" << engine_name(e) << "\"} " << engines[e] << "\n";
+    }
+    metric("lmc_instructions_total", "counter", "Instructions executed.");
+    out << "lmc_instructions_total " << steps << "\n";
+    metric("lmc_input_waits_total", "counter", "Runs which stopped on an INP without input.");
+    out << "lmc_input_waits_total " << input_waits << "\n";
+    metric("lmc_stops_total", "counter", "Runs stopped by a limit.");
+    out << "lmc_stops_total{reason=\"step-limit\"} " << step_limits << "\n"
+           "lmc_stops_total{reason=\"timeout\"} " << timeouts << "\n";
+    metric("lmc_cache_hits_total", "counter", "Results or programs found in a cache.");
+    out << "lmc_cache_hits_total " << cache_hits << "\n";
+    metric("lmc_cache_misses_total", "counter", "Results or programs not found in a cache.");
+    out << "lmc_cache_misses_total " << cache_misses << "\n";
+    metric("lmc_threads", "gauge", "Threads with counters.");
+    out << "lmc_threads " << threads << "\n";
+    metric("lmc_uptime_seconds", "gauge", "Time since the start.");
+    out << std::fixed << std::setprecision(3)
+        << "lmc_uptime_seconds " << uptime.count() << "\n";
+    metric("lmc_jobs_per_second", "gauge", "Average number of jobs per second since the start.");
+    out << "lmc_jobs_per_second " << (uptime.count() > 0.0 ? jobs / uptime.count() : 0.0) << "\n";
+    metric("lmc_steps_per_run", "gauge", "Average number of instructions per run (results found in a cache did not run).");
+    out << "lmc_steps_per_run " << (runs != 0 ? static_cast<double>(steps) / runs : 0.0) << "\n";
+    out << std::defaultfloat;
+}
+
+
+// write a temporary file and rename it so readers never see a partial file
+//
+bool metrics::save(std::string const & filename) const
+{
+    std::ostringstream text;
+    print(text);
+    std::string const data(text.str());
+
+    std::string const tmp(filename + ".tmp" + std::to_string(getpid()));
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        if(!out.write(data.data(), data.size()))
+        {
+            out.close();
+            unlink(tmp.c_str());
+            return false;
+        }
+    }
+    if(rename(tmp.c_str(), filename.c_str()) != 0)
+    {
+        unlink(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+
+void metrics::start_dump(std::string const & filename, int interval)
+{
+    f_filename = filename;
+    f_interval = std::max(interval, 1);
+    f_dumper = std::thread(&metrics::dump, this);
+}
+
+
+void metrics::dump()
+{
+    std::unique_lock<std::mutex> lock(f_mutex);
+    for(;;)
+    {
+        bool const quit(f_cond.wait_for(lock, std::chrono::seconds(f_interval), [this]() { return f_quit; }));
+
+        // print() locks the mutex
+        //
+        lock.unlock();
+        if(!save(f_filename))
+        {
+            std::cerr << "error: could not write the metrics to \"" << f_filename << "\".\n";
+        }
+        lock.lock();
+
+        if(quit)
+        {
+            return;
+        }
+    }
+}
+
+
+
+} // namespace lmc
+// vim: ts=4 sw=4 et
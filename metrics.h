@@ -0,0 +1,129 @@
+// Written by Alexis Wilke based on
+// https://en.wikipedia.org/wiki/Little_man_computer
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Source: 
+// https://github.com/AlexisWilke/little-man-computer
+
+
+#pragma once
+
+#include    "machine.h"
+
+#include    <atomic>
+#include    <condition_variable>
+#include    <deque>
+#include    <mutex>
+#include    <thread>
+
+
+namespace lmc
+{
+
+
+
+// a counter written by one thread only: a relaxed load + store compiles
+// to plain moves (no lock prefix) and other threads can still read it
+// while it changes
+//
+class counter
+{
+public:
+    void add(std::uint64_t n = 1)
+    {
+        f_value.store(f_value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    std::uint64_t get() const
+    {
+        return f_value.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<std::uint64_t>
+                        f_value = 0;
+};
+
+
+// the counters of one thread, aligned on a cache line so two threads
+// never write to the same line; they get updated once per run of a
+// machine, the machine itself counts the instructions (`steps` is the
+// number executed by that one run, not the total since the reset())
+//
+struct alignas(64) thread_metrics
+{
+    void                run(engine_t engine, status_t status, std::uint64_t steps);
+    void                job_done();
+
+    counter             f_jobs = counter();             // programs which returned a result
+    counter             f_runs = counter();             // calls to machine::run()
+    counter             f_steps = counter();
+    counter             f_input_waits = counter();      // runs which stopped on INP
+    counter             f_step_limits = counter();
+    counter             f_timeouts = counter();
+    counter             f_cache_hits = counter();
+    counter             f_cache_misses = counter();
+    counter             f_engines[ENGINE_max] = {};     // runs per engine
+};
+
+
+// Each thread which runs machines gets its own thread_metrics from
+// add_thread(); print() sums them when called (i.e. when scraped) and
+// writes them in the Prometheus text format:
+//
+//     lmc_jobs_total, lmc_runs_total{engine="..."}, lmc_instructions_total,
+//     lmc_input_waits_total, lmc_stops_total{reason="step-limit|timeout"},
+//     lmc_cache_hits_total, lmc_cache_misses_total, lmc_threads,
+//     lmc_uptime_seconds, lmc_jobs_per_second, lmc_steps_per_run
+//
+// The last two are averages since the start, for people reading the file
+// directly; Prometheus computes rates from the totals.
+//
+// start_dump() writes that text to a file every `interval` seconds (the
+// file gets replaced atomically, as expected by the node exporter text
+// file collector) and once more when the object is destroyed.
+//
+class metrics
+{
+public:
+                        metrics();
+                        ~metrics();
+
+    thread_metrics &    add_thread();
+    void                print(std::ostream & out) const;
+    bool                save(std::string const & filename) const;
+    void                start_dump(std::string const & filename, int interval = 1);
+
+private:
+    void                dump();
+
+    mutable std::mutex  f_mutex = std::mutex();
+    std::deque<thread_metrics>
+                        f_threads = {};
+    std::chrono::steady_clock::time_point
+                        f_start = std::chrono::steady_clock::time_point();
+
+    std::string         f_filename = std::string();
+    int                 f_interval = 1;
+    bool                f_quit = false;
+    std::condition_variable
+                        f_cond = std::condition_variable();
+    std::thread         f_dumper = std::thread();
+};
+
+
+
+} // namespace lmc
+// vim: ts=4 sw=4 et
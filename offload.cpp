@@ -0,0 +1,653 @@
+// Written by Alexis Wilke based on
+// https://en.wikipedia.org/wiki/Little_man_computer
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Source: 
+// https://github.com/AlexisWilke/little-man-computer
+
+
+#include    "offload.h"
+
+#include    <iostream>
+
+#ifdef LMC_OPENCL
+#include    <algorithm>
+#include    <string>
+
+#define CL_TARGET_OPENCL_VERSION 120
+#include    <CL/cl.h>
+#endif
+
+
+
+namespace lmc
+{
+
+
+namespace
+{
+
+
+
+// run_offload() failing is not fatal, the caller runs the batch on the
+// CPU so each reason ends with this
+//
+char const g_fallback[] = ", the batch runs with the simd engine instead.\n";
+
+
+
+} // no name namespace
+
+
+#ifdef LMC_OPENCL
+namespace
+{
+
+
+
+// The memory is laid out cell by cell, one lane after the other, so the
+// work items of a group read consecutive shorts. Same semantics as
+// run_lockstep(): values which are not a valid instruction do nothing,
+// the limits are checked on branches and when the PC wraps around, an INP
+// without input stays on the INP. An OUT with a full buffer also stays
+// where it is and ends the launch early for that lane.
+//
+char const g_source[] = R"(
+__kernel void lmc_init(__global short const * image,
+                       __global short * memory,
+                       __global int * pc_reg,
+                       __global int * acc_reg,
+                       __global int * overflow_reg,
+                       __global int * status_reg,
+                       __global ulong * steps_reg,
+                       __global uint * input_pos,
+                       uint lanes,
+                       int pc,
+                       int acc,
+                       int overflow,
+                       ulong steps)
+{
+    uint const lane = get_global_id(0);
+    if(lane >= lanes)
+    {
+        return;
+    }
+    for(int loc = 0; loc < MEMORY_SIZE; ++loc)
+    {
+        memory[loc * lanes + lane] = image[loc];
+    }
+    pc_reg[lane] = pc;
+    acc_reg[lane] = acc;
+    overflow_reg[lane] = overflow;
+    status_reg[lane] = STATUS_RUNNING;
+    steps_reg[lane] = steps;
+    input_pos[lane] = 0;
+}
+
+
+__kernel void lmc_run(__global short * memory,
+                      __global int * pc_reg,
+                      __global int * acc_reg,
+                      __global int * overflow_reg,
+                      __global int * status_reg,
+                      __global ulong * steps_reg,
+                      __global int const * inputs,
+                      __global uint const * input_start,
+                      __global uint const * input_count,
+                      __global uint * input_pos,
+                      __global int * outputs,
+                      __global uint * output_count,
+                      uint lanes,
+                      ulong slice,
+                      ulong max_steps)
+{
+    uint const lane = get_global_id(0);
+    if(lane >= lanes)
+    {
+        return;
+    }
+    output_count[lane] = 0;
+    if(status_reg[lane] != STATUS_RUNNING)
+    {
+        return;
+    }
+
+    __global short * mem = memory + lane;
+    __global int const * in = inputs + input_start[lane];
+    uint const in_count = input_count[lane];
+    uint in_pos = input_pos[lane];
+    __global int * out = outputs + lane * OUTPUTS;
+    uint out_count = 0;
+    int pc = pc_reg[lane];
+    int acc = acc_reg[lane];
+    int overflow = overflow_reg[lane];
+    ulong steps = steps_reg[lane];
+    ulong end = steps + slice;
+    int status = STATUS_RUNNING;
+    while(status == STATUS_RUNNING && steps < end)
+    {
+        int const cell = mem[pc * lanes];
+        int const loc = cell % 100;
+        int check = 0;
+        ++steps;
+        ++pc;
+        switch(cell / 100)
+        {
+        case MNEMONIC_HLT:
+            status = STATUS_HALTED;
+            break;
+
+        case MNEMONIC_ADD:
+            acc += mem[loc * lanes];
+            overflow = acc > 999;
+            acc %= 1000;
+            break;
+
+        case MNEMONIC_SUB:
+            overflow = acc < mem[loc * lanes];
+            acc -= mem[loc * lanes];
+            acc %= 1000;
+            break;
+
+        case MNEMONIC_STA:
+            mem[loc * lanes] = acc;
+            break;
+
+        case MNEMONIC_LDA:
+            acc = mem[loc * lanes];
+            break;
+
+        case MNEMONIC_BRA:
+            pc = loc;
+            check = 1;
+            break;
+
+        case MNEMONIC_BRZ:
+            if(acc == 0)
+            {
+                pc = loc;
+            }
+            check = 1;
+            break;
+
+        case MNEMONIC_BRP:
+            if(!overflow)
+            {
+                pc = loc;
+            }
+            check = 1;
+            break;
+
+        case MNEMONIC_INP:
+            if(in_pos >= in_count)
+            {
+                --pc;
+                --steps;
+                status = STATUS_NO_INPUT;
+                break;
+            }
+            acc = in[in_pos] % 1000;
+            ++in_pos;
+            break;
+
+        case MNEMONIC_OUT:
+            if(out_count == OUTPUTS)
+            {
+                --pc;
+                --steps;
+                end = steps;
+                break;
+            }
+            out[out_count] = acc;
+            ++out_count;
+            break;
+
+        }
+        if(pc >= MEMORY_SIZE)
+        {
+            pc = 0;
+            check = 1;
+        }
+        if(check
+        && status == STATUS_RUNNING
+        && max_steps != 0
+        && steps >= max_steps)
+        {
+            status = STATUS_STEP_LIMIT;
+        }
+    }
+
+    pc_reg[lane] = pc;
+    acc_reg[lane] = acc;
+    overflow_reg[lane] = overflow;
+    status_reg[lane] = status;
+    steps_reg[lane] = steps;
+    input_pos[lane] = in_pos;
+    output_count[lane] = out_count;
+}
+)";
+
+
+bool check(cl_int err, char const * what)
+{
+    if(err != CL_SUCCESS)
+    {
+        std::cerr << "warning: OpenCL " << what << "() failed (" << err << ")" << g_fallback;
+        return false;
+    }
+    return true;
+}
+
+
+class buffer
+{
+public:
+                        buffer() {}
+                        buffer(buffer const &) = delete;
+                        ~buffer() { release(); }
+    buffer &            operator = (buffer const &) = delete;
+
+    bool                create(cl_context context, cl_mem_flags flags, std::size_t size, void const * data = nullptr)
+                        {
+                            release();
+                            cl_int err(CL_SUCCESS);
+                            f_mem = clCreateBuffer(context
+                                        , flags | (data != nullptr ? CL_MEM_COPY_HOST_PTR : 0)
+                                        , std::max(size, static_cast<std::size_t>(1))
+                                        , const_cast<void *>(data)
+                                        , &err);
+                            return check(err, "clCreateBuffer");
+                        }
+    void                release()
+                        {
+                            if(f_mem != nullptr)
+                            {
+                                clReleaseMemObject(f_mem);
+                                f_mem = nullptr;
+                            }
+                        }
+
+    cl_mem              f_mem = nullptr;
+};
+
+
+// the arguments are given in the order of the kernel parameters; buffers
+// are passed as their cl_mem
+//
+template<typename ... T>
+bool set_args(cl_kernel kernel, T const & ... args)
+{
+    cl_uint idx(0);
+    cl_int err(CL_SUCCESS);
+    ((err = err != CL_SUCCESS ? err : clSetKernelArg(kernel, idx++, sizeof(T), &args)), ...);
+    return check(err, "clSetKernelArg");
+}
+
+
+template<typename T>
+bool read_buffer(cl_command_queue queue, buffer const & b, std::vector<T> & data)
+{
+    return check(clEnqueueReadBuffer(queue, b.f_mem, CL_TRUE, 0, data.size() * sizeof(T), data.data(), 0, nullptr, nullptr)
+                , "clEnqueueReadBuffer");
+}
+
+
+// the first GPU found, otherwise the first device of any type (i.e. a
+// CPU implementation such as PoCL)
+//
+class device
+{
+public:
+                        device() {}
+                        device(device const &) = delete;
+                        ~device();
+    device &            operator = (device const &) = delete;
+
+    bool                open();
+    bool                run(snapshot const & start, batch_job * jobs, std::size_t count, limits const & l, std::chrono::steady_clock::time_point started);
+
+private:
+    cl_context          f_context = nullptr;
+    cl_command_queue    f_queue = nullptr;
+    cl_program          f_program = nullptr;
+    cl_kernel           f_init = nullptr;
+    cl_kernel           f_run = nullptr;
+};
+
+
+device::~device()
+{
+    if(f_run != nullptr)
+    {
+        clReleaseKernel(f_run);
+    }
+    if(f_init != nullptr)
+    {
+        clReleaseKernel(f_init);
+    }
+    if(f_program != nullptr)
+    {
+        clReleaseProgram(f_program);
+    }
+    if(f_queue != nullptr)
+    {
+        clReleaseCommandQueue(f_queue);
+    }
+    if(f_context != nullptr)
+    {
+        clReleaseContext(f_context);
+    }
+}
+
+
+bool device::open()
+{
+    cl_uint platform_count(0);
+    if(clGetPlatformIDs(0, nullptr, &platform_count) != CL_SUCCESS
+    || platform_count == 0)
+    {
+        std::cerr << "warning: no OpenCL platform found" << g_fallback;
+        return false;
+    }
+    std::vector<cl_platform_id> platforms(platform_count);
+    if(!check(clGetPlatformIDs(platform_count, platforms.data(), nullptr), "clGetPlatformIDs"))
+    {
+        return false;
+    }
+    cl_device_id id(nullptr);
+    cl_device_type const types[] = { CL_DEVICE_TYPE_GPU, CL_DEVICE_TYPE_ALL };
+    for(cl_device_type type : types)
+    {
+        for(auto const & p : platforms)
+        {
+            if(clGetDeviceIDs(p, type, 1, &id, nullptr) == CL_SUCCESS)
+            {
+                break;
+            }
+            id = nullptr;
+        }
+        if(id != nullptr)
+        {
+            break;
+        }
+    }
+    if(id == nullptr)
+    {
+        std::cerr << "warning: no OpenCL device found" << g_fallback;
+        return false;
+    }
+
+    cl_int err(CL_SUCCESS);
+    f_context = clCreateContext(nullptr, 1, &id, nullptr, nullptr, &err);
+    if(!check(err, "clCreateContext"))
+    {
+        return false;
+    }
+    f_queue = clCreateCommandQueue(f_context, id, 0, &err);
+    if(!check(err, "clCreateCommandQueue"))
+    {
+        return false;
+    }
+    char const * source(g_source);
+    f_program = clCreateProgramWithSource(f_context, 1, &source, nullptr, &err);
+    if(!check(err, "clCreateProgramWithSource"))
+    {
+        return false;
+    }
+
+    // the kernels use the same constants as the C++ code
+    //
+    std::string const options(
+              "-DMEMORY_SIZE=" + std::to_string(MEMORY_SIZE)
+            + " -DOUTPUTS=" + std::to_string(OFFLOAD_OUTPUTS)
+            + " -DSTATUS_RUNNING=(" + std::to_string(STATUS_RUNNING) + ")"
+            + " -DSTATUS_HALTED=" + std::to_string(STATUS_HALTED)
+            + " -DSTATUS_NO_INPUT=" + std::to_string(STATUS_NO_INPUT)
+            + " -DSTATUS_STEP_LIMIT=" + std::to_string(STATUS_STEP_LIMIT)
+            + " -DMNEMONIC_HLT=" + std::to_string(MNEMONIC_HLT)
+            + " -DMNEMONIC_ADD=" + std::to_string(MNEMONIC_ADD)
+            + " -DMNEMONIC_SUB=" + std::to_string(MNEMONIC_SUB)
+            + " -DMNEMONIC_STA=" + std::to_string(MNEMONIC_STA)
+            + " -DMNEMONIC_LDA=" + std::to_string(MNEMONIC_LDA)
+            + " -DMNEMONIC_BRA=" + std::to_string(MNEMONIC_BRA)
+            + " -DMNEMONIC_BRZ=" + std::to_string(MNEMONIC_BRZ)
+            + " -DMNEMONIC_BRP=" + std::to_string(MNEMONIC_BRP)
+            + " -DMNEMONIC_INP=" + std::to_string(MNEMONIC_INP)
+            + " -DMNEMONIC_OUT=" + std::to_string(MNEMONIC_OUT));
+    if(clBuildProgram(f_program, 1, &id, options.c_str(), nullptr, nullptr) != CL_SUCCESS)
+    {
+        std::size_t size(0);
+        clGetProgramBuildInfo(f_program, id, CL_PROGRAM_BUILD_LOG, 0, nullptr, &size);
+        std::string log(size, '\0');
+        clGetProgramBuildInfo(f_program, id, CL_PROGRAM_BUILD_LOG, size, &log[0], nullptr);
+        std::cerr << "warning: the OpenCL kernels did not compile" << g_fallback << log.c_str() << "\n";
+        return false;
+    }
+    f_init = clCreateKernel(f_program, "lmc_init", &err);
+    if(!check(err, "clCreateKernel"))
+    {
+        return false;
+    }
+    f_run = clCreateKernel(f_program, "lmc_run", &err);
+    return check(err, "clCreateKernel");
+}
+
+
+bool device::run(snapshot const & start, batch_job * jobs, std::size_t count, limits const & l, std::chrono::steady_clock::time_point started)
+{
+    cl_uint const lanes(count);
+    std::size_t const global((count + 63) / 64 * 64);
+
+    std::vector<cl_short> image(start.f_program.f_cells, start.f_program.f_cells + MEMORY_SIZE);
+    std::vector<cl_int> inputs;
+    std::vector<cl_uint> input_start(count);
+    std::vector<cl_uint> input_count(count);
+    for(std::size_t lane(0); lane < count; ++lane)
+    {
+        input_start[lane] = inputs.size();
+        input_count[lane] = jobs[lane].f_inputs.size();
+        inputs.insert(inputs.end(), jobs[lane].f_inputs.begin(), jobs[lane].f_inputs.end());
+    }
+
+    buffer image_buffer;
+    buffer memory;
+    buffer pc;
+    buffer acc;
+    buffer overflow;
+    buffer status;
+    buffer steps;
+    buffer input_buffer;
+    buffer input_start_buffer;
+    buffer input_count_buffer;
+    buffer input_pos;
+    buffer outputs;
+    buffer output_count;
+    if(!image_buffer.create(f_context, CL_MEM_READ_ONLY, image.size() * sizeof(cl_short), image.data())
+    || !memory.create(f_context, CL_MEM_READ_WRITE, MEMORY_SIZE * count * sizeof(cl_short))
+    || !pc.create(f_context, CL_MEM_READ_WRITE, count * sizeof(cl_int))
+    || !acc.create(f_context, CL_MEM_READ_WRITE, count * sizeof(cl_int))
+    || !overflow.create(f_context, CL_MEM_READ_WRITE, count * sizeof(cl_int))
+    || !status.create(f_context, CL_MEM_READ_WRITE, count * sizeof(cl_int))
+    || !steps.create(f_context, CL_MEM_READ_WRITE, count * sizeof(cl_ulong))
+    || !input_buffer.create(f_context, CL_MEM_READ_ONLY, inputs.size() * sizeof(cl_int), inputs.empty() ? nullptr : inputs.data())
+    || !input_start_buffer.create(f_context, CL_MEM_READ_ONLY, count * sizeof(cl_uint), input_start.data())
+    || !input_count_buffer.create(f_context, CL_MEM_READ_ONLY, count * sizeof(cl_uint), input_count.data())
+    || !input_pos.create(f_context, CL_MEM_READ_WRITE, count * sizeof(cl_uint))
+    || !outputs.create(f_context, CL_MEM_WRITE_ONLY, count * OFFLOAD_OUTPUTS * sizeof(cl_int))
+    || !output_count.create(f_context, CL_MEM_READ_WRITE, count * sizeof(cl_uint)))
+    {
+        return false;
+    }
+
+    cl_int const start_pc(start.f_pc);
+    cl_int const start_acc(start.f_acc);
+    cl_int const start_overflow(start.f_overflow ? 1 : 0);
+    cl_ulong const start_steps(start.f_steps);
+    if(!set_args(f_init
+                , image_buffer.f_mem, memory.f_mem, pc.f_mem, acc.f_mem, overflow.f_mem
+                , status.f_mem, steps.f_mem, input_pos.f_mem
+                , lanes, start_pc, start_acc, start_overflow, start_steps)
+    || !check(clEnqueueNDRangeKernel(f_queue, f_init, 1, nullptr, &global, nullptr, 0, nullptr, nullptr)
+                , "clEnqueueNDRangeKernel"))
+    {
+        return false;
+    }
+
+    cl_ulong const slice(OFFLOAD_SLICE);
+    cl_ulong const max_steps(l.f_max_steps);
+    if(!set_args(f_run
+                , memory.f_mem, pc.f_mem, acc.f_mem, overflow.f_mem, status.f_mem, steps.f_mem
+                , input_buffer.f_mem, input_start_buffer.f_mem, input_count_buffer.f_mem, input_pos.f_mem
+                , outputs.f_mem, output_count.f_mem
+                , lanes, slice, max_steps))
+    {
+        return false;
+    }
+
+    std::vector<cl_int> status_values(count);
+    std::vector<cl_uint> counts(count);
+    std::vector<cl_int> values(count * OFFLOAD_OUTPUTS);
+    for(;;)
+    {
+        if(!check(clEnqueueNDRangeKernel(f_queue, f_run, 1, nullptr, &global, nullptr, 0, nullptr, nullptr)
+                    , "clEnqueueNDRangeKernel")
+        || !read_buffer(f_queue, output_count, counts)
+        || !read_buffer(f_queue, status, status_values))
+        {
+            return false;
+        }
+        if(std::any_of(counts.begin(), counts.end(), [](cl_uint n) { return n != 0; }))
+        {
+            if(!read_buffer(f_queue, outputs, values))
+            {
+                return false;
+            }
+            for(std::size_t lane(0); lane < count; ++lane)
+            {
+                cl_int const * v(values.data() + lane * OFFLOAD_OUTPUTS);
+                jobs[lane].f_outputs.insert(jobs[lane].f_outputs.end(), v, v + counts[lane]);
+            }
+        }
+        if(std::none_of(status_values.begin(), status_values.end(), [](cl_int s) { return s == STATUS_RUNNING; }))
+        {
+            break;
+        }
+
+        // the lanes still running stop where the last launch left them
+        //
+        if(l.f_timeout != std::chrono::nanoseconds::zero()
+        && std::chrono::steady_clock::now() - started >= l.f_timeout)
+        {
+            for(auto & s : status_values)
+            {
+                if(s == STATUS_RUNNING)
+                {
+                    s = STATUS_TIMEOUT;
+                }
+            }
+            break;
+        }
+    }
+
+    std::vector<cl_int> pc_values(count);
+    std::vector<cl_int> acc_values(count);
+    std::vector<cl_int> overflow_values(count);
+    std::vector<cl_ulong> steps_values(count);
+    if(!read_buffer(f_queue, pc, pc_values)
+    || !read_buffer(f_queue, acc, acc_values)
+    || !read_buffer(f_queue, overflow, overflow_values)
+    || !read_buffer(f_queue, steps, steps_values))
+    {
+        return false;
+    }
+    for(std::size_t lane(0); lane < count; ++lane)
+    {
+        batch_job & job(jobs[lane]);
+        job.f_status = status_values[lane];
+        job.f_pc = pc_values[lane];
+        job.f_acc = acc_values[lane];
+        job.f_overflow = overflow_values[lane] != 0;
+        job.f_steps = steps_values[lane];
+    }
+    return true;
+}
+
+
+
+} // no name namespace
+
+
+
+bool run_offload(snapshot const & start, std::vector<batch_job> & jobs, limits const & l)
+{
+    auto const started(std::chrono::steady_clock::now());
+
+    device d;
+    if(!d.open())
+    {
+        return false;
+    }
+
+    // on failure, remove the outputs of the chunks which ran so the
+    // caller can run the jobs again some other way
+    //
+    std::vector<std::size_t> sizes;
+    for(auto const & job : jobs)
+    {
+        sizes.push_back(job.f_outputs.size());
+    }
+    for(std::size_t idx(0); idx < jobs.size(); idx += OFFLOAD_LANES)
+    {
+        std::size_t const count(std::min(OFFLOAD_LANES, jobs.size() - idx));
+        if(!d.run(start, jobs.data() + idx, count, l, started))
+        {
+            for(std::size_t j(0); j < jobs.size(); ++j)
+            {
+                jobs[j].f_outputs.resize(sizes[j]);
+            }
+            return false;
+        }
+    }
+    return true;
+}
+
+
+bool offload_supported()
+{
+    return true;
+}
+
+
+#else
+bool offload_supported()
+{
+    return false;
+}
+
+
+bool run_offload(snapshot const & start, std::vector<batch_job> & jobs, limits const & l)
+{
+    (void)start;
+    (void)jobs;
+    (void)l;
+    std::cerr << "warning: this build does not support OpenCL (see LMC_OPENCL in CMakeLists.txt)" << g_fallback;
+    return false;
+}
+#endif
+
+
+
+} // namespace lmc
+// vim: ts=4 sw=4 et
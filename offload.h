@@ -0,0 +1,55 @@
+// Written by Alexis Wilke based on
+// https://en.wikipedia.org/wiki/Little_man_computer
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Source: 
+// https://github.com/AlexisWilke/little-man-computer
+
+
+#pragma once
+
+#include    "batch.h"
+
+
+namespace lmc
+{
+
+
+
+// Run a batch on an OpenCL device (a GPU) with one work item per job.
+// The program is uploaded once and copied to the memory of each lane on
+// the device; the INP values of all the jobs go in one buffer and the
+// OUT values come back through a small buffer per lane, emptied between
+// kernel launches. Each launch runs up to OFFLOAD_SLICE steps per lane so
+// long batches do not block the device and the timeout can be checked.
+// The results are the same as with run_lockstep().
+//
+// Returns false, after printing the reason as a warning, when the build
+// has no OpenCL support (see LMC_OPENCL in CMakeLists.txt) or no device
+// can run it; the jobs did not run and the caller runs them with the
+// simd engine. offload_supported() tells whether the build has OpenCL.
+//
+constexpr std::size_t       OFFLOAD_LANES = 65536;          // jobs per upload
+constexpr std::uint32_t     OFFLOAD_OUTPUTS = 32;           // OUT buffered per lane and launch
+constexpr std::uint64_t     OFFLOAD_SLICE = 100'000;        // steps per lane and launch
+
+
+bool        offload_supported();
+bool        run_offload(snapshot const & start, std::vector<batch_job> & jobs, limits const & l);
+
+
+
+} // namespace lmc
+// vim: ts=4 sw=4 et
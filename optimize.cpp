@@ -0,0 +1,290 @@
+// Written by Alexis Wilke based on
+// https://en.wikipedia.org/wiki/Little_man_computer
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Source: 
+// https://github.com/AlexisWilke/little-man-computer
+
+
+#include    "optimize.h"
+
+#include    "analysis.h"
+
+#include    <algorithm>
+
+
+
+namespace lmc
+{
+
+
+namespace
+{
+
+
+
+constexpr std::uint64_t     FOLD_MAX_STEPS = 1'000'000;
+
+
+// the prefix can only be folded if it does not write anything
+//
+class count_output
+    : public output
+{
+public:
+    virtual void write(int value) override
+    {
+        static_cast<void>(value);
+        ++f_count;
+    }
+
+    std::uint64_t       f_count = 0;
+};
+
+
+mnemonic_t opcode(short cell)
+{
+    return cell >= 0 && cell < 1000 ? cell / 100 : MNEMONIC_NONE;
+}
+
+
+bool has_address(mnemonic_t instruction)
+{
+    return instruction >= MNEMONIC_ADD
+        && instruction <= MNEMONIC_BRP;
+}
+
+
+bool falls_through(short cell)
+{
+    mnemonic_t const instruction(cell / 100);
+    return instruction != MNEMONIC_HLT
+        && instruction != MNEMONIC_BRA;
+}
+
+
+// run the program from its current state until it needs an input; the
+// counters of the snapshot are kept as they were, the folded steps are
+// saved, not executed (a program which halts first is left alone, the
+// PC of a halted machine is past its HLT)
+//
+void fold_prefix(snapshot & s, optimize_report & r)
+{
+    std::vector<int> none;
+    vector_input in(none);
+    count_output out;
+    machine m(s.f_program, in, out);
+    m.restore(s);
+    limits l;
+    l.f_max_steps = s.f_steps + FOLD_MAX_STEPS;
+    m.set_limits(l);
+    status_t const status(m.run());
+    if(out.f_count != 0
+    || status != STATUS_NO_INPUT
+    || m.steps() == s.f_steps)
+    {
+        return;
+    }
+
+    r.f_steps_folded = m.steps() - s.f_steps;
+    snapshot folded;
+    m.save(folded);
+    folded.f_program.f_size = s.f_program.f_size;
+    folded.f_program.f_labels = std::move(s.f_program.f_labels);
+    folded.f_steps = s.f_steps;
+    folded.f_inputs = s.f_inputs;
+    folded.f_outputs = s.f_outputs;
+    s = std::move(folded);
+}
+
+
+
+} // no name namespace
+
+
+
+bool optimize(snapshot & s, bool fold, optimize_report & r)
+{
+    r = optimize_report();
+    program & p(s.f_program);
+    r.f_cells_before = p.f_size;
+    r.f_cells_after = p.f_size;
+
+    if(fold)
+    {
+        fold_prefix(s, r);
+    }
+
+    analysis a;
+    analyze(p.f_cells, a, s.f_pc);
+    if(a.f_self_modifying)
+    {
+        r.f_not_moved = "the program modifies its code";
+        return true;
+    }
+
+    bool remove[MEMORY_SIZE] = {};
+    int unreachable(0);
+    int loads(0);
+    for(int pc(0); pc < static_cast<int>(MEMORY_SIZE); ++pc)
+    {
+        if(a.f_kind[pc] == CELL_UNUSED)
+        {
+            remove[pc] = true;
+            if(pc < p.f_size)
+            {
+                ++unreachable;
+            }
+        }
+    }
+
+    // STA X followed by LDA X: the accumulator already holds X; the last
+    // cell is kept since it falls through to 0
+    //
+    for(int pc(0); pc + 2 < static_cast<int>(MEMORY_SIZE); ++pc)
+    {
+        short const cell(p.f_cells[pc]);
+        if(a.f_kind[pc] == CELL_CODE
+        && a.f_kind[pc + 1] == CELL_CODE
+        && opcode(cell) == MNEMONIC_STA
+        && p.f_cells[pc + 1] == MNEMONIC_LDA * 100 + cell % 100
+        && !a.f_target[pc + 1]
+        && pc + 1 != s.f_pc)
+        {
+            remove[pc + 1] = true;
+            ++loads;
+        }
+    }
+    if(unreachable == 0
+    && loads == 0)
+    {
+        return true;
+    }
+
+    // the new address of each cell; a removed cell gets the address of
+    // the next cell which stays
+    //
+    int moved[MEMORY_SIZE + 1];
+    int kept(0);
+    for(std::size_t pc(0); pc < MEMORY_SIZE; ++pc)
+    {
+        moved[pc] = kept;
+        if(!remove[pc])
+        {
+            ++kept;
+        }
+    }
+    moved[MEMORY_SIZE] = kept;
+
+    for(std::size_t pc(0); pc < MEMORY_SIZE; ++pc)
+    {
+        if(a.f_kind[pc] != CELL_CODE)
+        {
+            continue;
+        }
+        short const cell(p.f_cells[pc]);
+        mnemonic_t const instruction(opcode(cell));
+        if((instruction == MNEMONIC_ADD
+                || instruction == MNEMONIC_SUB
+                || instruction == MNEMONIC_LDA)
+        && a.f_kind[cell % 100] == CELL_CODE)
+        {
+            r.f_not_moved = "a code cell is read as data";
+            return true;
+        }
+        if(falls_through(cell))
+        {
+            std::size_t const next(pc + 1 == MEMORY_SIZE ? 0 : pc + 1);
+            int const expected(remove[pc] ? moved[pc] : (moved[pc] + 1) % static_cast<int>(MEMORY_SIZE));
+            if(moved[next] != expected)
+            {
+                r.f_not_moved = "the code falls through the last cell";
+                return true;
+            }
+        }
+    }
+
+    short cells[MEMORY_SIZE] = {};
+    for(std::size_t pc(0); pc < MEMORY_SIZE; ++pc)
+    {
+        if(remove[pc])
+        {
+            continue;
+        }
+        short cell(p.f_cells[pc]);
+        mnemonic_t const instruction(opcode(cell));
+        if(a.f_kind[pc] == CELL_CODE
+        && has_address(instruction))
+        {
+            cell = instruction * 100 + moved[cell % 100];
+        }
+        cells[moved[pc]] = cell;
+    }
+    std::copy(cells, cells + MEMORY_SIZE, p.f_cells);
+    for(auto it(p.f_labels.begin()); it != p.f_labels.end(); )
+    {
+        int const loc(it->second);
+        if(loc >= 0
+        && loc < static_cast<int>(MEMORY_SIZE)
+        && remove[loc])
+        {
+            it = p.f_labels.erase(it);
+            continue;
+        }
+        if(loc >= 0
+        && loc <= static_cast<int>(MEMORY_SIZE))
+        {
+            it->second = moved[loc];
+        }
+        ++it;
+    }
+    p.f_size = moved[std::min(p.f_size, static_cast<int>(MEMORY_SIZE))];
+    for(std::size_t pc(p.f_size); pc < MEMORY_SIZE; ++pc)
+    {
+        if(cells[pc] != 0)
+        {
+            p.f_size = pc + 1;
+        }
+    }
+    s.f_pc = moved[s.f_pc];
+
+    r.f_unreachable = unreachable;
+    r.f_redundant_loads = loads;
+    r.f_cells_after = p.f_size;
+    return true;
+}
+
+
+void print_report(optimize_report const & r, std::ostream & out)
+{
+    out << "optimizer: " << r.f_cells_before << " -> " << r.f_cells_after << " cells ("
+        << r.f_unreachable << " unreachable, "
+        << r.f_redundant_loads << " redundant LDA), "
+        << r.f_steps_folded << " steps run at assembly time";
+    if(r.f_redundant_loads != 0)
+    {
+        out << ", 1 step saved each time a removed LDA would have run";
+    }
+    out << ".\n";
+    if(r.f_not_moved != nullptr)
+    {
+        out << "optimizer: cells not moved, " << r.f_not_moved << ".\n";
+    }
+}
+
+
+
+} // namespace lmc
+// vim: ts=4 sw=4 et
@@ -0,0 +1,73 @@
+// Written by Alexis Wilke based on
+// https://en.wikipedia.org/wiki/Little_man_computer
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Source: 
+// https://github.com/AlexisWilke/little-man-computer
+
+
+#pragma once
+
+#include    "machine.h"
+
+#include    <iostream>
+
+
+namespace lmc
+{
+
+
+
+// what optimize() changed; f_steps_folded were run at assembly time and
+// each removed LDA saves one step every time the program reaches it
+//
+struct optimize_report
+{
+    std::uint64_t       f_steps_folded = 0;
+    int                 f_redundant_loads = 0;
+    int                 f_unreachable = 0;
+    int                 f_cells_before = 0;
+    int                 f_cells_after = 0;
+    char const *        f_not_moved = nullptr;      // why the cells stayed in place
+};
+
+
+// Rewrite the starting state of a program so it runs the same with fewer
+// steps and cells:
+//
+// 1. fold: the instructions before the first INP do not depend on the
+//    input so, if they do not OUT, they run here (up to 1,000,000 steps)
+//    and the state starts on that INP; every loop with a trip count known
+//    at assembly time gets executed that way (skipped when fold is false,
+//    i.e. when the result must start at 0 like -c)
+//
+// 2. an LDA of the cell which the STA just before it wrote is removed;
+//    the two must be in the same basic block (the LDA is not a target)
+//
+// 3. the cells which the analysis found unused are removed
+//
+// Steps 2 and 3 move cells so they are only done when the analysis
+// proves that nothing depends on the addresses: no self-modifying code,
+// no code cell read as data, and no fall through which would end on a
+// different cell. The addresses of the instructions and labels get
+// updated.
+//
+bool        optimize(snapshot & s, bool fold, optimize_report & r);
+void        print_report(optimize_report const & r, std::ostream & out);
+
+
+
+} // namespace lmc
+// vim: ts=4 sw=4 et
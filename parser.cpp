@@ -0,0 +1,793 @@
+// Written by Alexis Wilke based on
+// https://en.wikipedia.org/wiki/Little_man_computer
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Source: 
+// https://github.com/AlexisWilke/little-man-computer
+
+
+#include    "parser.h"
+
+#include    "linker.h"
+
+#include    <algorithm>
+#include    <cstdint>
+#include    <fstream>
+#include    <iostream>
+#include    <stdexcept>
+#include    <string_view>
+
+
+
+namespace lmc
+{
+
+
+
+diagnostics::message::message(int line, std::string const & msg)
+    : f_line(line)
+    , f_message(msg)
+{
+}
+
+
+// the list is allocated once for the first errors
+//
+diagnostics::diagnostics(std::size_t max_errors)
+    : f_max_errors(max_errors)
+{
+    f_messages.reserve(max_errors == 0 || max_errors > 64 ? 64 : max_errors);
+}
+
+
+void diagnostics::error(int line, std::string const & msg)
+{
+    if(!full())
+    {
+        f_messages.emplace_back(line, msg);
+    }
+}
+
+
+int diagnostics::error_count() const
+{
+    return f_messages.size();
+}
+
+
+bool diagnostics::full() const
+{
+    return f_max_errors != 0
+        && f_messages.size() >= f_max_errors;
+}
+
+
+std::vector<diagnostics::message> const & diagnostics::messages() const
+{
+    return f_messages;
+}
+
+
+// the label errors are found after all the lines were read so the
+// messages get sorted first; the text is written in one go
+//
+void diagnostics::print(std::ostream & out, std::string const & filename) const
+{
+    if(f_messages.empty())
+    {
+        return;
+    }
+
+    std::vector<message const *> sorted;
+    sorted.reserve(f_messages.size());
+    for(auto const & m : f_messages)
+    {
+        sorted.push_back(&m);
+    }
+    std::stable_sort(
+          sorted.begin()
+        , sorted.end()
+        , [](message const * a, message const * b) { return a->f_line < b->f_line; });
+
+    std::string text;
+    for(auto const * m : sorted)
+    {
+        text += "error:";
+        text += filename;
+        text += ':';
+        text += std::to_string(m->f_line);
+        text += ": ";
+        text += m->f_message;
+        text += '\n';
+    }
+    text += "found ";
+    text += std::to_string(f_messages.size());
+    text += full() ? " errors, stopped.\n" : " errors.\n";
+    out.write(text.data(), text.size());
+}
+
+
+
+namespace
+{
+
+
+
+// the labels are saved in a flat open addressing table; the names are
+// views in the source buffer so no allocation happens while parsing a
+// program of 100 cells (the extended programs allocate a larger table
+// once, its size being a power of two at least twice the memory size)
+//
+constexpr std::size_t   LABEL_TABLE_SIZE = 256;
+constexpr std::size_t   MAX_WORDS = 4;
+
+
+struct label_t
+{
+    std::string_view    f_name = std::string_view();
+    int                 f_pc = -1;
+};
+
+
+// the label used by a cell and the line where it was used, so errors
+// found once all the labels are known point to the right line
+//
+struct label_use
+{
+    std::string_view    f_name = std::string_view();
+    int                 f_line = 0;
+};
+
+
+class label_table
+{
+public:
+    label_table(label_t * labels, std::size_t size)
+        : f_labels(labels)
+        , f_size(size)
+    {
+    }
+
+    // return nullptr when the table is full
+    //
+    label_t * find(std::string_view const & name, bool create)
+    {
+        std::uint32_t h(2166136261U);
+        for(auto const & c : name)
+        {
+            h = (h ^ static_cast<unsigned char>(c)) * 16777619U;
+        }
+        for(std::size_t probe(0); probe < f_size; ++probe)
+        {
+            label_t & l(f_labels[(h + probe) & (f_size - 1)]);
+            if(l.f_pc == -1)
+            {
+                if(!create)
+                {
+                    return nullptr;
+                }
+                l.f_name = name;
+                return &l;
+            }
+            if(l.f_name == name)
+            {
+                return &l;
+            }
+        }
+        return nullptr;
+    }
+
+    void export_labels(std::map<std::string, int> & labels) const
+    {
+        for(std::size_t idx(0); idx < f_size; ++idx)
+        {
+            label_t const & l(f_labels[idx]);
+            if(l.f_pc != -1)
+            {
+                labels[std::string(l.f_name)] = l.f_pc;
+            }
+        }
+    }
+
+private:
+    label_t *           f_labels = nullptr;
+    std::size_t         f_size = 0;
+};
+
+
+bool is_comment(char c)
+{
+    return c == '#' || c == '/' || c == ';';
+}
+
+
+// split one line in words; only the first MAX_WORDS are kept, a return
+// value of MAX_WORDS means "that many or more"
+//
+std::size_t split(std::string_view const & input, std::string_view (&words)[MAX_WORDS])
+{
+    std::size_t count(0);
+    char const * s(input.data());
+    char const * const e(s + input.length());
+    for(;;)
+    {
+        while(s < e && isspace(*s))
+        {
+            ++s;
+        }
+        if(s >= e || is_comment(*s))
+        {
+            return count;
+        }
+        char const * w(s);
+        while(s < e && !isspace(*s) && !is_comment(*s))
+        {
+            ++s;
+        }
+        words[count] = std::string_view(w, s - w);
+        ++count;
+        if(count >= MAX_WORDS)
+        {
+            return count;
+        }
+    }
+}
+
+
+constexpr std::uint32_t pack(char a, char b, char c)
+{
+    return (static_cast<std::uint32_t>(static_cast<unsigned char>(a)) << 16)
+         | (static_cast<std::uint32_t>(static_cast<unsigned char>(b)) << 8)
+         | static_cast<std::uint32_t>(static_cast<unsigned char>(c));
+}
+
+
+// all the mnemonics are 3 letters; convert the word to uppercase and pack
+// it in one integer which we can then compare in a single switch()
+//
+mnemonic_t is_mnemonic(std::string_view const & word)
+{
+    if(word.length() != 3)
+    {
+        return MNEMONIC_NONE;
+    }
+    auto const upper = [](char c)
+    {
+        return c >= 'a' && c <= 'z' ? static_cast<char>(c - 0x20) : c;
+    };
+    switch(pack(upper(word[0]), upper(word[1]), upper(word[2])))
+    {
+    case pack('H', 'L', 'T'):
+        return MNEMONIC_HLT;
+
+    case pack('A', 'D', 'D'):
+        return MNEMONIC_ADD;
+
+    case pack('S', 'U', 'B'):
+        return MNEMONIC_SUB;
+
+    case pack('S', 'T', 'A'):
+        return MNEMONIC_STA;
+
+    case pack('L', 'D', 'A'):
+        return MNEMONIC_LDA;
+
+    case pack('B', 'R', 'A'):
+        return MNEMONIC_BRA;
+
+    case pack('B', 'R', 'Z'):
+        return MNEMONIC_BRZ;
+
+    case pack('B', 'R', 'P'):
+        return MNEMONIC_BRP;
+
+    case pack('I', 'N', 'P'):
+        return MNEMONIC_INP;
+
+    case pack('O', 'U', 'T'):
+        return MNEMONIC_OUT;
+
+    case pack('D', 'A', 'T'):
+        return MNEMONIC_DAT;
+
+    }
+
+    return MNEMONIC_NONE;
+}
+
+
+// same as atoi() without the need for a null terminated string
+//
+int to_int(std::string_view const & word)
+{
+    std::size_t pos(0);
+    while(pos < word.length() && isspace(word[pos]))
+    {
+        ++pos;
+    }
+    bool negative(false);
+    if(pos < word.length() && (word[pos] == '-' || word[pos] == '+'))
+    {
+        negative = word[pos] == '-';
+        ++pos;
+    }
+    int value(0);
+    for(; pos < word.length() && word[pos] >= '0' && word[pos] <= '9'; ++pos)
+    {
+        if(value < 1'000'000)
+        {
+            value = value * 10 + word[pos] - '0';
+        }
+    }
+    return negative ? -value : value;
+}
+
+
+// the assembler proper, shared by the normal and extended programs; an
+// instruction is its mnemonic times the memory size plus the address so
+// with 100 cells, "ADD 5" is 105 and with 1,000 cells it is 1005
+//
+// label_ref must have memory_size entries, the table a power of two;
+// once d is full (see diagnostics::full()) the function stops right away;
+// when assembling a unit, the references to labels are saved in `refs`
+// so the linker can relocate them and a label not defined in the unit
+// is not an error
+//
+template<typename CELL>
+bool assemble_cells(
+          std::string_view const & text
+        , CELL * cells
+        , int memory_size
+        , int & size
+        , label_use * label_ref
+        , label_table & label_pc
+        , std::map<std::string, int> & labels
+        , std::vector<reference> * refs
+        , diagnostics & d)
+{
+    int const max_value(memory_size * 10);
+    int line(0);
+    std::size_t pos(0);
+    while(pos < text.length())
+    {
+        if(d.full())
+        {
+            return false;
+        }
+        std::size_t end(text.find('\n', pos));
+        if(end == std::string_view::npos)
+        {
+            end = text.length();
+        }
+        std::string_view const input(text.substr(pos, end - pos));
+        pos = end + 1;
+
+        ++line;
+        std::string_view words[MAX_WORDS];
+        std::size_t const word_count(split(input, words));
+        if(word_count == 0)
+        {
+            continue;
+        }
+
+        std::string_view parameter;
+        mnemonic_t instruction(is_mnemonic(words[0]));
+        if(instruction != MNEMONIC_NONE)
+        {
+            if(word_count > 2)
+            {
+                d.error(line, "more than two words on the line is not legal.");
+                continue;
+            }
+
+            // no label
+            //
+            if(word_count == 2)
+            {
+                parameter = words[1];
+            }
+        }
+        else if(word_count < 2)
+        {
+            d.error(line, "a word by itself, which is not a mnemonic, is not legal.");
+            continue;
+        }
+        else
+        {
+            instruction = is_mnemonic(words[1]);
+            if(instruction == MNEMONIC_NONE)
+            {
+                d.error(line, "a label must be followed by a mnemonic.");
+                continue;
+            }
+
+            // we have a label -- save its position
+            //
+            label_t * const label(label_pc.find(words[0], true));
+            if(label == nullptr)
+            {
+                d.error(line, "too many labels.");
+                continue;
+            }
+            label->f_pc = size;
+
+            if(word_count == 3)
+            {
+                parameter = words[2];
+            }
+            else if(word_count > 3)
+            {
+                d.error(line, "a mnemonic can be followed by at most one parameter.");
+                continue;
+            }
+        }
+
+        if(size >= memory_size)
+        {
+            d.error(line, "program too long; limit is "
+                + std::to_string(memory_size) + " instructions/data.");
+            continue;
+        }
+
+        switch(instruction)
+        {
+        case MNEMONIC_NONE:
+            throw std::logic_error("instruction still undefined.");
+
+        case MNEMONIC_HLT:
+            if(!parameter.empty())
+            {
+                d.error(line, "the HTL instruction does not accept a parameter.");
+            }
+            else
+            {
+                cells[size] = 0;
+                ++size;
+            }
+            break;
+
+        case MNEMONIC_ADD:
+            if(parameter.empty())
+            {
+                d.error(line, "the ADD instruction requires a parameter (label reference).");
+            }
+            else
+            {
+                cells[size] = MNEMONIC_ADD * memory_size;
+                label_ref[size] = label_use{ parameter, line };
+                ++size;
+            }
+            break;
+
+        case MNEMONIC_SUB:
+            if(parameter.empty())
+            {
+                d.error(line, "the SUB instruction requires a parameter (label reference).");
+            }
+            else
+            {
+                cells[size] = MNEMONIC_SUB * memory_size;
+                label_ref[size] = label_use{ parameter, line };
+                ++size;
+            }
+            break;
+
+        case MNEMONIC_STA:
+            if(parameter.empty())
+            {
+                d.error(line, "the STA instruction requires a parameter (label reference).");
+            }
+            else
+            {
+                cells[size] = MNEMONIC_STA * memory_size;
+                label_ref[size] = label_use{ parameter, line };
+                ++size;
+            }
+            break;
+
+        case MNEMONIC_LDA:
+            if(parameter.empty())
+            {
+                d.error(line, "the LDA instruction requires a parameter (label reference).");
+            }
+            else
+            {
+                cells[size] = MNEMONIC_LDA * memory_size;
+                label_ref[size] = label_use{ parameter, line };
+                ++size;
+            }
+            break;
+
+        case MNEMONIC_BRA:
+            if(parameter.empty())
+            {
+                d.error(line, "the BRA instruction requires a parameter (label reference).");
+            }
+            else
+            {
+                cells[size] = MNEMONIC_BRA * memory_size;
+                label_ref[size] = label_use{ parameter, line };
+                ++size;
+            }
+            break;
+
+        case MNEMONIC_BRZ:
+            if(parameter.empty())
+            {
+                d.error(line, "the BRZ instruction requires a parameter (label reference).");
+            }
+            else
+            {
+                cells[size] = MNEMONIC_BRZ * memory_size;
+                label_ref[size] = label_use{ parameter, line };
+                ++size;
+            }
+            break;
+
+        case MNEMONIC_BRP:
+            if(parameter.empty())
+            {
+                d.error(line, "the BRP instruction requires a parameter (label reference).");
+            }
+            else
+            {
+                cells[size] = MNEMONIC_BRP * memory_size;
+                label_ref[size] = label_use{ parameter, line };
+                ++size;
+            }
+            break;
+
+        case MNEMONIC_INP:
+            if(!parameter.empty())
+            {
+                d.error(line, "the INP instruction does not accept a parameter.");
+            }
+            else
+            {
+                cells[size] = MNEMONIC_INP * memory_size;
+                ++size;
+            }
+            break;
+
+        case MNEMONIC_OUT:
+            if(!parameter.empty())
+            {
+                d.error(line, "the OUT instruction does not accept a parameter.");
+            }
+            else
+            {
+                cells[size] = MNEMONIC_OUT * memory_size;
+                ++size;
+            }
+            break;
+
+        case MNEMONIC_DAT:
+            if(parameter.empty())
+            {
+                cells[size] = 0;
+                ++size;
+            }
+            else
+            {
+                int const value(to_int(parameter));
+                if(value >= max_value)
+                {
+                    d.error(line, "DAT supports numbers between 0 and "
+                        + std::to_string(max_value - 1) + ".");
+                }
+                else
+                {
+                    cells[size] = value;
+                    ++size;
+                }
+            }
+            break;
+
+        }
+    }
+
+    // second pass to enter the label positions
+    //
+    for(int ref(0); ref < memory_size; ++ref)
+    {
+        if(d.full())
+        {
+            return false;
+        }
+        label_use const & use(label_ref[ref]);
+        std::string_view const & name(use.f_name);
+        if(name.empty())
+        {
+            continue;
+        }
+        int number(0);
+        for(auto const & c : name)
+        {
+            if(c >= '0' && c <= '9')
+            {
+                if(number < max_value)
+                {
+                    number = number * 10 + c - '0';
+                }
+            }
+            else
+            {
+                number = -1;
+                break;
+            }
+        }
+        if(number != -1)
+        {
+            if(number >= max_value)
+            {
+                d.error(use.f_line, "label \"" + std::string(name) + "\" is too large a number.");
+                continue;
+            }
+            cells[ref] += number;
+        }
+        else
+        {
+            label_t const * const f(label_pc.find(name, false));
+            if(f == nullptr)
+            {
+                if(refs != nullptr)
+                {
+                    refs->push_back(reference{ ref, false, std::string(name), use.f_line });
+                    continue;
+                }
+                d.error(use.f_line, "label \"" + std::string(name) + "\" was not found.");
+                continue;
+            }
+            if(refs != nullptr)
+            {
+                refs->push_back(reference{ ref, true, std::string(name), use.f_line });
+            }
+            if(f->f_pc >= memory_size)
+            {
+                d.error(use.f_line, "offset of label \"" + std::string(name)
+                    + "\" is too large (" + std::to_string(f->f_pc) + ").");
+            }
+            cells[ref] += f->f_pc;
+        }
+    }
+
+    if(d.error_count() != 0)
+    {
+        return false;
+    }
+
+    label_pc.export_labels(labels);
+
+    return true;
+}
+
+
+std::string read_source(std::istream & in)
+{
+    std::string source;
+    in.seekg(0, std::ios::end);
+    std::streamoff const length(in.tellg());
+    if(length > 0)
+    {
+        source.resize(length);
+        in.seekg(0, std::ios::beg);
+        in.read(source.data(), length);
+        source.resize(in.gcount());
+    }
+    else
+    {
+        in.clear();
+        char buf[64 * 1024];
+        while(in.read(buf, sizeof(buf)) || in.gcount() > 0)
+        {
+            source.append(buf, in.gcount());
+        }
+    }
+    return source;
+}
+
+
+
+} // no name namespace
+
+
+
+bool assemble(std::string_view const & text, program & p, diagnostics & d)
+{
+    label_t labels[LABEL_TABLE_SIZE];
+    label_table label_pc(labels, LABEL_TABLE_SIZE);
+    label_use label_ref[MEMORY_SIZE];
+    return assemble_cells(text, p.f_cells, MEMORY_SIZE, p.f_size, label_ref, label_pc, p.f_labels, nullptr, d);
+}
+
+
+// p.f_memory_size must be set; the cells get allocated here
+//
+bool assemble(std::string_view const & text, extended_program & p, diagnostics & d)
+{
+    std::size_t table_size(LABEL_TABLE_SIZE);
+    while(table_size < p.f_memory_size * 2)
+    {
+        table_size *= 2;
+    }
+    std::vector<label_t> labels(table_size);
+    label_table label_pc(labels.data(), table_size);
+    std::vector<label_use> label_ref(p.f_memory_size);
+    p.f_cells.assign(p.f_memory_size, 0);
+    return assemble_cells(text, p.f_cells.data(), static_cast<int>(p.f_memory_size), p.f_size, label_ref.data(), label_pc, p.f_labels, nullptr, d);
+}
+
+
+// the unit is assembled as if it were loaded at address 0, see link()
+//
+bool assemble(std::string_view const & text, object_unit & u, diagnostics & d)
+{
+    label_t labels[LABEL_TABLE_SIZE];
+    label_table label_pc(labels, LABEL_TABLE_SIZE);
+    label_use label_ref[MEMORY_SIZE];
+    u.f_program = program();
+    u.f_references.clear();
+    return assemble_cells(text, u.f_program.f_cells, MEMORY_SIZE, u.f_program.f_size, label_ref, label_pc, u.f_program.f_labels, &u.f_references, d);
+}
+
+
+// the stream is read in full first; when the stream is seekable (i.e. a
+// file) the buffer gets allocated once
+//
+bool assemble(std::istream & in, program & p, diagnostics & d)
+{
+    return assemble(std::string_view(read_source(in)), p, d);
+}
+
+
+bool parse(std::string const & filename, program & p, std::size_t max_errors)
+{
+    std::ifstream in;
+    in.open(filename, std::ios::binary);
+    if(!in.is_open())
+    {
+        std::cerr << "error: could not open \"" << filename
+            << "\" for reading.\n";
+        return false;
+    }
+
+    diagnostics d(max_errors);
+    bool const result(assemble(in, p, d));
+    d.print(std::cerr, filename);
+    return result;
+}
+
+
+bool parse(std::string const & filename, extended_program & p, std::size_t max_errors)
+{
+    std::ifstream in;
+    in.open(filename, std::ios::binary);
+    if(!in.is_open())
+    {
+        std::cerr << "error: could not open \"" << filename
+            << "\" for reading.\n";
+        return false;
+    }
+
+    diagnostics d(max_errors);
+    bool const result(assemble(std::string_view(read_source(in)), p, d));
+    d.print(std::cerr, filename);
+    return result;
+}
+
+
+
+} // namespace lmc
+// vim: ts=4 sw=4 et
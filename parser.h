@@ -0,0 +1,91 @@
+// Written by Alexis Wilke based on
+// https://en.wikipedia.org/wiki/Little_man_computer
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Source: 
+// https://github.com/AlexisWilke/little-man-computer
+
+
+#pragma once
+
+#include    "program.h"
+
+#include    <iostream>
+#include    <string_view>
+#include    <vector>
+
+
+namespace lmc
+{
+
+
+
+// the errors found while assembling a program; they get printed all at
+// once, sorted by line; with a maximum, the errors past that number are
+// dropped and the assembler stops as soon as full() returns true
+//
+class diagnostics
+{
+public:
+    struct message
+    {
+                        message(int line, std::string const & msg);
+
+        int             f_line = 0;
+        std::string     f_message = std::string();
+    };
+
+                        diagnostics(std::size_t max_errors = 0);
+
+    void                error(int line, std::string const & msg);
+    int                 error_count() const;
+    bool                full() const;
+    std::vector<message> const &
+                        messages() const;
+    void                print(std::ostream & out, std::string const & filename) const;
+
+private:
+    std::size_t         f_max_errors = 0;       // 0 = no limit
+    std::vector<message>
+                        f_messages = {};
+};
+
+
+// assemble from memory; p is expected to be a new program object and the
+// function returns false if any error was added to d
+//
+bool        assemble(std::string_view const & source, program & p, diagnostics & d);
+bool        assemble(std::istream & in, program & p, diagnostics & d);
+
+// one file of a program made of several files (see link())
+//
+struct object_unit;
+
+bool        assemble(std::string_view const & source, object_unit & u, diagnostics & d);
+
+// p.f_memory_size must be set to a valid size (see is_memory_size())
+//
+bool        assemble(std::string_view const & source, extended_program & p, diagnostics & d);
+
+// assemble a file and print the errors, if any, to std::cerr; stop after
+// max_errors errors (0 = no limit)
+//
+bool        parse(std::string const & filename, program & p, std::size_t max_errors = 0);
+bool        parse(std::string const & filename, extended_program & p, std::size_t max_errors = 0);
+
+
+
+} // namespace lmc
+// vim: ts=4 sw=4 et
@@ -0,0 +1,97 @@
+// Written by Alexis Wilke based on
+// https://en.wikipedia.org/wiki/Little_man_computer
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Source: 
+// https://github.com/AlexisWilke/little-man-computer
+
+
+#include    "profile.h"
+
+#include    <algorithm>
+#include    <iomanip>
+#include    <sstream>
+#include    <vector>
+
+
+
+namespace lmc
+{
+
+
+
+// print the hot spots, most executed mailbox first; the cells which were
+// only written to (STA targets, i.e. variables) come last
+//
+void profile::print(program const & p, std::ostream & out) const
+{
+    std::uint64_t total(0);
+    std::vector<int> cells;
+    for(std::size_t pc(0); pc < MEMORY_SIZE; ++pc)
+    {
+        total += f_executed[pc];
+        if(f_executed[pc] != 0 || f_stores[pc] != 0)
+        {
+            cells.push_back(pc);
+        }
+    }
+    std::stable_sort(
+              cells.begin()
+            , cells.end()
+            , [this](int a, int b)
+            {
+                return f_executed[a] > f_executed[b];
+            });
+
+    out << "address label        instruction          executed      %       taken   not taken      stores\n";
+    for(auto const pc : cells)
+    {
+        // a cell which never ran is presented as data
+        //
+        std::ostringstream line;
+        line << std::right << std::setw(7) << pc
+            << ' ' << std::left << std::setw(12) << label_name(p, pc)
+            << ' ' << std::setw(20)
+            << (f_executed[pc] == 0
+                    ? "DAT " + std::to_string(p.f_cells[pc])
+                    : disassemble(p, p.f_cells[pc]))
+            << std::right << std::setw(9) << f_executed[pc]
+            << std::fixed << std::setprecision(2) << std::setw(7)
+            << (total == 0 ? 0.0 : f_executed[pc] * 100.0 / total);
+        int const instruction(p.f_cells[pc] / 100);
+        if(f_executed[pc] != 0
+        && (instruction == MNEMONIC_BRZ || instruction == MNEMONIC_BRP))
+        {
+            line << std::setw(12) << f_taken[pc]
+                << std::setw(12) << f_not_taken[pc];
+        }
+        else
+        {
+            line << std::setw(24) << "";
+        }
+        if(f_stores[pc] != 0)
+        {
+            line << std::setw(12) << f_stores[pc];
+        }
+        std::string const str(line.str());
+        out << str.substr(0, str.find_last_not_of(' ') + 1) << '\n';
+    }
+    out << "total instructions: " << total << '\n';
+}
+
+
+
+} // namespace lmc
+// vim: ts=4 sw=4 et
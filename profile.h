@@ -0,0 +1,58 @@
+// Written by Alexis Wilke based on
+// https://en.wikipedia.org/wiki/Little_man_computer
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Source: 
+// https://github.com/AlexisWilke/little-man-computer
+
+
+#pragma once
+
+#include    "program.h"
+
+#include    <cstdint>
+#include    <iostream>
+
+
+namespace lmc
+{
+
+
+
+// Per mailbox counters filled by the engines when a profile is attached
+// to a machine (see machine::set_profile()); the hooks are inline so the
+// cost is one increment per counter
+//
+class profile
+{
+public:
+    void                on_step(int pc) { ++f_executed[pc]; }
+    void                on_branch(int pc, bool taken) { ++(taken ? f_taken : f_not_taken)[pc]; }
+    void                on_store(int loc) { ++f_stores[loc]; }
+    void                on_executed(int pc, short cell, int acc, bool overflow) { (void)pc; (void)cell; (void)acc; (void)overflow; }
+
+    void                print(program const & p, std::ostream & out) const;
+
+private:
+    std::uint64_t       f_executed[MEMORY_SIZE] = {};
+    std::uint64_t       f_taken[MEMORY_SIZE] = {};
+    std::uint64_t       f_not_taken[MEMORY_SIZE] = {};
+    std::uint64_t       f_stores[MEMORY_SIZE] = {};
+};
+
+
+
+} // namespace lmc
+// vim: ts=4 sw=4 et
@@ -0,0 +1,143 @@
+// Written by Alexis Wilke based on
+// https://en.wikipedia.org/wiki/Little_man_computer
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Source: 
+// https://github.com/AlexisWilke/little-man-computer
+
+
+#include    "program.h"
+
+#include    <iterator>
+
+
+
+namespace lmc
+{
+
+
+
+namespace
+{
+
+
+
+char const * const g_mnemonic_names[] =
+{
+    "HLT",
+    "ADD",
+    "SUB",
+    "STA",
+    "LDA",
+    "BRA",
+    "BRZ",
+    "BRP",
+    "INP",
+    "OUT",
+    "DAT",
+};
+
+static_assert(std::size(g_mnemonic_names) == MNEMONIC_DAT + 1);
+
+
+
+} // no name namespace
+
+
+
+// the extended memory sizes are 100, 1,000, 10,000 and 100,000 mailboxes
+//
+bool is_memory_size(std::size_t size)
+{
+    for(std::size_t valid(MEMORY_SIZE); valid <= MAX_MEMORY_SIZE; valid *= 10)
+    {
+        if(size == valid)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+char const * mnemonic_name(mnemonic_t m)
+{
+    if(m < MNEMONIC_HLT || m > MNEMONIC_DAT)
+    {
+        return "???";
+    }
+    return g_mnemonic_names[m];
+}
+
+
+// the label defined at that address, an empty string if none
+//
+std::string label_name(program const & p, int pc)
+{
+    for(auto const & l : p.f_labels)
+    {
+        if(l.second == pc)
+        {
+            return l.first;
+        }
+    }
+    return std::string();
+}
+
+
+// the cell as the engines interpret it; the operand is shown as a label
+// when one exists at that address
+//
+std::string disassemble(program const & p, short cell)
+{
+    int const instruction(cell / 100);
+    if(cell < 0 || instruction > MNEMONIC_OUT)
+    {
+        return "DAT " + std::to_string(cell);
+    }
+    std::string result(mnemonic_name(instruction));
+    switch(instruction)
+    {
+    case MNEMONIC_HLT:
+        if(cell != 0)
+        {
+            return "DAT " + std::to_string(cell);
+        }
+        break;
+
+    case MNEMONIC_INP:
+    case MNEMONIC_OUT:
+        if(cell % 100 != 0)
+        {
+            result += " (" + std::to_string(cell % 100) + ")";
+        }
+        break;
+
+    default:
+        {
+            std::string const name(label_name(p, cell % 100));
+            result += ' ';
+            result += name.empty() ? std::to_string(cell % 100) : name;
+        }
+        break;
+
+    }
+    return result;
+}
+
+
+
+} // namespace lmc
+// vim: ts=4 sw=4 et
@@ -0,0 +1,84 @@
+// Written by Alexis Wilke based on
+// https://en.wikipedia.org/wiki/Little_man_computer
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Source: 
+// https://github.com/AlexisWilke/little-man-computer
+
+
+#pragma once
+
+#include    <cstddef>
+#include    <map>
+#include    <string>
+#include    <vector>
+
+
+namespace lmc
+{
+
+
+typedef int mnemonic_t;
+
+constexpr mnemonic_t    MNEMONIC_NONE = -1;
+constexpr mnemonic_t    MNEMONIC_HLT = 0;
+constexpr mnemonic_t    MNEMONIC_ADD = 1;
+constexpr mnemonic_t    MNEMONIC_SUB = 2;
+constexpr mnemonic_t    MNEMONIC_STA = 3;
+constexpr mnemonic_t    MNEMONIC_LDA = 4;
+constexpr mnemonic_t    MNEMONIC_BRA = 5;
+constexpr mnemonic_t    MNEMONIC_BRZ = 6;
+constexpr mnemonic_t    MNEMONIC_BRP = 7;
+constexpr mnemonic_t    MNEMONIC_INP = 8;
+constexpr mnemonic_t    MNEMONIC_OUT = 9;
+constexpr mnemonic_t    MNEMONIC_DAT = 10;
+
+
+constexpr std::size_t   MEMORY_SIZE = 100;
+constexpr std::size_t   MAX_MEMORY_SIZE = 100'000;    // extended programs
+
+
+// the result of parse(); a machine gets initialized from such an image
+//
+struct program
+{
+    short                       f_cells[MEMORY_SIZE] = {};
+    int                         f_size = 0;
+    std::map<std::string, int>  f_labels = {};
+};
+
+
+// a program with more mailboxes (see extended_machine); the memory size
+// is a power of ten so with 10^n mailboxes an address has n digits and
+// a cell holds n + 1 digits, i.e. 0 to 9,999 with 1,000 mailboxes
+//
+struct extended_program
+{
+    std::size_t                 f_memory_size = MEMORY_SIZE;
+    std::vector<int>            f_cells = {};
+    int                         f_size = 0;
+    std::map<std::string, int>  f_labels = {};
+};
+
+
+bool                is_memory_size(std::size_t size);
+char const *        mnemonic_name(mnemonic_t m);
+std::string         label_name(program const & p, int pc);
+std::string         disassemble(program const & p, short cell);
+
+
+
+} // namespace lmc
+// vim: ts=4 sw=4 et
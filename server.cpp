@@ -0,0 +1,1232 @@
+// Written by Alexis Wilke based on
+// https://en.wikipedia.org/wiki/Little_man_computer
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Source: 
+// https://github.com/AlexisWilke/little-man-computer
+
+
+#include    "server.h"
+
+#include    "cache.h"
+#include    "image.h"
+#include    "metrics.h"
+#include    "parser.h"
+
+#include    <cerrno>
+#include    <condition_variable>
+#include    <cstdio>
+#include    <cstring>
+#include    <deque>
+#include    <list>
+#include    <memory>
+#include    <mutex>
+#include    <string_view>
+#include    <sstream>
+#include    <thread>
+#include    <unordered_map>
+
+#include    <fcntl.h>
+#include    <poll.h>
+#include    <signal.h>
+#include    <sys/socket.h>
+#include    <sys/un.h>
+#include    <unistd.h>
+
+
+
+namespace lmc
+{
+
+
+
+namespace
+{
+
+
+
+// a client sending more than this in one request is not sending a Little
+// Man Computer program or its inputs
+//
+constexpr std::size_t       MAX_REQUEST_SIZE = 1024 * 1024;
+
+
+// a client which lets more than this many bytes of answers pile up is not
+// reading them; its session ends
+//
+constexpr std::size_t       MAX_OUTPUT_SIZE = 16 * 1024 * 1024;
+
+
+// the number of sources remembered so sending the same one again does not
+// assemble it again; past that, the least recently used one is forgotten
+//
+constexpr std::size_t       MAX_SOURCES = 1024;
+
+
+// the number of programs (assembled sources and images) kept for RUN and
+// OPEN; past that, the least recently used one is forgotten, the jobs
+// already started keep their own reference to it
+//
+constexpr std::size_t       MAX_PROGRAMS = 1024;
+
+
+// FNV-1a, 64 bits
+//
+std::uint64_t fnv1a(std::string_view data)
+{
+    std::uint64_t h(14695981039346656037ULL);
+    for(auto const c : data)
+    {
+        h = (h ^ static_cast<unsigned char>(c)) * 1099511628211ULL;
+    }
+    return h;
+}
+
+
+// a source already assembled and the hash of its program; f_used is its
+// position in server::f_sources_used
+//
+struct source_entry
+{
+    std::string         f_source = std::string();
+    std::string         f_hash = std::string();
+    std::list<std::uint64_t>::iterator
+                        f_used = std::list<std::uint64_t>::iterator();
+};
+
+
+// a program by hash; f_used is its position in server::f_programs_used
+//
+struct program_entry
+{
+    std::shared_ptr<snapshot const>
+                        f_snapshot = std::shared_ptr<snapshot const>();
+    std::list<std::string>::iterator
+                        f_used = std::list<std::string>::iterator();
+};
+
+
+struct job;
+
+
+// the two ends of a session; with a socket both are the same descriptor
+// which gets closed with the connection
+//
+// Both ends are non-blocking. The answers are queued and written as far
+// as the client accepts them; the rest waits for the event loop to see
+// POLLOUT, so a client which does not read never blocks a thread. The
+// `wakeup` descriptor tells the event loop that the queue is not empty
+// anymore.
+//
+class connection
+{
+public:
+                        connection(int in, int out, bool owned, int wakeup);
+                        ~connection();
+
+    int                 fd() const;
+    int                 output_fd() const;
+    bool                receive();
+    std::string_view    pending() const;
+    void                consume(std::size_t size);
+    void                send(std::string const & data);
+    bool                has_output();
+    bool                flush();
+    bool                broken();
+
+    bool                add_job(std::shared_ptr<job> j);
+    std::shared_ptr<job>
+                        find_job(std::string const & id);
+    void                remove_job(job const * j);
+    std::vector<std::shared_ptr<job>>
+                        take_jobs();
+
+private:
+    void                write_output();
+
+    int                 f_in = -1;
+    int                 f_out = -1;
+    bool                f_owned = false;
+    int                 f_wakeup = -1;
+    int                 f_in_flags = 0;
+    int                 f_out_flags = 0;
+    std::string         f_received = std::string();
+    std::size_t         f_pos = 0;
+    std::mutex          f_send_mutex = std::mutex();    // protects f_output, f_output_pos and f_broken
+    std::string         f_output = std::string();
+    std::size_t         f_output_pos = 0;
+    bool                f_broken = false;
+    std::mutex          f_jobs_mutex = std::mutex();
+    std::unordered_map<std::string, std::shared_ptr<job>>
+                        f_jobs = {};
+};
+
+
+connection::connection(int in, int out, bool owned, int wakeup)
+    : f_in(in)
+    , f_out(out)
+    , f_owned(owned)
+    , f_wakeup(wakeup)
+    , f_in_flags(fcntl(in, F_GETFL))
+    , f_out_flags(fcntl(out, F_GETFL))
+{
+    fcntl(f_in, F_SETFL, f_in_flags | O_NONBLOCK);
+    fcntl(f_out, F_SETFL, f_out_flags | O_NONBLOCK);
+}
+
+
+// stdin and stdout get their flags back
+//
+connection::~connection()
+{
+    if(f_owned)
+    {
+        close(f_in);
+    }
+    else
+    {
+        fcntl(f_in, F_SETFL, f_in_flags);
+        fcntl(f_out, F_SETFL, f_out_flags);
+    }
+}
+
+
+int connection::fd() const
+{
+    return f_in;
+}
+
+
+int connection::output_fd() const
+{
+    return f_out;
+}
+
+
+// called once poll() said the input is ready; returns false when the
+// client is gone
+//
+bool connection::receive()
+{
+    if(f_pos > 0)
+    {
+        f_received.erase(0, f_pos);
+        f_pos = 0;
+    }
+    std::size_t const size(f_received.size());
+    f_received.resize(size + 64 * 1024);
+    ssize_t r(-1);
+    do
+    {
+        r = ::read(f_in, &f_received[size], 64 * 1024);
+    }
+    while(r < 0 && errno == EINTR);
+    f_received.resize(size + std::max(r, static_cast<ssize_t>(0)));
+    return r > 0
+        || (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK));
+}
+
+
+std::string_view connection::pending() const
+{
+    return std::string_view(f_received).substr(f_pos);
+}
+
+
+void connection::consume(std::size_t size)
+{
+    f_pos += size;
+}
+
+
+// answers come from the event loop and from any number of workers; each
+// send() queues its lines in full so they don't get mixed and writes what
+// the client accepts right away; once the client is gone, the remaining
+// answers are dropped
+//
+void connection::send(std::string const & data)
+{
+    bool wake(false);
+    {
+        std::lock_guard<std::mutex> lock(f_send_mutex);
+        if(f_broken)
+        {
+            return;
+        }
+        bool const was_empty(f_output_pos == f_output.size());
+        f_output += data;
+        write_output();
+        if(f_output.size() - f_output_pos > MAX_OUTPUT_SIZE)
+        {
+            f_broken = true;
+        }
+        wake = f_broken
+            || (was_empty && f_output_pos < f_output.size());
+    }
+
+    // the event loop now has to poll for POLLOUT (or end the session)
+    //
+    if(wake)
+    {
+        char const c('w');
+        while(::write(f_wakeup, &c, 1) < 0 && errno == EINTR);
+    }
+}
+
+
+bool connection::has_output()
+{
+    std::lock_guard<std::mutex> lock(f_send_mutex);
+    return !f_broken && f_output_pos < f_output.size();
+}
+
+
+bool connection::broken()
+{
+    std::lock_guard<std::mutex> lock(f_send_mutex);
+    return f_broken;
+}
+
+
+// called by the event loop once poll() said the output is ready; returns
+// false once the client is gone (or does not read its answers)
+//
+bool connection::flush()
+{
+    std::lock_guard<std::mutex> lock(f_send_mutex);
+    write_output();
+    return !f_broken;
+}
+
+
+// f_send_mutex must be locked
+//
+void connection::write_output()
+{
+    while(!f_broken
+       && f_output_pos < f_output.size())
+    {
+        ssize_t const r(::write(f_out, f_output.data() + f_output_pos, f_output.size() - f_output_pos));
+        if(r > 0)
+        {
+            f_output_pos += r;
+        }
+        else if(r < 0
+             && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            break;
+        }
+        else if(r < 0
+             && errno != EINTR)
+        {
+            f_broken = true;
+        }
+    }
+    if(f_broken
+    || f_output_pos == f_output.size())
+    {
+        f_output.clear();
+        f_output_pos = 0;
+    }
+    else if(f_output_pos >= 64 * 1024)
+    {
+        f_output.erase(0, f_output_pos);
+        f_output_pos = 0;
+    }
+}
+
+
+// the values are streamed back as the program outputs them, a few
+// kilobytes at a time
+//
+class reply_output
+    : public output
+{
+public:
+                        reply_output(connection & c, std::string const & id);
+
+    virtual void        write(int value) override;
+    virtual void        flush() override;
+
+private:
+    connection &        f_connection;
+    std::string const & f_id;
+    std::string         f_buffer = std::string();
+};
+
+
+reply_output::reply_output(connection & c, std::string const & id)
+    : f_connection(c)
+    , f_id(id)
+{
+}
+
+
+void reply_output::write(int value)
+{
+    f_buffer += "OUT ";
+    f_buffer += f_id;
+    f_buffer += ' ';
+    f_buffer += std::to_string(value);
+    f_buffer += '\n';
+    if(f_buffer.size() >= 4096)
+    {
+        flush();
+    }
+}
+
+
+void reply_output::flush()
+{
+    if(!f_buffer.empty())
+    {
+        f_connection.send(f_buffer);
+        f_buffer.clear();
+    }
+}
+
+
+// one RUN or OPEN; the job is the input of its machine so INP takes the
+// values sent with INPUT as they arrive
+//
+// f_running is true while the job is queued or executing; when false, the
+// machine is suspended on an INP and only a new INPUT or a CLOSE wakes it
+// up (f_mutex protects f_inputs, f_running and f_closed)
+//
+struct job
+    : public input
+{
+                        job(std::shared_ptr<connection> c, std::string const & id, std::shared_ptr<snapshot const> start, bool interactive);
+
+    virtual bool        read(int & value) override;
+
+    std::shared_ptr<connection>
+                        f_connection = std::shared_ptr<connection>();
+    std::string const   f_id = std::string();
+    std::shared_ptr<snapshot const>
+                        f_start = std::shared_ptr<snapshot const>();
+    bool const          f_interactive = false;
+    std::mutex          f_mutex = std::mutex();
+    std::deque<int>     f_inputs = {};
+    bool                f_running = true;
+    bool                f_closed = false;
+    reply_output        f_output;
+    machine             f_machine;
+};
+
+
+job::job(std::shared_ptr<connection> c, std::string const & id, std::shared_ptr<snapshot const> start, bool interactive)
+    : f_connection(c)
+    , f_id(id)
+    , f_start(start)
+    , f_interactive(interactive)
+    , f_output(*f_connection, f_id)
+    , f_machine(f_start->f_program, *this, f_output)
+{
+    f_machine.restore(*f_start);
+}
+
+
+bool job::read(int & value)
+{
+    std::lock_guard<std::mutex> lock(f_mutex);
+    if(f_inputs.empty())
+    {
+        return false;
+    }
+    value = f_inputs.front();
+    f_inputs.pop_front();
+    return true;
+}
+
+
+// an OPEN with an identifier already in use is refused
+//
+bool connection::add_job(std::shared_ptr<job> j)
+{
+    std::lock_guard<std::mutex> lock(f_jobs_mutex);
+    return f_jobs.emplace(j->f_id, j).second;
+}
+
+
+std::shared_ptr<job> connection::find_job(std::string const & id)
+{
+    std::lock_guard<std::mutex> lock(f_jobs_mutex);
+    auto const it(f_jobs.find(id));
+    if(it == f_jobs.end())
+    {
+        return std::shared_ptr<job>();
+    }
+    return it->second;
+}
+
+
+void connection::remove_job(job const * j)
+{
+    std::lock_guard<std::mutex> lock(f_jobs_mutex);
+    auto const it(f_jobs.find(j->f_id));
+    if(it != f_jobs.end()
+    && it->second.get() == j)
+    {
+        f_jobs.erase(it);
+    }
+}
+
+
+std::vector<std::shared_ptr<job>> connection::take_jobs()
+{
+    std::vector<std::shared_ptr<job>> result;
+    std::lock_guard<std::mutex> lock(f_jobs_mutex);
+    for(auto & j : f_jobs)
+    {
+        result.push_back(std::move(j.second));
+    }
+    f_jobs.clear();
+    return result;
+}
+
+
+char const * status_name(status_t status)
+{
+    switch(status)
+    {
+    case STATUS_HALTED:
+        return "halted";
+
+    case STATUS_NO_INPUT:
+        return "no-input";
+
+    case STATUS_STEP_LIMIT:
+        return "step-limit";
+
+    case STATUS_TIMEOUT:
+        return "timeout";
+
+    }
+    return "unknown";
+}
+
+
+// one thread, the event loop, polls the clients, reads their requests and
+// keeps the programs in the cache; the workers execute the jobs which
+// are ready to run, one machine at a time
+//
+class server
+{
+public:
+                        server(engine_t engine, limits const & l, int threads, metrics * stats);
+                        ~server();
+
+    int                 loop(int listener, bool use_stdio);
+
+private:
+    void                wake();
+
+    bool                process(std::shared_ptr<connection> const & c);
+    void                add_source(connection & c, std::string const & id, std::string const & source);
+    void                add_image(connection & c, std::string const & id, std::string const & image);
+    void                start(std::shared_ptr<connection> const & c, std::string const & id, std::istream & in, bool interactive);
+    void                resume(connection & c, std::string const & id, std::istream & in);
+    void                close_job(std::shared_ptr<job> const & j);
+    void                end_session(connection & c);
+
+    std::string         add_program(std::shared_ptr<snapshot const> s);
+    std::shared_ptr<snapshot const>
+                        find_program(std::string const & hash);
+    void                schedule(std::shared_ptr<job> j);
+    void                worker();
+    void                execute(std::shared_ptr<job> const & j, thread_metrics * counters);
+
+    engine_t            f_engine = ENGINE_SWITCH;
+    limits              f_limits = limits();
+    metrics *           f_metrics = nullptr;
+    thread_metrics *    f_loop_counters = nullptr;      // of the event loop
+
+    std::mutex          f_programs_mutex = std::mutex();
+    std::unordered_map<std::string, program_entry>
+                        f_programs = {};
+    std::list<std::string>
+                        f_programs_used = {};           // most recently used first
+    std::unordered_map<std::uint64_t, source_entry>
+                        f_sources = {};                 // by FNV-1a of the source
+    std::list<std::uint64_t>
+                        f_sources_used = {};            // most recently used first
+
+    std::mutex          f_queue_mutex = std::mutex();
+    std::condition_variable
+                        f_queue_cond = std::condition_variable();
+    std::deque<std::shared_ptr<job>>
+                        f_queue = {};
+    bool                f_quit = false;
+    std::vector<std::thread>
+                        f_workers = {};
+    int                 f_wakeup[2] = { -1, -1 };       // pipe waking up the event loop
+};
+
+
+// each run is a single job so the lock-step and gpu engines make no sense here
+//
+server::server(engine_t engine, limits const & l, int threads, metrics * stats)
+    : f_engine(engine == ENGINE_SIMD || engine == ENGINE_GPU ? ENGINE_THREADED : engine)
+    , f_limits(l)
+    , f_metrics(stats)
+{
+    if(pipe2(f_wakeup, O_NONBLOCK | O_CLOEXEC) != 0)
+    {
+        std::cerr << "error: could not create the wake up pipe.\n";
+    }
+    if(f_metrics != nullptr)
+    {
+        f_loop_counters = &f_metrics->add_thread();
+    }
+    if(threads <= 0)
+    {
+        threads = std::max(1U, std::thread::hardware_concurrency());
+    }
+    for(int idx(0); idx < threads; ++idx)
+    {
+        f_workers.emplace_back(&server::worker, this);
+    }
+}
+
+
+// the jobs still in the queue get executed before the workers exit
+//
+server::~server()
+{
+    {
+        std::lock_guard<std::mutex> lock(f_queue_mutex);
+        f_quit = true;
+    }
+    f_queue_cond.notify_all();
+    for(auto & w : f_workers)
+    {
+        w.join();
+    }
+    close(f_wakeup[0]);
+    close(f_wakeup[1]);
+}
+
+
+// the event loop reads the pipe empty each time it wakes up
+//
+void server::wake()
+{
+    char const c('w');
+    while(::write(f_wakeup[1], &c, 1) < 0 && errno == EINTR);
+}
+
+
+// a listener of -1 serves stdin and stdout only and returns once that
+// client is gone; otherwise the function only returns on errors
+//
+// Once its session ended, a client stays in the loop until its last jobs
+// are done and their answers written (or it stops reading them).
+//
+int server::loop(int listener, bool use_stdio)
+{
+    struct client
+    {
+        std::shared_ptr<connection> f_connection = std::shared_ptr<connection>();
+        bool                        f_reading = true;
+    };
+    std::vector<client> clients;
+    if(use_stdio)
+    {
+        clients.push_back(client{ std::make_shared<connection>(STDIN_FILENO, STDOUT_FILENO, false, f_wakeup[1]) });
+    }
+    std::vector<pollfd> fds;
+    while(listener >= 0
+       || !clients.empty())
+    {
+        // two entries per client, the input and the output; the entries
+        // not polled have an fd of -1
+        //
+        fds.clear();
+        for(auto const & cl : clients)
+        {
+            connection & c(*cl.f_connection);
+            fds.push_back(pollfd{ cl.f_reading ? c.fd() : -1, POLLIN, 0 });
+            fds.push_back(pollfd{ c.has_output() ? c.output_fd() : -1, POLLOUT, 0 });
+        }
+        fds.push_back(pollfd{ f_wakeup[0], POLLIN, 0 });
+        if(listener >= 0)
+        {
+            fds.push_back(pollfd{ listener, POLLIN, 0 });
+        }
+        if(poll(fds.data(), fds.size(), -1) < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            std::cerr << "error: poll() failed.\n";
+            return 1;
+        }
+
+        std::size_t const count(clients.size());
+        if(fds[count * 2].revents != 0)
+        {
+            char buf[256];
+            while(::read(f_wakeup[0], buf, sizeof(buf)) > 0);
+        }
+
+        std::size_t kept(0);
+        for(std::size_t idx(0); idx < count; ++idx)
+        {
+            client & cl(clients[idx]);
+            connection & c(*cl.f_connection);
+            if(fds[idx * 2].revents != 0
+            && (!c.receive() || !process(cl.f_connection)))
+            {
+                end_session(c);
+                cl.f_reading = false;
+            }
+            if(fds[idx * 2 + 1].revents != 0)
+            {
+                c.flush();
+            }
+            if(cl.f_reading
+            && c.broken())
+            {
+                end_session(c);
+                cl.f_reading = false;
+            }
+
+            // the jobs hold a reference to their connection
+            //
+            if(!cl.f_reading
+            && (c.broken()
+                || (!c.has_output() && cl.f_connection.use_count() == 1)))
+            {
+                continue;
+            }
+            clients[kept] = std::move(cl);
+            ++kept;
+        }
+        clients.resize(kept);
+
+        if(listener >= 0
+        && (fds[count * 2 + 1].revents & POLLIN) != 0)
+        {
+            int const fd(accept4(listener, nullptr, nullptr, SOCK_CLOEXEC | SOCK_NONBLOCK));
+            if(fd >= 0)
+            {
+                clients.push_back(client{ std::make_shared<connection>(fd, fd, true, f_wakeup[1]) });
+            }
+            else if(errno != EINTR
+                 && errno != ECONNABORTED
+                 && errno != EAGAIN)
+            {
+                std::cerr << "error: could not accept a connection.\n";
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+
+// execute all the complete requests received so far; returns false to
+// end the session (QUIT or a request which can't be skipped)
+//
+bool server::process(std::shared_ptr<connection> const & c)
+{
+    for(;;)
+    {
+        std::string_view const data(c->pending());
+        std::string_view::size_type const nl(data.find('\n'));
+        if(nl == std::string_view::npos)
+        {
+            if(data.size() > MAX_REQUEST_SIZE)
+            {
+                c->send("ERROR - request too long.\n");
+                return false;
+            }
+            return true;
+        }
+        std::string line(data.substr(0, nl));
+        if(!line.empty()
+        && line.back() == '\r')
+        {
+            line.pop_back();
+        }
+        std::istringstream in(line);
+        std::string command;
+        std::string id;
+        in >> command >> id;
+        std::size_t used(nl + 1);
+
+        std::string body;
+        if(command == "SOURCE"
+        || command == "IMAGE")
+        {
+            // without a valid size, the next request can't be found
+            //
+            std::size_t size(0);
+            if(id.empty()
+            || !(in >> size)
+            || size > MAX_REQUEST_SIZE)
+            {
+                c->send("ERROR " + (id.empty() ? std::string("-") : id) + " invalid size.\n");
+                return false;
+            }
+            if(data.size() < used + size)
+            {
+                return true;
+            }
+            body = data.substr(used, size);
+            used += size;
+        }
+        c->consume(used);
+
+        if(command.empty())
+        {
+            continue;
+        }
+        if(command == "QUIT")
+        {
+            return false;
+        }
+        if(id.empty())
+        {
+            c->send("ERROR - " + command + " expects an identifier.\n");
+        }
+        else if(command == "SOURCE")
+        {
+            add_source(*c, id, body);
+        }
+        else if(command == "IMAGE")
+        {
+            add_image(*c, id, body);
+        }
+        else if(command == "RUN"
+             || command == "OPEN")
+        {
+            start(c, id, in, command == "OPEN");
+        }
+        else if(command == "METRICS")
+        {
+            std::ostringstream text;
+            if(f_metrics != nullptr)
+            {
+                f_metrics->print(text);
+            }
+            std::string const data(text.str());
+            c->send("METRICS " + id + " " + std::to_string(data.size()) + "\n" + data);
+        }
+        else if(command == "INPUT")
+        {
+            resume(*c, id, in);
+        }
+        else if(command == "CLOSE")
+        {
+            std::shared_ptr<job> j(c->find_job(id));
+            if(j == nullptr)
+            {
+                c->send("ERROR " + id + " is not open.\n");
+            }
+            else
+            {
+                close_job(j);
+            }
+        }
+        else
+        {
+            c->send("ERROR " + id + " unknown command \"" + command + "\".\n");
+        }
+    }
+}
+
+
+void server::add_source(connection & c, std::string const & id, std::string const & source)
+{
+    std::uint64_t const key(fnv1a(source));
+    std::string hash;
+    {
+        std::lock_guard<std::mutex> lock(f_programs_mutex);
+        auto const it(f_sources.find(key));
+        if(it != f_sources.end()
+        && it->second.f_source == source
+        && f_programs.count(it->second.f_hash) != 0)
+        {
+            hash = it->second.f_hash;
+            f_sources_used.splice(f_sources_used.begin(), f_sources_used, it->second.f_used);
+        }
+    }
+    if(f_loop_counters != nullptr)
+    {
+        (hash.empty() ? f_loop_counters->f_cache_misses : f_loop_counters->f_cache_hits).add();
+    }
+    if(hash.empty())
+    {
+        auto s(std::make_shared<snapshot>());
+        diagnostics d;
+        if(!assemble(source, s->f_program, d))
+        {
+            std::string msg("ERROR " + id);
+            char const * sep(" ");
+            for(auto const & m : d.messages())
+            {
+                msg += sep;
+                msg += std::to_string(m.f_line);
+                msg += ": ";
+                msg += m.f_message;
+                sep = "; ";
+            }
+            msg += '\n';
+            c.send(msg);
+            return;
+        }
+        s->f_program.f_labels.clear();
+        hash = add_program(s);
+        std::lock_guard<std::mutex> lock(f_programs_mutex);
+        auto it(f_sources.find(key));
+        if(it == f_sources.end())
+        {
+            if(f_sources.size() >= MAX_SOURCES)
+            {
+                f_sources.erase(f_sources_used.back());
+                f_sources_used.pop_back();
+            }
+            f_sources_used.push_front(key);
+            it = f_sources.emplace(key, source_entry()).first;
+            it->second.f_used = f_sources_used.begin();
+        }
+        else
+        {
+            // a different source with the same FNV-1a replaces the other
+            //
+            f_sources_used.splice(f_sources_used.begin(), f_sources_used, it->second.f_used);
+        }
+        it->second.f_source = source;
+        it->second.f_hash = hash;
+    }
+    c.send("PROGRAM " + id + " " + hash + "\n");
+}
+
+
+void server::add_image(connection & c, std::string const & id, std::string const & image)
+{
+    auto s(std::make_shared<snapshot>());
+    if(!load_snapshot(image, "<image " + id + ">", *s))
+    {
+        c.send("ERROR " + id + " invalid image.\n");
+        return;
+    }
+    c.send("PROGRAM " + id + " " + add_program(s) + "\n");
+}
+
+
+bool read_inputs(std::istream & in, std::deque<int> & inputs)
+{
+    int value(0);
+    while(in >> value)
+    {
+        inputs.push_back(value);
+    }
+    return in.eof();
+}
+
+
+void server::start(std::shared_ptr<connection> const & c, std::string const & id, std::istream & in, bool interactive)
+{
+    std::string hash;
+    in >> hash;
+    std::shared_ptr<snapshot const> start(find_program(hash));
+    if(start == nullptr)
+    {
+        c->send("ERROR " + id + " unknown program \"" + hash + "\".\n");
+        return;
+    }
+    auto j(std::make_shared<job>(c, id, start, interactive));
+    j->f_machine.set_limits(f_limits);
+    if(!read_inputs(in, j->f_inputs))
+    {
+        c->send("ERROR " + id + " inputs can only include integers.\n");
+        return;
+    }
+    if(interactive
+    && !c->add_job(j))
+    {
+        c->send("ERROR " + id + " is already open.\n");
+        return;
+    }
+    schedule(j);
+}
+
+
+void server::resume(connection & c, std::string const & id, std::istream & in)
+{
+    std::shared_ptr<job> j(c.find_job(id));
+    if(j == nullptr)
+    {
+        c.send("ERROR " + id + " is not open.\n");
+        return;
+    }
+    bool valid(true);
+    {
+        std::lock_guard<std::mutex> lock(j->f_mutex);
+        valid = read_inputs(in, j->f_inputs);
+        if(!j->f_running
+        && !j->f_inputs.empty())
+        {
+            j->f_running = true;
+            schedule(j);
+        }
+    }
+    if(!valid)
+    {
+        c.send("ERROR " + id + " inputs can only include integers.\n");
+    }
+}
+
+
+// a suspended machine ends right away, a running one the next time it
+// needs an input which is not available
+//
+void server::close_job(std::shared_ptr<job> const & j)
+{
+    {
+        std::lock_guard<std::mutex> lock(j->f_mutex);
+        j->f_closed = true;
+        if(j->f_running)
+        {
+            return;
+        }
+    }
+
+    // a suspended job stays suspended once f_closed is set
+    //
+    if(f_loop_counters != nullptr)
+    {
+        f_loop_counters->job_done();
+    }
+    j->f_connection->remove_job(j.get());
+    j->f_connection->send(
+              "DONE " + j->f_id
+            + " " + status_name(STATUS_NO_INPUT)
+            + " " + std::to_string(j->f_machine.steps() - j->f_start->f_steps)
+            + "\n");
+}
+
+
+void server::end_session(connection & c)
+{
+    for(auto const & j : c.take_jobs())
+    {
+        close_job(j);
+    }
+}
+
+
+// the hash is computed from the cells and registers (the same key as the
+// result cache without limits and inputs) so a source and its image end
+// up as the same entry
+//
+std::string server::add_program(std::shared_ptr<snapshot const> s)
+{
+    std::uint64_t const h(fnv1a(result_cache::key(*s, limits(), std::vector<int>())));
+    char hash[32];
+    snprintf(hash, sizeof(hash), "%016llx", static_cast<unsigned long long>(h));
+
+    std::lock_guard<std::mutex> lock(f_programs_mutex);
+    auto const it(f_programs.find(hash));
+    if(it != f_programs.end())
+    {
+        f_programs_used.splice(f_programs_used.begin(), f_programs_used, it->second.f_used);
+        return hash;
+    }
+    if(f_programs.size() >= MAX_PROGRAMS)
+    {
+        f_programs.erase(f_programs_used.back());
+        f_programs_used.pop_back();
+    }
+    f_programs_used.push_front(hash);
+    program_entry & e(f_programs[hash]);
+    e.f_snapshot = s;
+    e.f_used = f_programs_used.begin();
+    return hash;
+}
+
+
+std::shared_ptr<snapshot const> server::find_program(std::string const & hash)
+{
+    std::lock_guard<std::mutex> lock(f_programs_mutex);
+    auto const it(f_programs.find(hash));
+    if(it == f_programs.end())
+    {
+        return std::shared_ptr<snapshot const>();
+    }
+    f_programs_used.splice(f_programs_used.begin(), f_programs_used, it->second.f_used);
+    return it->second.f_snapshot;
+}
+
+
+void server::schedule(std::shared_ptr<job> j)
+{
+    {
+        std::lock_guard<std::mutex> lock(f_queue_mutex);
+        f_queue.push_back(std::move(j));
+    }
+    f_queue_cond.notify_one();
+}
+
+
+void server::worker()
+{
+    thread_metrics * counters(f_metrics == nullptr ? nullptr : &f_metrics->add_thread());
+    for(;;)
+    {
+        std::shared_ptr<job> j;
+        {
+            std::unique_lock<std::mutex> lock(f_queue_mutex);
+            f_queue_cond.wait(lock, [this]() { return f_quit || !f_queue.empty(); });
+            if(f_queue.empty())
+            {
+                return;
+            }
+            j = std::move(f_queue.front());
+            f_queue.pop_front();
+        }
+        execute(j, counters);
+
+        // the event loop drops the connections of ended sessions once
+        // their jobs are gone
+        //
+        j.reset();
+        wake();
+    }
+}
+
+
+// the machine runs until it stops; an OPEN job which needs more input is
+// suspended (WAIT) and the worker moves on to the next job in the queue,
+// the machine keeps its registers so the next run() resumes on the INP
+//
+void server::execute(std::shared_ptr<job> const & j, thread_metrics * counters)
+{
+    for(;;)
+    {
+        std::uint64_t const before(j->f_machine.steps());
+        status_t const status(j->f_machine.run(f_engine));
+        if(counters != nullptr)
+        {
+            counters->run(f_engine, status, j->f_machine.steps() - before);
+        }
+        j->f_output.flush();
+        std::string const steps(std::to_string(j->f_machine.steps() - j->f_start->f_steps));
+        if(status == STATUS_NO_INPUT)
+        {
+            bool suspend(false);
+            {
+                std::lock_guard<std::mutex> lock(j->f_mutex);
+                suspend = j->f_inputs.empty()
+                       && j->f_interactive
+                       && !j->f_closed;
+            }
+            if(suspend)
+            {
+                // the WAIT goes out while f_running is still true so the
+                // answers to the next INPUT can't come first; an INPUT or a
+                // CLOSE which arrives meanwhile is handled below
+                //
+                j->f_connection->send("WAIT " + j->f_id + " " + steps + "\n");
+                std::lock_guard<std::mutex> lock(j->f_mutex);
+                if(j->f_inputs.empty()
+                && !j->f_closed)
+                {
+                    j->f_running = false;
+                    return;
+                }
+            }
+            bool more(false);
+            {
+                std::lock_guard<std::mutex> lock(j->f_mutex);
+                more = !j->f_inputs.empty();
+            }
+            if(more)
+            {
+                // an INPUT arrived after the INP failed
+                //
+                continue;
+            }
+        }
+        if(counters != nullptr)
+        {
+            counters->job_done();
+        }
+        if(j->f_interactive)
+        {
+            j->f_connection->remove_job(j.get());
+        }
+        j->f_connection->send("DONE " + j->f_id + " " + status_name(status) + " " + steps + "\n");
+        return;
+    }
+}
+
+
+
+} // no name namespace
+
+
+
+// an empty path serves stdin and stdout until the end of the input, then
+// waits for the last runs; otherwise the function only returns on errors
+//
+int serve(std::string const & socket_path, engine_t engine, limits const & l, int threads, metrics * stats)
+{
+    // a client closing its end early must not kill the server
+    //
+    signal(SIGPIPE, SIG_IGN);
+
+    server s(engine, l, threads, stats);
+    if(socket_path.empty())
+    {
+        return s.loop(-1, true);
+    }
+
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if(socket_path.length() >= sizeof(addr.sun_path))
+    {
+        std::cerr << "error: socket path \"" << socket_path << "\" is too long.\n";
+        return 1;
+    }
+    strncpy(addr.sun_path, socket_path.c_str(), sizeof(addr.sun_path) - 1);
+
+    int const fd(socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0));
+    if(fd < 0)
+    {
+        std::cerr << "error: could not create a socket.\n";
+        return 1;
+    }
+    unlink(socket_path.c_str());
+    if(bind(fd, reinterpret_cast<sockaddr const *>(&addr), sizeof(addr)) != 0
+    || listen(fd, SOMAXCONN) != 0)
+    {
+        close(fd);
+        std::cerr << "error: could not listen on \"" << socket_path << "\".\n";
+        return 1;
+    }
+    int const result(s.loop(fd, false));
+    close(fd);
+    return result;
+}
+
+
+
+} // namespace lmc
+// vim: ts=4 sw=4 et
@@ -0,0 +1,80 @@
+// Written by Alexis Wilke based on
+// https://en.wikipedia.org/wiki/Little_man_computer
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Source: 
+// https://github.com/AlexisWilke/little-man-computer
+
+
+#pragma once
+
+#include    "machine.h"
+
+
+namespace lmc
+{
+
+
+
+// The server reads requests from a Unix socket (any number of clients)
+// or from stdin (answers go to stdout). Requests and answers are lines of
+// text; each request starts with an identifier chosen by the client which
+// is repeated in the answers so runs can be matched with their results
+// since they execute in parallel and may finish in any order:
+//
+//     SOURCE <id> <size>\n<size bytes of assembly>
+//                          -> PROGRAM <id> <hash>
+//                          -> ERROR <id> <messages>
+//     IMAGE <id> <size>\n<size bytes of a .lmcb program or snapshot>
+//                          -> PROGRAM <id> <hash>
+//                          -> ERROR <id> <message>
+//     RUN <id> <hash> [<input> ...]
+//                          -> OUT <id> <value>         (once per OUT)
+//                          -> DONE <id> <status> <steps>
+//                          -> ERROR <id> <message>
+//     OPEN <id> <hash> [<input> ...]
+//                          same as RUN except that an INP without input
+//                          suspends the machine until the next INPUT:
+//                          -> WAIT <id> <steps>
+//     INPUT <id> <input> [<input> ...]
+//                          resume the machine suspended by OPEN <id>
+//     CLOSE <id>           no more input for OPEN <id>
+//                          -> DONE <id> no-input <steps>
+//     METRICS <id>         the counters of the server (see metrics.h)
+//                          -> METRICS <id> <size>\n<size bytes of text>
+//     QUIT                 end the session
+//
+// The <hash> identifies the assembled program in the cache of the server
+// (the same source or image always gives the same hash) so a program is
+// sent once and run any number of times. The server keeps the 1024 most
+// recently used programs; an older <hash> gets "unknown program" and the
+// client has to send that program again. The <status> is one of halted,
+// no-input, step-limit or timeout.
+//
+// A suspended machine does not hold a thread: one thread polls all the
+// clients and the runs go to a pool of workers only when they can execute.
+// The answers are queued per client and written when its socket accepts
+// them, so a client which stops reading does not slow down the others;
+// its session ends once 16 MiB of answers are waiting.
+//
+class metrics;
+
+
+int         serve(std::string const & socket_path, engine_t engine, limits const & l, int threads, metrics * stats = nullptr);
+
+
+
+} // namespace lmc
+// vim: ts=4 sw=4 et
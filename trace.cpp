@@ -0,0 +1,216 @@
+// Written by Alexis Wilke based on
+// https://en.wikipedia.org/wiki/Little_man_computer
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Source: 
+// https://github.com/AlexisWilke/little-man-computer
+
+
+#include    "trace.h"
+
+#include    <cerrno>
+#include    <cstring>
+#include    <iomanip>
+
+#include    <fcntl.h>
+#include    <sys/mman.h>
+#include    <sys/stat.h>
+#include    <unistd.h>
+
+
+
+namespace lmc
+{
+
+
+
+namespace
+{
+
+
+
+char const  g_magic[4] = { 'L', 'M', 'C', 'T' };
+
+
+std::uint16_t get16(unsigned char const * buf)
+{
+    return buf[0] | (buf[1] << 8);
+}
+
+
+
+} // no name namespace
+
+
+
+// the buffer only gets allocated by open() so a machine which is not
+// traced does not pay for it
+//
+trace::trace()
+{
+}
+
+
+trace::~trace()
+{
+    close();
+    delete [] f_buffer;
+}
+
+
+bool trace::open(std::string const & filename)
+{
+    close();
+    f_fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if(f_fd < 0)
+    {
+        std::cerr << "error: could not open \"" << filename
+            << "\" for writing.\n";
+        return false;
+    }
+    f_failed = false;
+    if(f_buffer == nullptr)
+    {
+        f_buffer = new unsigned char[BUFFER_SIZE];
+    }
+    memset(f_buffer, 0, TRACE_HEADER_SIZE);
+    memcpy(f_buffer, g_magic, sizeof(g_magic));
+    f_buffer[4] = TRACE_VERSION;
+    f_buffer[5] = TRACE_VERSION >> 8;
+    f_buffer[6] = TRACE_RECORD_SIZE;
+    f_buffer[7] = TRACE_RECORD_SIZE >> 8;
+
+    // the header is the size of two records so the buffer stays aligned
+    //
+    static_assert(TRACE_HEADER_SIZE % TRACE_RECORD_SIZE == 0);
+    f_pos = TRACE_HEADER_SIZE;
+    return true;
+}
+
+
+// write the rest of the buffer; returns false if any write failed since
+// the trace was opened
+//
+bool trace::close()
+{
+    if(f_fd < 0)
+    {
+        return true;
+    }
+    write_buffer();
+    if(::close(f_fd) != 0)
+    {
+        f_failed = true;
+    }
+    f_fd = -1;
+    return !f_failed;
+}
+
+
+void trace::write_buffer()
+{
+    unsigned char const * s(f_buffer);
+    while(f_pos > 0 && !f_failed)
+    {
+        ssize_t const r(::write(f_fd, s, f_pos));
+        if(r < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            f_failed = true;
+            break;
+        }
+        s += r;
+        f_pos -= r;
+    }
+    f_pos = 0;
+}
+
+
+// one line per record: step number, address, label, instruction and the
+// registers once the instruction ran
+//
+bool print_trace(std::string const & filename, program const & p, std::ostream & out)
+{
+    int const fd(::open(filename.c_str(), O_RDONLY | O_CLOEXEC));
+    if(fd < 0)
+    {
+        std::cerr << "error: could not open \"" << filename
+            << "\" for reading.\n";
+        return false;
+    }
+    struct stat st;
+    if(fstat(fd, &st) != 0
+    || static_cast<std::size_t>(st.st_size) < TRACE_HEADER_SIZE)
+    {
+        ::close(fd);
+        std::cerr << "error:" << filename << ": file too small for a trace.\n";
+        return false;
+    }
+    void * const map(mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0));
+    ::close(fd);
+    if(map == MAP_FAILED)
+    {
+        std::cerr << "error:" << filename << ": could not map trace in memory.\n";
+        return false;
+    }
+    unsigned char const * const buf(reinterpret_cast<unsigned char const *>(map));
+    std::size_t const size(st.st_size);
+
+    bool result(false);
+    if(memcmp(buf, g_magic, sizeof(g_magic)) != 0)
+    {
+        std::cerr << "error:" << filename << ": not an LMC trace.\n";
+    }
+    else if(get16(buf + 4) != TRACE_VERSION
+         || get16(buf + 6) != TRACE_RECORD_SIZE)
+    {
+        std::cerr << "error:" << filename << ": unsupported trace version "
+            << get16(buf + 4) << ".\n";
+    }
+    else
+    {
+        result = true;
+        out << "   step address label        instruction           acc overflow\n";
+        std::uint64_t step(0);
+        for(std::size_t pos(TRACE_HEADER_SIZE); pos + TRACE_RECORD_SIZE <= size; pos += TRACE_RECORD_SIZE)
+        {
+            unsigned char const * const r(buf + pos);
+            ++step;
+            out << std::right << std::setw(7) << step
+                << std::setw(8) << static_cast<int>(r[0])
+                << ' ' << std::left << std::setw(12) << label_name(p, r[0])
+                << ' ' << std::setw(20) << disassemble(p, static_cast<std::int16_t>(get16(r + 2)))
+                << std::right << std::setw(5) << static_cast<std::int16_t>(get16(r + 4))
+                << ((r[1] & 1) != 0 ? " yes" : " no")
+                << '\n';
+        }
+        if((size - TRACE_HEADER_SIZE) % TRACE_RECORD_SIZE != 0)
+        {
+            std::cerr << "error:" << filename << ": trace ends with a partial record.\n";
+            result = false;
+        }
+    }
+
+    munmap(map, size);
+    return result;
+}
+
+
+
+} // namespace lmc
+// vim: ts=4 sw=4 et
@@ -0,0 +1,112 @@
+// Written by Alexis Wilke based on
+// https://en.wikipedia.org/wiki/Little_man_computer
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Source: 
+// https://github.com/AlexisWilke/little-man-computer
+
+
+#pragma once
+
+#include    "program.h"
+
+#include    <cstdint>
+#include    <iostream>
+
+
+namespace lmc
+{
+
+
+
+// A trace file is a 16 byte header followed by one fixed size record per
+// instruction executed, all in little endian:
+//
+//     offset  size  field
+//          0     4  magic "LMCT"
+//          4     2  version (1)
+//          6     2  size of one record (8)
+//          8     8  reserved (0)
+//
+// and each record:
+//
+//     offset  size  field
+//          0     1  PC of the instruction
+//          1     1  flags (bit 0: overflow, after the instruction)
+//          2     2  the instruction cell, i.e. opcode * 100 + operand
+//          4     2  accumulator after the instruction (signed)
+//          6     2  reserved (0)
+//
+constexpr std::uint16_t     TRACE_VERSION = 1;
+constexpr std::size_t       TRACE_HEADER_SIZE = 16;
+constexpr std::size_t       TRACE_RECORD_SIZE = 8;
+
+
+// The machine calls on_executed() after each instruction when a trace is
+// attached (see machine::set_trace()); the record is built in a large
+// buffer which gets written with one write(2) when full so the cost per
+// step is a few stores
+//
+class trace
+{
+public:
+                        trace();
+                        trace(trace const &) = delete;
+                        ~trace();
+    trace &             operator = (trace const &) = delete;
+
+    bool                open(std::string const & filename);
+    bool                close();
+
+    void                on_step(int pc) { (void)pc; }
+    void                on_branch(int pc, bool taken) { (void)pc; (void)taken; }
+    void                on_store(int loc) { (void)loc; }
+    void                on_executed(int pc, short cell, int acc, bool overflow)
+                        {
+                            if(f_pos == BUFFER_SIZE)
+                            {
+                                write_buffer();
+                            }
+                            unsigned char * const r(f_buffer + f_pos);
+                            r[0] = pc;
+                            r[1] = overflow ? 1 : 0;
+                            r[2] = cell;
+                            r[3] = cell >> 8;
+                            r[4] = acc;
+                            r[5] = acc >> 8;
+                            r[6] = 0;
+                            r[7] = 0;
+                            f_pos += TRACE_RECORD_SIZE;
+                        }
+
+private:
+    static constexpr std::size_t
+                        BUFFER_SIZE = 1024 * 1024 / TRACE_RECORD_SIZE * TRACE_RECORD_SIZE;
+
+    void                write_buffer();
+
+    int                 f_fd = -1;
+    bool                f_failed = false;
+    std::size_t         f_pos = 0;
+    unsigned char *     f_buffer = nullptr;
+};
+
+
+bool        print_trace(std::string const & filename, program const & p, std::ostream & out);
+
+
+
+} // namespace lmc
+// vim: ts=4 sw=4 et
@@ -0,0 +1,300 @@
+// Written by Alexis Wilke based on
+// https://en.wikipedia.org/wiki/Little_man_computer
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Source: 
+// https://github.com/AlexisWilke/little-man-computer
+
+
+#include    "transpile.h"
+
+#include    "analysis.h"
+
+#include    <fstream>
+#include    <iomanip>
+
+
+
+namespace lmc
+{
+
+
+
+namespace
+{
+
+
+
+// the helpers are [[maybe_unused]] since a program without INP or OUT
+// does not call them
+//
+char const g_header[] =
+    "// Generated by little-man-computer -c; do not edit.\n"
+    "\n"
+    "#include <cstdio>\n"
+    "\n"
+    "\n"
+    "[[maybe_unused]] static bool input(int & acc)\n"
+    "{\n"
+    "    int value(0);\n"
+    "    if(scanf(\"%d\", &value) != 1)\n"
+    "    {\n"
+    "        return false;\n"
+    "    }\n"
+    "    acc = value % 1000;\n"
+    "    return true;\n"
+    "}\n"
+    "\n"
+    "\n"
+    "[[maybe_unused]] static void output(int acc)\n"
+    "{\n"
+    "    printf(\"%d\\n\", acc);\n"
+    "}\n"
+    "\n"
+    "\n"
+    "[[maybe_unused]] static int no_input(int pc)\n"
+    "{\n"
+    "    fflush(stdout);\n"
+    "    fprintf(stderr, \"\\nerror: no more input available (PC: %d).\\n\", pc);\n"
+    "    return 1;\n"
+    "}\n"
+    "\n"
+    "\n";
+
+
+// used by the self-modifying version for cells which do not hold their
+// original instruction anymore; same semantic as machine::run_switch()
+//
+char const g_step[] =
+    "// returns -1 to continue, otherwise the exit code of the program\n"
+    "//\n"
+    "static int step(short * m, int & pc, int & acc, bool & ovf)\n"
+    "{\n"
+    "    int const here(pc);\n"
+    "    int const instruction(m[pc] / 100);\n"
+    "    int const loc(m[pc] % 100);\n"
+    "    pc = pc == 99 ? 0 : pc + 1;\n"
+    "    switch(instruction)\n"
+    "    {\n"
+    "    case 0: return 0;\n"
+    "    case 1: ovf = acc + m[loc] > 999; acc = (acc + m[loc]) % 1000; break;\n"
+    "    case 2: ovf = acc < m[loc]; acc = (acc - m[loc]) % 1000; break;\n"
+    "    case 3: m[loc] = acc; break;\n"
+    "    case 4: acc = m[loc]; break;\n"
+    "    case 5: pc = loc; break;\n"
+    "    case 6: if(acc == 0) pc = loc; break;\n"
+    "    case 7: if(!ovf) pc = loc; break;\n"
+    "    case 8: if(!input(acc)) return no_input(here); break;\n"
+    "    case 9: output(acc); break;\n"
+    "    }\n"
+    "    return -1;\n"
+    "}\n"
+    "\n"
+    "\n";
+
+
+struct decoded_t
+{
+    int             f_instruction = -1;     // -1 for cells which are ignored
+    int             f_loc = 0;
+};
+
+
+decoded_t decode(short cell)
+{
+    decoded_t d;
+    int const instruction(cell / 100);
+    if(instruction >= MNEMONIC_HLT && instruction <= MNEMONIC_OUT)
+    {
+        d.f_instruction = instruction;
+    }
+    d.f_loc = cell % 100;
+    return d;
+}
+
+
+std::string label(int pc)
+{
+    std::string result("L00");
+    result[1] = '0' + pc / 10;
+    result[2] = '0' + pc % 10;
+    return result;
+}
+
+
+
+} // no name namespace
+
+
+
+void transpile(program const & p, std::ostream & out)
+{
+    analysis a;
+    analyze(p.f_cells, a);
+    bool const self_modifying(a.f_self_modifying);
+
+    out << g_header;
+    if(self_modifying)
+    {
+        out << g_step;
+    }
+
+    out << "int main()\n"
+        << "{\n"
+        << "    " << (self_modifying ? "" : "[[maybe_unused]] ")
+        << "short m[" << MEMORY_SIZE << "] =\n"
+        << "    {";
+    for(std::size_t pc(0); pc < MEMORY_SIZE; ++pc)
+    {
+        out << (pc % 10 == 0 ? "\n        " : " ")
+            << p.f_cells[pc] << ',';
+    }
+    out << "\n    };\n"
+        << "    int acc(0);\n"
+        << "    bool ovf(false);\n";
+    if(self_modifying)
+    {
+        out << "    int pc(0);\n"
+            << "    (void)ovf;\n"
+            << "    goto L00;\n"
+            << "\n"
+            << "slow:\n"
+            << "    {\n"
+            << "        int const code(step(m, pc, acc, ovf));\n"
+            << "        if(code != -1)\n"
+            << "        {\n"
+            << "            return code;\n"
+            << "        }\n"
+            << "    }\n"
+            << "    switch(pc)\n"
+            << "    {\n";
+        for(std::size_t pc(0); pc < MEMORY_SIZE; ++pc)
+        {
+            out << "    case " << pc << ": goto " << label(pc) << ";\n";
+        }
+        out << "    }\n";
+    }
+    else
+    {
+        out << "    (void)ovf;\n";
+    }
+    out << "\n";
+
+    // in the self-modifying case all the cells are emitted (the modified
+    // code could jump anywhere) and verified before they get executed
+    //
+    bool falls_through(false);
+    for(std::size_t pc(0); pc < MEMORY_SIZE; ++pc)
+    {
+        if(!self_modifying && a.f_kind[pc] != CELL_CODE)
+        {
+            continue;
+        }
+        short const cell(p.f_cells[pc]);
+        decoded_t const d(decode(cell));
+        int const loc(d.f_loc);
+        if(self_modifying || a.f_target[pc])
+        {
+            out << label(pc) << ":\n";
+        }
+        out << "    // " << std::setw(2) << pc << ": " << disassemble(p, cell) << "\n";
+        if(self_modifying)
+        {
+            out << "    if(m[" << pc << "] != " << cell << ") { pc = " << pc << "; goto slow; }\n";
+        }
+        falls_through = true;
+        switch(d.f_instruction)
+        {
+        case MNEMONIC_HLT:
+            out << "    return 0;\n";
+            falls_through = false;
+            break;
+
+        case MNEMONIC_ADD:
+            out << "    ovf = acc + m[" << loc << "] > 999;\n"
+                << "    acc = (acc + m[" << loc << "]) % 1000;\n";
+            break;
+
+        case MNEMONIC_SUB:
+            out << "    ovf = acc < m[" << loc << "];\n"
+                << "    acc = (acc - m[" << loc << "]) % 1000;\n";
+            break;
+
+        case MNEMONIC_STA:
+            out << "    m[" << loc << "] = acc;\n";
+            break;
+
+        case MNEMONIC_LDA:
+            out << "    acc = m[" << loc << "];\n";
+            break;
+
+        case MNEMONIC_BRA:
+            out << "    goto " << label(loc) << ";\n";
+            falls_through = false;
+            break;
+
+        case MNEMONIC_BRZ:
+            out << "    if(acc == 0) goto " << label(loc) << ";\n";
+            break;
+
+        case MNEMONIC_BRP:
+            out << "    if(!ovf) goto " << label(loc) << ";\n";
+            break;
+
+        case MNEMONIC_INP:
+            out << "    if(!input(acc)) return no_input(" << pc << ");\n";
+            break;
+
+        case MNEMONIC_OUT:
+            out << "    output(acc);\n";
+            break;
+
+        default:
+            // ignored
+            break;
+
+        }
+    }
+    if(falls_through)
+    {
+        out << "    goto L00;\n";
+    }
+    out << "}\n";
+}
+
+
+bool transpile(program const & p, std::string const & filename)
+{
+    std::ofstream out(filename);
+    if(!out.is_open())
+    {
+        std::cerr << "error: could not open \"" << filename
+            << "\" for writing.\n";
+        return false;
+    }
+    transpile(p, out);
+    if(!out)
+    {
+        std::cerr << "error: could not write C++ to \"" << filename
+            << "\".\n";
+        return false;
+    }
+    return true;
+}
+
+
+
+} // namespace lmc
+// vim: ts=4 sw=4 et
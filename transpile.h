@@ -0,0 +1,45 @@
+// Written by Alexis Wilke based on
+// https://en.wikipedia.org/wiki/Little_man_computer
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Source: 
+// https://github.com/AlexisWilke/little-man-computer
+
+
+#pragma once
+
+#include    "program.h"
+
+#include    <iostream>
+
+
+namespace lmc
+{
+
+
+
+// Translate a program to a standalone C++ program. When no STA can write
+// to a mailbox reachable as code, each mailbox becomes a label followed
+// by straight-line code; otherwise each mailbox first verifies that its
+// cell was not modified and, if it was, runs it through a generic
+// interpreter function and a switch() to jump back in the native code.
+//
+void        transpile(program const & p, std::ostream & out);
+bool        transpile(program const & p, std::string const & filename);
+
+
+
+} // namespace lmc
+// vim: ts=4 sw=4 et